@@ -55,6 +55,31 @@ typedef struct devsdk_commandrequest
   iot_data_type_t type;
 } devsdk_commandrequest;
 
+/**
+ * @brief A numeric or boolean reading held in place, see devsdk_commandresult_set_int() etc.
+ */
+
+typedef enum devsdk_scalar_kind
+{
+  DEVSDK_SCALAR_NONE,
+  DEVSDK_SCALAR_INT,
+  DEVSDK_SCALAR_UINT,
+  DEVSDK_SCALAR_FLOAT,
+  DEVSDK_SCALAR_BOOL
+} devsdk_scalar_kind;
+
+typedef struct devsdk_scalar
+{
+  devsdk_scalar_kind kind;
+  union
+  {
+    int64_t i;
+    uint64_t ui;
+    double f;
+    bool b;
+  } v;
+} devsdk_scalar;
+
 /**
  * @brief Structure containing the result of a get operation.
  */
@@ -65,6 +90,8 @@ typedef struct devsdk_commandresult
   uint64_t origin;
   /** The result. */
   iot_data_t *value;
+  /** Alternatively, a numeric or boolean result may be set here using the devsdk_commandresult_set functions. It is used only if value is NULL. */
+  devsdk_scalar scalar;
 } devsdk_commandresult;
 
 #ifdef __cplusplus
@@ -177,6 +204,19 @@ devsdk_protocols *devsdk_protocols_dup (const devsdk_protocols *e);
 
 void devsdk_protocols_free (devsdk_protocols *e);
 
+/**
+ * @brief Set a numeric or boolean result in place, without allocating an iot_data_t. The value is converted to the type of
+ *        the device resource when the reading is generated. These functions may not be used for string or binary resources.
+ *        For AutoEvents the result array is reused, and readings set in this way need not be allocated at all.
+ * @param res The result to set.
+ * @param val The value.
+ */
+
+void devsdk_commandresult_set_int (devsdk_commandresult *res, int64_t val);
+void devsdk_commandresult_set_uint (devsdk_commandresult *res, uint64_t val);
+void devsdk_commandresult_set_float (devsdk_commandresult *res, double val);
+void devsdk_commandresult_set_bool (devsdk_commandresult *res, bool val);
+
 #ifdef __cplusplus
 }
 #endif
@@ -117,7 +117,7 @@ typedef void (*devsdk_stop) (void *impl, bool force);
  * @param resource_name The resource on which autoevents have been configured.
  * @param nreadings The number of readings requested.
  * @param requests An array specifying the readings that have been requested.
- * @param interval The time between events, in milliseconds.
+ * @param interval The time between events, in milliseconds. Shorter intervals are rounded up to 1.
  * @param onChange If true, events should only be generated if one or more readings have changed.
  * @return A pointer to a data structure that will be provided in a subsequent call to the stop handler.
  */
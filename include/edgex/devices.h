@@ -120,6 +120,72 @@ edgex_device * edgex_get_device_byname (devsdk_service_t *svc, const char *name)
 
 void edgex_free_device (edgex_device *d);
 
+/**
+ * @brief A snapshot of the devices and profiles known to the service. The
+ *        devices and profiles in a snapshot are shared with the service and
+ *        must not be modified; they remain valid until the snapshot is
+ *        released. Snapshots must be released before the service is freed.
+ */
+
+typedef struct edgex_snapshot edgex_snapshot;
+
+/**
+ * @brief Position within a snapshot. Initialize with EDGEX_SNAPSHOT_ITER_INIT
+ *        before iterating; use a separate iterator for devices and profiles.
+ */
+
+typedef struct edgex_snapshot_iter
+{
+  unsigned pos;
+} edgex_snapshot_iter;
+
+#define EDGEX_SNAPSHOT_ITER_INIT { 0 }
+
+/**
+ * @brief Obtain a snapshot of the current devices and profiles. Snapshots are
+ *        shared: this takes a reference on the service's current snapshot,
+ *        which is only rebuilt (in time proportional to the number of
+ *        devices) after the devices or profiles have changed.
+ * @param svc The device service.
+ * @returns The snapshot, to be released with edgex_snapshot_release.
+ */
+
+edgex_snapshot *edgex_snapshot_acquire (devsdk_service_t *svc);
+
+/**
+ * @brief Release a snapshot.
+ * @param snap The snapshot.
+ */
+
+void edgex_snapshot_release (edgex_snapshot *snap);
+
+/**
+ * @brief Iterate over the devices in a snapshot.
+ * @param snap The snapshot.
+ * @param iter The iterator, which is advanced.
+ * @returns The next device, or NULL if there are no more.
+ */
+
+const edgex_device *edgex_snapshot_next_device (const edgex_snapshot *snap, edgex_snapshot_iter *iter);
+
+/**
+ * @brief Iterate over the device profiles in a snapshot.
+ * @param snap The snapshot.
+ * @param iter The iterator, which is advanced.
+ * @returns The next device profile, or NULL if there are no more.
+ */
+
+const edgex_deviceprofile *edgex_snapshot_next_profile (const edgex_snapshot *snap, edgex_snapshot_iter *iter);
+
+/**
+ * @brief Find a device in a snapshot.
+ * @param snap The snapshot.
+ * @param name The device name.
+ * @returns The device, or NULL if it is not present in the snapshot.
+ */
+
+const edgex_device *edgex_snapshot_device_byname (const edgex_snapshot *snap, const char *name);
+
 #ifdef __cplusplus
 }
 #endif
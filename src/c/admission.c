@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "admission.h"
+#include "map.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <microhttpd.h>
+
+typedef edgex_map(uint32_t) edgex_map_uint32;
+
+struct edgex_admission_t
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t maxinflight;
+  uint32_t maxdevice;
+  uint32_t queuelen;
+  uint32_t timeout;
+  uint32_t inflight;
+  uint32_t waiting;
+  uint64_t admitted;
+  uint64_t queued;
+  uint64_t shed;
+  edgex_map_uint32 devcounts;
+};
+
+edgex_admission_t *edgex_admission_alloc
+  (uint32_t maxinflight, uint32_t maxdevice, uint32_t queuelen, uint32_t timeout)
+{
+  pthread_condattr_t attr;
+  edgex_admission_t *adm = calloc (1, sizeof (edgex_admission_t));
+  adm->maxinflight = maxinflight;
+  adm->maxdevice = maxdevice;
+  adm->queuelen = queuelen;
+  adm->timeout = timeout;
+  edgex_map_init (&adm->devcounts);
+  pthread_mutex_init (&adm->lock, NULL);
+  pthread_condattr_init (&attr);
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+  pthread_cond_init (&adm->cond, &attr);
+  pthread_condattr_destroy (&attr);
+  return adm;
+}
+
+void edgex_admission_free (edgex_admission_t *adm)
+{
+  if (adm)
+  {
+    edgex_map_deinit (&adm->devcounts);
+    pthread_cond_destroy (&adm->cond);
+    pthread_mutex_destroy (&adm->lock);
+    free (adm);
+  }
+}
+
+int edgex_admission_enter (edgex_admission_t *adm, const char *devname)
+{
+  int result = MHD_HTTP_OK;
+  bool waited = false;
+  bool expired = false;
+  struct timespec deadline;
+  uint32_t *count = NULL;
+
+  pthread_mutex_lock (&adm->lock);
+  while (true)
+  {
+    if (adm->maxdevice && devname)
+    {
+      count = edgex_map_get (&adm->devcounts, devname);
+      if (count && *count >= adm->maxdevice)
+      {
+        result = MHD_HTTP_TOO_MANY_REQUESTS;
+        break;
+      }
+    }
+    if (adm->maxinflight == 0 || adm->inflight < adm->maxinflight)
+    {
+      break;
+    }
+    if (expired)
+    {
+      result = MHD_HTTP_SERVICE_UNAVAILABLE;
+      break;
+    }
+    if (!waited)
+    {
+      if (adm->waiting >= adm->queuelen)
+      {
+        result = MHD_HTTP_SERVICE_UNAVAILABLE;
+        break;
+      }
+      waited = true;
+      adm->waiting++;
+      adm->queued++;
+      clock_gettime (CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += adm->timeout / 1000;
+      deadline.tv_nsec += (adm->timeout % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000)
+      {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+    }
+    if (adm->timeout)
+    {
+      expired = (pthread_cond_timedwait (&adm->cond, &adm->lock, &deadline) == ETIMEDOUT);
+    }
+    else
+    {
+      pthread_cond_wait (&adm->cond, &adm->lock);
+    }
+  }
+
+  if (waited)
+  {
+    adm->waiting--;
+  }
+  if (result == MHD_HTTP_OK)
+  {
+    adm->inflight++;
+    adm->admitted++;
+    if (adm->maxdevice && devname)
+    {
+      if (count)
+      {
+        (*count)++;
+      }
+      else
+      {
+        edgex_map_set (&adm->devcounts, devname, 1);
+      }
+    }
+  }
+  else
+  {
+    adm->shed++;
+  }
+  pthread_mutex_unlock (&adm->lock);
+  return result;
+}
+
+static void devcount_release (edgex_admission_t *adm, const char *devname)
+{
+  uint32_t *count = edgex_map_get (&adm->devcounts, devname);
+  if (count && --(*count) == 0)
+  {
+    edgex_map_remove (&adm->devcounts, devname);
+  }
+}
+
+void edgex_admission_leave (edgex_admission_t *adm, const char *devname)
+{
+  pthread_mutex_lock (&adm->lock);
+  adm->inflight--;
+  if (adm->maxdevice && devname)
+  {
+    devcount_release (adm, devname);
+  }
+  if (adm->waiting)
+  {
+    pthread_cond_broadcast (&adm->cond);
+  }
+  pthread_mutex_unlock (&adm->lock);
+}
+
+int edgex_admission_enter_device (edgex_admission_t *adm, const char *devname)
+{
+  int result = MHD_HTTP_OK;
+
+  if (adm->maxdevice)
+  {
+    pthread_mutex_lock (&adm->lock);
+    uint32_t *count = edgex_map_get (&adm->devcounts, devname);
+    if (count == NULL)
+    {
+      edgex_map_set (&adm->devcounts, devname, 1);
+    }
+    else if (*count < adm->maxdevice)
+    {
+      (*count)++;
+    }
+    else
+    {
+      result = MHD_HTTP_TOO_MANY_REQUESTS;
+      adm->shed++;
+    }
+    pthread_mutex_unlock (&adm->lock);
+  }
+  return result;
+}
+
+void edgex_admission_leave_device (edgex_admission_t *adm, const char *devname)
+{
+  if (adm->maxdevice)
+  {
+    pthread_mutex_lock (&adm->lock);
+    devcount_release (adm, devname);
+    pthread_mutex_unlock (&adm->lock);
+  }
+}
+
+void edgex_admission_getstats
+  (edgex_admission_t *adm, edgex_admission_stats *stats)
+{
+  pthread_mutex_lock (&adm->lock);
+  stats->admitted = adm->admitted;
+  stats->queued = adm->queued;
+  stats->shed = adm->shed;
+  stats->inflight = adm->inflight;
+  stats->waiting = adm->waiting;
+  pthread_mutex_unlock (&adm->lock);
+}
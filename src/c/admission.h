@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_ADMISSION_H_
+#define _EDGEX_DEVICE_ADMISSION_H_ 1
+
+/* Admission control for device commands. Limits the number of commands in
+ * flight, both overall and per device. Requests over the global limit may
+ * wait in a bounded queue; anything else is shed immediately.
+ */
+
+#include <stdint.h>
+
+struct edgex_admission_t;
+typedef struct edgex_admission_t edgex_admission_t;
+
+typedef struct edgex_admission_stats
+{
+  uint64_t admitted;
+  uint64_t queued;
+  uint64_t shed;
+  uint32_t inflight;
+  uint32_t waiting;
+} edgex_admission_stats;
+
+/*
+ * Limits of zero mean unlimited. The timeout is in milliseconds.
+ */
+
+extern edgex_admission_t *edgex_admission_alloc
+  (uint32_t maxinflight, uint32_t maxdevice, uint32_t queuelen, uint32_t timeout);
+extern void edgex_admission_free (edgex_admission_t *adm);
+
+/*
+ * Request admission for a command on the named device (or NULL for a command
+ * not tied to a single device). Returns MHD_HTTP_OK if the command may run, in
+ * which case edgex_admission_leave must be called on completion. Otherwise
+ * returns MHD_HTTP_TOO_MANY_REQUESTS if the device limit is reached or
+ * MHD_HTTP_SERVICE_UNAVAILABLE if the service is saturated.
+ */
+
+extern int edgex_admission_enter (edgex_admission_t *adm, const char *devname);
+extern void edgex_admission_leave (edgex_admission_t *adm, const char *devname);
+
+/*
+ * Admit a command on the named device against the per-device limit only, for
+ * use within a command already holding a service-wide slot (such as one
+ * addressed to all devices). Returns MHD_HTTP_OK, in which case
+ * edgex_admission_leave_device must be called on completion, or
+ * MHD_HTTP_TOO_MANY_REQUESTS.
+ */
+
+extern int edgex_admission_enter_device (edgex_admission_t *adm, const char *devname);
+extern void edgex_admission_leave_device (edgex_admission_t *adm, const char *devname);
+
+extern void edgex_admission_getstats
+  (edgex_admission_t *adm, edgex_admission_stats *stats);
+
+#endif
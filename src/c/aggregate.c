@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "aggregate.h"
+#include "devutil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+const char *edgex_aggregate_names[] =
+  { "min", "max", "mean", "stddev", "last", "count", NULL };
+
+#define AGG_ALL ((1u << EDGEX_AGG_NTYPES) - 1)
+#define AGG_NONNUMERIC ((1u << EDGEX_AGG_LAST) | (1u << EDGEX_AGG_COUNT))
+
+/* Running statistics for one resource over the current window. The mean and
+ * variance are maintained by Welford's method.
+ */
+
+typedef struct
+{
+  unsigned aggs;
+  uint64_t count;
+  uint64_t nnum;
+  double min;
+  double max;
+  double mean;
+  double m2;
+  devsdk_commandresult last;
+} edgex_aggstate;
+
+/* Each output reading is an aggregate of one resource */
+
+typedef struct
+{
+  unsigned res;
+  edgex_aggregate agg;
+} edgex_aggslot;
+
+struct edgex_aggregator
+{
+  pthread_mutex_t lock;
+  uint64_t window;
+  uint64_t start;
+  bool started;
+  unsigned nreqs;
+  edgex_aggstate *state;
+  edgex_aggslot *slots;
+  edgex_propertyvalue *pvals;
+  edgex_cmdinfo out;
+};
+
+static bool is_numeric (iot_data_type_t type)
+{
+  return type >= IOT_DATA_INT8 && type <= IOT_DATA_FLOAT64;
+}
+
+static bool get_double (const devsdk_commandresult *res, double *d)
+{
+  const iot_data_t *data = res->value;
+
+  if (data == NULL)
+  {
+    switch (res->scalar.kind)
+    {
+      case DEVSDK_SCALAR_INT: *d = res->scalar.v.i; break;
+      case DEVSDK_SCALAR_UINT: *d = res->scalar.v.ui; break;
+      case DEVSDK_SCALAR_FLOAT: *d = res->scalar.v.f; break;
+      default: return false;
+    }
+    return true;
+  }
+  switch (iot_data_type (data))
+  {
+    case IOT_DATA_INT8: *d = iot_data_i8 (data); break;
+    case IOT_DATA_UINT8: *d = iot_data_ui8 (data); break;
+    case IOT_DATA_INT16: *d = iot_data_i16 (data); break;
+    case IOT_DATA_UINT16: *d = iot_data_ui16 (data); break;
+    case IOT_DATA_INT32: *d = iot_data_i32 (data); break;
+    case IOT_DATA_UINT32: *d = iot_data_ui32 (data); break;
+    case IOT_DATA_INT64: *d = iot_data_i64 (data); break;
+    case IOT_DATA_UINT64: *d = iot_data_ui64 (data); break;
+    case IOT_DATA_FLOAT32: *d = iot_data_f32 (data); break;
+    case IOT_DATA_FLOAT64: *d = iot_data_f64 (data); break;
+    default: return false;
+  }
+  return true;
+}
+
+unsigned edgex_aggregates_for (const devsdk_nvpairs *attrs, iot_data_type_t type)
+{
+  unsigned result = 0;
+  const char *window = devsdk_nvpairs_value (attrs, "aggregateWindow");
+  const char *list = devsdk_nvpairs_value (attrs, "aggregates");
+
+  if (window && *window)
+  {
+    if (list && *list)
+    {
+      char *lstr = strdup (list);
+      char *ctx = NULL;
+      for (char *iter = strtok_r (lstr, ", ", &ctx); iter; iter = strtok_r (NULL, ", ", &ctx))
+      {
+        for (unsigned i = 0; edgex_aggregate_names[i]; i++)
+        {
+          if (strcmp (iter, edgex_aggregate_names[i]) == 0)
+          {
+            result |= (1u << i);
+          }
+        }
+      }
+      free (lstr);
+    }
+    else
+    {
+      result = AGG_ALL;
+    }
+    if (!is_numeric (type))
+    {
+      result &= AGG_NONNUMERIC;
+    }
+  }
+  return result;
+}
+
+iot_data_type_t edgex_aggregate_type (edgex_aggregate agg, iot_data_type_t type)
+{
+  switch (agg)
+  {
+    case EDGEX_AGG_LAST: return type;
+    case EDGEX_AGG_COUNT: return IOT_DATA_UINT64;
+    default: return IOT_DATA_FLOAT64;
+  }
+}
+
+static void aggstate_reset (edgex_aggstate *s)
+{
+  s->count = 0;
+  s->nnum = 0;
+  s->min = INFINITY;
+  s->max = -INFINITY;
+  s->mean = 0.0;
+  s->m2 = 0.0;
+}
+
+edgex_aggregator *edgex_aggregator_alloc (const edgex_cmdinfo *cmd, iot_logger_t *lc)
+{
+  edgex_aggregator *a;
+  unsigned nout = 0;
+  uint64_t window = 0;
+
+  for (unsigned i = 0; i < cmd->nreqs; i++)
+  {
+    const char *wstr = devsdk_nvpairs_value (cmd->reqs[i].attributes, "aggregateWindow");
+    if (wstr && *wstr)
+    {
+      uint64_t us = edgex_parse_duration (wstr);
+      if (us == 0)
+      {
+        iot_log_error (lc, "Resource %s: unable to parse \"%s\" for aggregateWindow", cmd->reqs[i].resname, wstr);
+      }
+      else if (window == 0 || us * 1000 < window)
+      {
+        window = us * 1000;
+      }
+    }
+  }
+  if (window == 0)
+  {
+    return NULL;
+  }
+
+  a = calloc (1, sizeof (edgex_aggregator));
+  pthread_mutex_init (&a->lock, NULL);
+  a->window = window;
+  a->nreqs = cmd->nreqs;
+  a->state = calloc (cmd->nreqs, sizeof (edgex_aggstate));
+  for (unsigned i = 0; i < cmd->nreqs; i++)
+  {
+    unsigned aggs = edgex_aggregates_for (cmd->reqs[i].attributes, cmd->pvals[i]->type);
+    a->state[i].aggs = aggs;
+    aggstate_reset (&a->state[i]);
+    nout += aggs ? __builtin_popcount (aggs) : 1;
+  }
+
+  /* Describe the output readings. Aggregates other than last have their own
+   * property values; last, and unaggregated resources, use the resource's.
+   */
+
+  a->slots = calloc (nout, sizeof (edgex_aggslot));
+  a->pvals = calloc (nout, sizeof (edgex_propertyvalue));
+  a->out.name = cmd->name;
+  a->out.isget = true;
+  a->out.nreqs = nout;
+  a->out.reqs = calloc (nout, sizeof (devsdk_commandrequest));
+  a->out.pvals = calloc (nout, sizeof (edgex_propertyvalue *));
+  a->out.maps = calloc (nout, sizeof (devsdk_nvpairs *));
+  a->out.dfls = calloc (nout, sizeof (char *));
+  nout = 0;
+  for (unsigned i = 0; i < cmd->nreqs; i++)
+  {
+    for (unsigned agg = 0; agg < EDGEX_AGG_NTYPES; agg++)
+    {
+      if (a->state[i].aggs == 0 && agg != EDGEX_AGG_LAST)
+      {
+        continue;
+      }
+      if (a->state[i].aggs && (a->state[i].aggs & (1u << agg)) == 0)
+      {
+        continue;
+      }
+      a->slots[nout].res = i;
+      a->slots[nout].agg = agg;
+      a->out.reqs[nout].attributes = cmd->reqs[i].attributes;
+      if (a->state[i].aggs)
+      {
+        const char *rname = cmd->reqs[i].resname;
+        char *name = malloc (strlen (rname) + strlen (edgex_aggregate_names[agg]) + 2);
+        strcpy (name, rname);
+        strcat (name, "_");
+        strcat (name, edgex_aggregate_names[agg]);
+        a->out.reqs[nout].resname = name;
+      }
+      else
+      {
+        a->out.reqs[nout].resname = strdup (cmd->reqs[i].resname);
+      }
+      if (agg == EDGEX_AGG_LAST)
+      {
+        a->out.reqs[nout].type = cmd->reqs[i].type;
+        a->out.pvals[nout] = cmd->pvals[i];
+      }
+      else
+      {
+        a->pvals[nout].type = edgex_aggregate_type (agg, cmd->pvals[i]->type);
+        a->pvals[nout].readable = true;
+        a->pvals[nout].floatAsBinary = cmd->pvals[i]->floatAsBinary;
+        a->out.reqs[nout].type = a->pvals[nout].type;
+        a->out.pvals[nout] = &a->pvals[nout];
+      }
+      nout++;
+    }
+  }
+  return a;
+}
+
+void edgex_aggregator_free (edgex_aggregator *a)
+{
+  if (a)
+  {
+    for (unsigned i = 0; i < a->nreqs; i++)
+    {
+      iot_data_free (a->state[i].last.value);
+    }
+    for (unsigned i = 0; i < a->out.nreqs; i++)
+    {
+      free ((char *) a->out.reqs[i].resname);
+    }
+    free (a->out.reqs);
+    free (a->out.pvals);
+    free (a->out.maps);
+    free (a->out.dfls);
+    free (a->pvals);
+    free (a->slots);
+    free (a->state);
+    pthread_mutex_destroy (&a->lock);
+    free (a);
+  }
+}
+
+/* Produce the readings for the current window and start a new one. Numeric
+ * aggregates of a resource which returned no numeric values are zero.
+ */
+
+static devsdk_commandresult *aggregator_emit (edgex_aggregator *a, uint64_t now)
+{
+  devsdk_commandresult *result = calloc (a->out.nreqs, sizeof (devsdk_commandresult));
+
+  for (unsigned n = 0; n < a->out.nreqs; n++)
+  {
+    edgex_aggstate *s = &a->state[a->slots[n].res];
+    result[n].origin = now;
+    switch (a->slots[n].agg)
+    {
+      case EDGEX_AGG_MIN:
+        result[n].value = iot_data_alloc_f64 (s->nnum ? s->min : 0.0);
+        break;
+      case EDGEX_AGG_MAX:
+        result[n].value = iot_data_alloc_f64 (s->nnum ? s->max : 0.0);
+        break;
+      case EDGEX_AGG_MEAN:
+        result[n].value = iot_data_alloc_f64 (s->mean);
+        break;
+      case EDGEX_AGG_STDDEV:
+        result[n].value = iot_data_alloc_f64 (s->nnum ? sqrt (s->m2 / s->nnum) : 0.0);
+        break;
+      case EDGEX_AGG_COUNT:
+        result[n].value = iot_data_alloc_ui64 (s->count);
+        break;
+      default:
+        result[n].origin = s->last.origin;
+        result[n].value = iot_data_copy (s->last.value);
+        result[n].scalar = s->last.scalar;
+        break;
+    }
+  }
+  for (unsigned i = 0; i < a->nreqs; i++)
+  {
+    aggstate_reset (&a->state[i]);
+  }
+  return result;
+}
+
+devsdk_commandresult *edgex_aggregator_add
+(
+  edgex_aggregator *a,
+  devsdk_commandresult *values,
+  uint64_t now,
+  const edgex_cmdinfo **out
+)
+{
+  devsdk_commandresult *result = NULL;
+
+  /* Windows are aligned to the first reading, and a window is completed by
+   * the first reading after its end. Windows without readings are skipped.
+   */
+
+  pthread_mutex_lock (&a->lock);
+  if (!a->started)
+  {
+    a->start = now;
+    a->started = true;
+  }
+  else if (now - a->start >= a->window)
+  {
+    result = aggregator_emit (a, a->start + a->window);
+    *out = &a->out;
+    a->start += (now - a->start) / a->window * a->window;
+  }
+  for (unsigned i = 0; i < a->nreqs; i++)
+  {
+    edgex_aggstate *s = &a->state[i];
+    double d;
+
+    s->count++;
+    if (s->aggs && get_double (&values[i], &d))
+    {
+      double delta = d - s->mean;
+      s->nnum++;
+      s->mean += delta / s->nnum;
+      s->m2 += delta * (d - s->mean);
+      if (d < s->min)
+      {
+        s->min = d;
+      }
+      if (d > s->max)
+      {
+        s->max = d;
+      }
+    }
+    iot_data_free (s->last.value);
+    s->last = values[i];
+    s->last.origin = values[i].origin ? values[i].origin : now;
+    values[i].value = NULL;
+    values[i].scalar.kind = DEVSDK_SCALAR_NONE;
+  }
+  pthread_mutex_unlock (&a->lock);
+  return result;
+}
+
+devsdk_commandresult *edgex_aggregator_flush
+  (edgex_aggregator *a, uint64_t now, const edgex_cmdinfo **out)
+{
+  devsdk_commandresult *result = NULL;
+
+  pthread_mutex_lock (&a->lock);
+  if (a->nreqs && a->state[0].count)
+  {
+    result = aggregator_emit (a, now);
+    *out = &a->out;
+  }
+  pthread_mutex_unlock (&a->lock);
+  return result;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_AGGREGATE_H_
+#define _EDGEX_DEVICE_AGGREGATE_H_ 1
+
+/* Windowed aggregation for AutoEvents. A device resource with the
+ * aggregateWindow attribute (a duration, eg "10s") is not posted for each
+ * sample; instead, once per window, an event is posted containing aggregate
+ * readings named <resource>_<aggregate>. The aggregates are selected by the
+ * aggregates attribute, a comma-separated list of min, max, mean, stddev,
+ * last and count; the default is all of them. Only last and count apply to
+ * non-numeric resources.
+ *
+ * Where the resources of a command have different windows, the shortest
+ * applies. Resources of the command without the aggregateWindow attribute
+ * are posted with their last value.
+ */
+
+#include "cmdinfo.h"
+#include "iot/logger.h"
+
+typedef enum edgex_aggregate
+{
+  EDGEX_AGG_MIN,
+  EDGEX_AGG_MAX,
+  EDGEX_AGG_MEAN,
+  EDGEX_AGG_STDDEV,
+  EDGEX_AGG_LAST,
+  EDGEX_AGG_COUNT,
+  EDGEX_AGG_NTYPES
+} edgex_aggregate;
+
+extern const char *edgex_aggregate_names[];
+
+/* The set of aggregates configured for a resource, as a bitmask indexed by
+ * edgex_aggregate, or zero if the resource is not aggregated.
+ */
+
+extern unsigned edgex_aggregates_for (const devsdk_nvpairs *attrs, iot_data_type_t type);
+
+/* The type of an aggregate reading for a resource of the given type */
+
+extern iot_data_type_t edgex_aggregate_type (edgex_aggregate agg, iot_data_type_t type);
+
+struct edgex_aggregator;
+typedef struct edgex_aggregator edgex_aggregator;
+
+/* Returns NULL if no resource of the command is aggregated */
+
+extern edgex_aggregator *edgex_aggregator_alloc (const edgex_cmdinfo *cmd, iot_logger_t *lc);
+extern void edgex_aggregator_free (edgex_aggregator *a);
+
+/* Add a set of readings for the command, taken at the given time (in
+ * nanoseconds). The readings are taken over and their slots in the values
+ * array cleared, but the array itself remains the caller's. If this
+ * completes a window, the aggregate readings are returned, and *out is set
+ * to describe them; otherwise the result is NULL.
+ */
+
+extern devsdk_commandresult *edgex_aggregator_add
+(
+  edgex_aggregator *a,
+  devsdk_commandresult *values,
+  uint64_t now,
+  const edgex_cmdinfo **out
+);
+
+/* Return the aggregate readings for a partial window, or NULL if there have
+ * been no readings since the last window.
+ */
+
+extern devsdk_commandresult *edgex_aggregator_flush
+  (edgex_aggregator *a, uint64_t now, const edgex_cmdinfo **out);
+
+#endif
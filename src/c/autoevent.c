@@ -7,6 +7,7 @@
  */
 
 #include "autoevent.h"
+#include "service.h"
 #include "errorlist.h"
 #include "edgex/edgex.h"
 #include "edgex/edgex-logging.h"
@@ -16,143 +17,867 @@
 #include "devutil.h"
 #include "correlation.h"
 #include "metadata.h"
+#include "intern.h"
+#include "timerwheel.h"
+#include "histogram.h"
+#include "filter.h"
+#include "aggregate.h"
+#include "transform.h"
+#include "iot/time.h"
 
+#include <time.h>
 #include <microhttpd.h>
 
+/* Maximum number of overrunning AutoEvents listed in the metrics */
+
+#define AE_METRICS_MAX 100
+
+/* AutoEvents of a device with the same interval are run together: they
+ * share a timer, and the driver's get handler is called once with the
+ * resources of all of them.
+ *
+ * A firing which occurs while the group is still running from a previous
+ * one is an overrun, and is handled according to the AutoEventOverrun
+ * setting. With the Queue policy, at most one firing is held over until the
+ * running one completes.
+ *
+ * Intervals are held in microseconds. Where an AutoEvent's interval is
+ * shorter than the AutoEventBatch time, its readings are accumulated and
+ * posted together in one event once the batch time has elapsed. AutoEvents
+ * on aggregated resources (see aggregate.h) post aggregates instead.
+ */
+
+/* Working storage for a firing of a group: the merged request, the results
+ * returned by the driver, and their split between the members. It is kept
+ * by the group and reused, being rebuilt only when the group's membership
+ * changes, so that in the steady state a firing allocates nothing beyond
+ * the readings themselves.
+ */
+
+typedef struct edgex_aebuf
+{
+  unsigned version;
+  unsigned n;
+  unsigned nreqs;
+  struct edgex_autoimpl **members;
+  devsdk_commandrequest *reqs;
+  unsigned *where;
+  devsdk_commandresult *results;
+  devsdk_commandresult *split;
+  bool *taken;
+} edgex_aebuf;
+
+typedef struct edgex_aegroup
+{
+  devsdk_service_t *svc;
+  char *device;
+  uint64_t interval;
+  edgex_timer *timer;
+  pthread_mutex_t lock;
+  struct edgex_autoimpl *members;
+  unsigned nreqs;
+  unsigned version;
+  edgex_aebuf *buf;
+  unsigned inflight;
+  bool queued;
+  uint64_t queuedat;
+  atomic_uint_fast64_t fires;
+  atomic_uint_fast64_t overruns;
+  atomic_uint_fast64_t latesum;
+  atomic_uint_fast64_t latemax;
+  struct edgex_aegroup *next;
+  struct edgex_aegroup *prev;
+  atomic_uint_fast32_t refs;
+} edgex_aegroup;
+
+struct edgex_autoevents_t
+{
+  pthread_mutex_t lock;
+  edgex_aegroup *groups;
+  edgex_histogram_t *lateness;
+  atomic_uint_fast64_t fires;
+  atomic_uint_fast64_t overruns;
+  atomic_uint_fast64_t emitted;
+  atomic_uint_fast64_t suppressed;
+};
+
 typedef struct edgex_autoimpl
 {
   devsdk_service_t *svc;
-  devsdk_commandresult *last;
+  edgex_filter *filter;
+  edgex_aggregator *agg;
   uint64_t interval;
   const edgex_cmdinfo *resource;
   char *device;
   devsdk_protocols *protocols;
   void *handle;
+  edgex_aegroup *group;
+  struct edgex_autoimpl *gnext;
   atomic_uint_fast32_t refs;
   bool onChange;
+  pthread_mutex_t batchlock;
+  devsdk_commandresult *batch;
+  unsigned nbatch;
+  unsigned batchcap;
+  uint64_t batchstart;
 } edgex_autoimpl;
 
-struct sfxstruct
+static bool ae_post
+(
+  edgex_autoimpl *ai,
+  const edgex_cmdinfo *cmd,
+  const char *name,
+  const char *id,
+  devsdk_commandresult *values,
+  unsigned nsamples,
+  bool *sent
+);
+
+static void edgex_autoimpl_release (edgex_autoimpl *ai)
 {
-  const char *str;
-  uint64_t factor;
-};
+  if (atomic_fetch_add (&ai->refs, -1) == 1)
+  {
+    if (ai->nbatch)
+    {
+      ae_post (ai, ai->resource, ai->device, NULL, ai->batch, ai->nbatch / ai->resource->nreqs, NULL);
+    }
+    free (ai->batch);
+    if (ai->agg)
+    {
+      const edgex_cmdinfo *out;
+      devsdk_commandresult *aggs = edgex_aggregator_flush (ai->agg, iot_time_nsecs (), &out);
+      if (aggs)
+      {
+        ae_post (ai, out, ai->device, NULL, aggs, 1, NULL);
+        free (aggs);
+      }
+      edgex_aggregator_free (ai->agg);
+    }
+    pthread_mutex_destroy (&ai->batchlock);
+    edgex_intern_release (ai->device);
+    devsdk_protocols_free (ai->protocols);
+    edgex_filter_free (ai->filter);
+    free (ai);
+  }
+}
 
-static struct sfxstruct suffixes[] =
-  { { "ms", 1 }, { "s", 1000 }, { "m", 60000 }, { "h", 3600000 }, { NULL, 0 } };
+edgex_autoevents_t *edgex_autoevents_alloc ()
+{
+  edgex_autoevents_t *aes = calloc (1, sizeof (edgex_autoevents_t));
+  pthread_mutex_init (&aes->lock, NULL);
+  aes->lateness = edgex_histogram_alloc ();
+  return aes;
+}
 
-static uint64_t parseTime (const char *spec)
+void edgex_autoevents_free (edgex_autoevents_t *aes)
 {
-  char *fend;
-  uint64_t fnum = strtoul (spec, &fend, 10);
-  for (int i = 0; suffixes[i].str; i++)
+  if (aes)
   {
-    if (strcmp (fend, suffixes[i].str) == 0)
+    edgex_histogram_free (aes->lateness);
+    pthread_mutex_destroy (&aes->lock);
+    free (aes);
+  }
+}
+
+static JSON_Value *edgex_aegroup_metrics (edgex_aegroup *g)
+{
+  JSON_Value *val = json_value_init_object ();
+  JSON_Object *obj = json_value_get_object (val);
+  JSON_Value *rval = json_value_init_array ();
+  JSON_Array *rarr = json_value_get_array (rval);
+  uint64_t fires = atomic_load (&g->fires);
+
+  json_object_set_string (obj, "Device", g->device);
+  json_object_set_uint (obj, "Interval", g->interval);
+  pthread_mutex_lock (&g->lock);
+  for (edgex_autoimpl *ai = g->members; ai; ai = ai->gnext)
+  {
+    json_array_append_string (rarr, ai->resource->name);
+  }
+  pthread_mutex_unlock (&g->lock);
+  json_object_set_value (obj, "Resources", rval);
+  json_object_set_uint (obj, "Fires", fires);
+  json_object_set_uint (obj, "Overruns", atomic_load (&g->overruns));
+  json_object_set_uint (obj, "MeanLateness", fires ? atomic_load (&g->latesum) / fires : 0);
+  json_object_set_uint (obj, "MaxLateness", atomic_load (&g->latemax));
+  return val;
+}
+
+JSON_Value *edgex_autoevents_metrics (edgex_autoevents_t *aes)
+{
+  JSON_Value *val = json_value_init_object ();
+  JSON_Object *obj = json_value_get_object (val);
+  JSON_Value *oval = json_value_init_array ();
+  JSON_Array *oarr = json_value_get_array (oval);
+  unsigned noverrunning = 0;
+
+  json_object_set_uint (obj, "Fires", atomic_load (&aes->fires));
+  json_object_set_uint (obj, "Overruns", atomic_load (&aes->overruns));
+  json_object_set_value (obj, "Lateness", edgex_histogram_summary (aes->lateness));
+  json_object_set_uint (obj, "ReadingsEmitted", atomic_load (&aes->emitted));
+  json_object_set_uint (obj, "ReadingsSuppressed", atomic_load (&aes->suppressed));
+
+  pthread_mutex_lock (&aes->lock);
+  for (edgex_aegroup *g = aes->groups; g; g = g->next)
+  {
+    if (atomic_load (&g->overruns))
     {
-      return fnum * suffixes[i].factor;
+      if (noverrunning++ < AE_METRICS_MAX)
+      {
+        json_array_append_value (oarr, edgex_aegroup_metrics (g));
+      }
     }
   }
-  return 0;
+  pthread_mutex_unlock (&aes->lock);
+  json_object_set_uint (obj, "Overrunning", noverrunning);
+  json_object_set_value (obj, "OverrunDetails", oval);
+  return val;
 }
 
-static void edgex_autoimpl_release (edgex_autoimpl *ai)
+static void ae_buf_free (edgex_aebuf *buf)
 {
-  if (atomic_fetch_add (&ai->refs, -1) == 1)
+  if (buf)
   {
-    free (ai->device);
-    devsdk_protocols_free (ai->protocols);
-    devsdk_commandresult_free (ai->last, ai->resource->nreqs);
-    free (ai);
+    free (buf->members);
+    free (buf->reqs);
+    free (buf->where);
+    free (buf->results);
+    free (buf->split);
+    free (buf->taken);
+    free (buf);
   }
 }
 
-static void *ae_runner (void *p)
+static void edgex_aegroup_release (edgex_aegroup *g)
 {
-  edgex_autoimpl *ai = (edgex_autoimpl *)p;
-  atomic_fetch_add (&ai->refs, 1);
+  if (atomic_fetch_add (&g->refs, -1) == 1)
+  {
+    edgex_autoevents_t *aes = g->svc->autoevents;
+    pthread_mutex_lock (&aes->lock);
+    if (g->prev)
+    {
+      g->prev->next = g->next;
+    }
+    else
+    {
+      aes->groups = g->next;
+    }
+    if (g->next)
+    {
+      g->next->prev = g->prev;
+    }
+    pthread_mutex_unlock (&aes->lock);
+    edgex_intern_release (g->device);
+    ae_buf_free (g->buf);
+    pthread_mutex_destroy (&g->lock);
+    free (g);
+  }
+}
 
-  edgex_device *dev = edgex_devmap_device_byname (ai->svc->devices, ai->device);
-  if (dev)
+static void ae_timer_release (void *p)
+{
+  edgex_aegroup_release ((edgex_aegroup *)p);
+}
+
+/* Free a set of readings and clear their slots, leaving the array for reuse */
+
+static void ae_clear (devsdk_commandresult *values, unsigned n)
+{
+  for (unsigned i = 0; i < n; i++)
+  {
+    iot_data_free (values[i].value);
+    values[i].value = NULL;
+    values[i].scalar.kind = DEVSDK_SCALAR_NONE;
+  }
+}
+
+/* Generate and post an event containing nsamples sets of readings for an
+ * AutoEvent, and clear the values. The readings are described by cmd, which
+ * is the AutoEvent's resource unless they are aggregates. Returns false if
+ * an assertion failed, in which case the device has been disabled (if its id
+ * is given). If sent is non-NULL it is set to whether the event was accepted.
+ */
+
+static bool ae_post
+(
+  edgex_autoimpl *ai,
+  const edgex_cmdinfo *cmd,
+  const char *name,
+  const char *id,
+  devsdk_commandresult *values,
+  unsigned nsamples,
+  bool *sent
+)
+{
+  bool ok = true;
+  devsdk_error err = EDGEX_OK;
+  edgex_event_cooked *event = edgex_data_process_event_batch
+    (name, cmd, values, nsamples, false, false);
+
+  if (sent)
+  {
+    *sent = false;
+  }
+  if (event)
   {
-    if (dev->adminState == LOCKED || dev->operatingState == DISABLED)
+    edgex_data_client_add_event (ai->svc->logger, &ai->svc->config.endpoints, event, &err);
+    if (err.code == 0)
     {
-      edgex_device_release (dev);
-      edgex_autoimpl_release (ai);
-      return NULL;
+      if (sent)
+      {
+        *sent = true;
+      }
     }
-    edgex_device_alloc_crlid (NULL);
-    iot_log_info (ai->svc->logger, "AutoEvent: %s/%s", ai->device, ai->resource->name);
-    devsdk_commandresult *results = calloc (ai->resource->nreqs, sizeof (devsdk_commandresult));
-    iot_data_t *exc = NULL;
-    if
-    (
-      ai->svc->userfns.gethandler
-        (ai->svc->userdata, dev->name, (devsdk_protocols *)dev->protocols, ai->resource->nreqs, ai->resource->reqs, results, NULL, &exc)
-    )
+    else
+    {
+      edgex_log_limited (ai->svc->logger, ai->svc->ratelog, IOT_LOG_ERROR, name, "AutoEvent: unable to push new event");
+    }
+    edgex_event_cooked_free (event);
+  }
+  else
+  {
+    edgex_log_limited (ai->svc->logger, ai->svc->ratelog, IOT_LOG_ERROR, name, "Assertion failed for device %s. Disabling.", name);
+    if (id)
+    {
+      edgex_metadata_client_set_device_opstate
+        (ai->svc->logger, &ai->svc->config.endpoints, id, DISABLED, &err);
+    }
+    ok = false;
+  }
+  ae_clear (values, nsamples * cmd->nreqs);
+  return ok;
+}
+
+/* Add a set of readings to an AutoEvent's batch, and post the batch if its
+ * time has elapsed. Readings without an origin are stamped with the time they
+ * were taken, since the event is generated later. The readings are moved
+ * into the batch and their slots in the results cleared.
+ */
+
+static bool ae_batch (edgex_autoimpl *ai, const edgex_device *dev, devsdk_commandresult *results)
+{
+  unsigned nreqs = ai->resource->nreqs;
+  uint64_t now = iot_time_nsecs ();
+  devsdk_commandresult *full = NULL;
+  unsigned nfull = 0;
+
+  pthread_mutex_lock (&ai->batchlock);
+  if (ai->nbatch + nreqs > ai->batchcap)
+  {
+    unsigned nsamples = ai->svc->config.device.aebatch * 1000 / ai->interval + 1;
+    ai->batchcap = nsamples * nreqs;
+    if (ai->batchcap < ai->nbatch + nreqs)
+    {
+      ai->batchcap = ai->nbatch + nreqs;
+    }
+    ai->batch = realloc (ai->batch, ai->batchcap * sizeof (devsdk_commandresult));
+  }
+  if (ai->nbatch == 0)
+  {
+    ai->batchstart = now;
+  }
+  for (unsigned i = 0; i < nreqs; i++)
+  {
+    ai->batch[ai->nbatch] = results[i];
+    ai->batch[ai->nbatch++].origin = results[i].origin ? results[i].origin : now;
+    results[i].value = NULL;
+    results[i].scalar.kind = DEVSDK_SCALAR_NONE;
+  }
+  if (now - ai->batchstart >= (uint64_t) ai->svc->config.device.aebatch * 1000000)
+  {
+    full = ai->batch;
+    nfull = ai->nbatch;
+    ai->batch = NULL;
+    ai->nbatch = 0;
+    ai->batchcap = 0;
+  }
+  pthread_mutex_unlock (&ai->batchlock);
+
+  if (full)
+  {
+    bool ok = ae_post (ai, ai->resource, dev->name, dev->id, full, nfull / nreqs, NULL);
+    free (full);
+    return ok;
+  }
+  return true;
+}
+
+/* Process a set of readings for one AutoEvent. The readings are consumed
+ * and their slots cleared; the results array itself belongs to the caller.
+ * Returns false if an assertion failed, in which case the device has been
+ * disabled.
+ */
+
+static bool ae_process (edgex_autoimpl *ai, const edgex_device *dev, devsdk_commandresult *results)
+{
+  bool ok = true;
+  bool sent;
+  unsigned nreqs = ai->resource->nreqs;
+  edgex_autoevents_t *aes = ai->svc->autoevents;
+
+  /* Transforms are applied before change detection, so that deadbands are
+   * in the units of the posted readings.
+   */
+
+  if (ai->svc->config.device.datatransform)
+  {
+    for (unsigned i = 0; i < nreqs; i++)
+    {
+      edgex_transform_outgoing (&results[i], ai->resource->pvals[i], ai->resource->maps[i]);
+    }
+  }
+  if (ai->agg)
+  {
+    /* Aggregation replaces change detection and batching */
+
+    const edgex_cmdinfo *out;
+    devsdk_commandresult *aggs = edgex_aggregator_add (ai->agg, results, iot_time_nsecs (), &out);
+    if (aggs)
+    {
+      ok = ae_post (ai, out, dev->name, dev->id, aggs, 1, NULL);
+      free (aggs);
+    }
+    return ok;
+  }
+  if (ai->filter)
+  {
+    if (!edgex_filter_check (ai->filter, results, iot_time_nsecs ()))
+    {
+      atomic_fetch_add (&aes->suppressed, nreqs);
+      ae_clear (results, nreqs);
+      return true;
+    }
+    atomic_fetch_add (&aes->emitted, nreqs);
+  }
+  if ((uint64_t) ai->svc->config.device.aebatch * 1000 > ai->interval)
+  {
+    /* Batched readings are compared with the previous set taken, whether or
+     * not it has been posted yet.
+     */
+
+    ok = ae_batch (ai, dev, results);
+  }
+  else
+  {
+    ok = ae_post (ai, ai->resource, dev->name, dev->id, results, 1, &sent);
+    if (ai->filter && !sent)
+    {
+      edgex_filter_reset (ai->filter);
+    }
+  }
+  return ok;
+}
+
+/* Build the request for a group: the resources of all its members, without
+ * duplicates. For each member's requests in turn, where[] receives the index
+ * of the request in the merged list.
+ */
+
+static unsigned ae_merge
+  (edgex_autoimpl **members, unsigned n, devsdk_commandrequest *reqs, unsigned *where)
+{
+  unsigned nreqs = 0;
+  unsigned w = 0;
+
+  for (unsigned m = 0; m < n; m++)
+  {
+    const edgex_cmdinfo *cmd = members[m]->resource;
+    for (unsigned j = 0; j < cmd->nreqs; j++)
     {
-      devsdk_commandresult *resdup = NULL;
-      if (!(ai->onChange && ai->last && devsdk_commandresult_equal (results, ai->last, ai->resource->nreqs)))
+      unsigned k;
+      for (k = 0; k < nreqs; k++)
       {
-        devsdk_error err = EDGEX_OK;
-        if (ai->onChange)
+        if (strcmp (reqs[k].resname, cmd->reqs[j].resname) == 0)
         {
-          resdup = devsdk_commandresult_dup (results, ai->resource->nreqs);
+          break;
         }
-        edgex_event_cooked *event =
-          edgex_data_process_event (dev->name, ai->resource, results, ai->svc->config.device.datatransform);
-        if (event)
-        {
-          edgex_data_client_add_event (ai->svc->logger, &ai->svc->config.endpoints, event, &err);
-          if (err.code == 0)
-          {
-            if (ai->onChange)
-            {
-              devsdk_commandresult_free (ai->last, ai->resource->nreqs);
-              ai->last = resdup;
-              resdup = NULL;
-            }
-          }
-          else
-          {
-            iot_log_error (ai->svc->logger, "AutoEvent: unable to push new event");
-          }
-          edgex_event_cooked_free (event);
-        }
-        else
+      }
+      if (k == nreqs)
+      {
+        reqs[nreqs++] = cmd->reqs[j];
+      }
+      where[w++] = k;
+    }
+  }
+  return nreqs;
+}
+
+/* Size a buffer for the group's current members. Called with the group
+ * locked.
+ */
+
+static void ae_buf_build (edgex_aegroup *g, edgex_aebuf *buf)
+{
+  unsigned n = 0;
+
+  for (edgex_autoimpl *ai = g->members; ai; ai = ai->gnext)
+  {
+    n++;
+  }
+  buf->members = realloc (buf->members, (n ? n : 1) * sizeof (edgex_autoimpl *));
+  buf->reqs = realloc (buf->reqs, (g->nreqs ? g->nreqs : 1) * sizeof (devsdk_commandrequest));
+  buf->where = realloc (buf->where, (g->nreqs ? g->nreqs : 1) * sizeof (unsigned));
+  buf->split = realloc (buf->split, (g->nreqs ? g->nreqs : 1) * sizeof (devsdk_commandresult));
+  n = 0;
+  for (edgex_autoimpl *ai = g->members; ai; ai = ai->gnext)
+  {
+    buf->members[n++] = ai;
+  }
+  buf->n = n;
+  buf->nreqs = ae_merge (buf->members, n, buf->reqs, buf->where);
+  buf->results = realloc (buf->results, (buf->nreqs ? buf->nreqs : 1) * sizeof (devsdk_commandresult));
+  buf->taken = realloc (buf->taken, (buf->nreqs ? buf->nreqs : 1) * sizeof (bool));
+  buf->version = g->version;
+}
+
+static void ae_read (devsdk_service_t *svc, const edgex_device *dev, edgex_aebuf *buf)
+{
+  edgex_autoimpl **members = buf->members;
+  unsigned n = buf->n;
+  unsigned nreqs = buf->nreqs;
+  devsdk_commandresult *results = buf->results;
+  iot_data_t *exc = NULL;
+
+  memset (results, 0, nreqs * sizeof (devsdk_commandresult));
+  if (svc->config.logging.tracing)
+  {
+    edgex_device_alloc_crlid (NULL);
+  }
+  for (unsigned m = 0; m < n; m++)
+  {
+    edgex_log_limited
+      (svc->logger, svc->ratelog, IOT_LOG_INFO, dev->name, "AutoEvent: %s/%s", dev->name, members[m]->resource->name);
+  }
+  if
+  (
+    svc->userfns.gethandler
+      (svc->userdata, dev->name, (devsdk_protocols *)dev->protocols, nreqs, buf->reqs, results, NULL, &exc)
+  )
+  {
+    /* Split the results between the members. The first member to use a
+     * resource takes its value, and any others receive copies. This is done
+     * before any processing, as transforms modify the values in place.
+     */
+
+    devsdk_commandresult *split = buf->split;
+    bool ok = true;
+    unsigned w = 0;
+
+    memset (buf->taken, 0, nreqs * sizeof (bool));
+    for (unsigned m = 0; m < n; m++)
+    {
+      for (unsigned j = 0; j < members[m]->resource->nreqs; j++, w++)
+      {
+        unsigned k = buf->where[w];
+        split[w] = results[k];
+        if (buf->taken[k] && results[k].value)
         {
-          iot_log_error (ai->svc->logger, "Assertion failed for device %s. Disabling.", dev->name);
-          edgex_metadata_client_set_device_opstate
-            (ai->svc->logger, &ai->svc->config.endpoints, dev->id, DISABLED, &err);
+          split[w].value = iot_data_copy (results[k].value);
         }
+        buf->taken[k] = true;
       }
-      devsdk_commandresult_free (resdup, ai->resource->nreqs);
     }
-    else
+    w = 0;
+    for (unsigned m = 0; m < n; m++)
     {
-      iot_log_error (ai->svc->logger, "AutoEvent: Driver for %s failed on GET", dev->name);
+      unsigned mreqs = members[m]->resource->nreqs;
+      if (ok)
+      {
+        ok = ae_process (members[m], dev, split + w);
+      }
+      else
+      {
+        ae_clear (split + w, mreqs);
+      }
+      w += mreqs;
+    }
+  }
+  else
+  {
+    edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "AutoEvent: Driver for %s failed on GET", dev->name);
+    ae_clear (results, nreqs);
+  }
+  iot_data_free (exc);
+  edgex_device_free_crlid ();
+}
+
+/* Run a firing using the group's buffer. If that is in use, as it may be
+ * under the Concurrent overrun policy, a temporary one is used instead.
+ */
+
+static void ae_run (edgex_aegroup *g)
+{
+  edgex_aebuf *buf;
+
+  pthread_mutex_lock (&g->lock);
+  buf = g->buf;
+  g->buf = NULL;
+  if (buf == NULL)
+  {
+    buf = calloc (1, sizeof (edgex_aebuf));
+    ae_buf_build (g, buf);
+  }
+  else if (buf->version != g->version)
+  {
+    ae_buf_build (g, buf);
+  }
+  for (unsigned m = 0; m < buf->n; m++)
+  {
+    atomic_fetch_add (&buf->members[m]->refs, 1);
+  }
+  pthread_mutex_unlock (&g->lock);
+
+  edgex_device *dev = edgex_devmap_device_byname (g->svc->devices, g->device);
+  if (dev)
+  {
+    if (buf->n && dev->adminState != LOCKED && dev->operatingState != DISABLED)
+    {
+      ae_read (g->svc, dev, buf);
     }
-    iot_data_free (exc);
-    devsdk_commandresult_free (results, ai->resource->nreqs);
-    edgex_device_free_crlid ();
     edgex_device_release (dev);
   }
   else
   {
-    iot_log_error
-      (ai->svc->logger, "Autoevent fired for unknown device %s", ai->device);
-    iot_schedule_remove (ai->svc->scheduler, ai->handle);
+    edgex_log_limited
+      (g->svc->logger, g->svc->ratelog, IOT_LOG_ERROR, g->device, "Autoevent fired for unknown device %s", g->device);
   }
+
+  for (unsigned m = 0; m < buf->n; m++)
+  {
+    edgex_autoimpl_release (buf->members[m]);
+  }
+
+  pthread_mutex_lock (&g->lock);
+  if (g->buf == NULL)
+  {
+    g->buf = buf;
+    buf = NULL;
+  }
+  pthread_mutex_unlock (&g->lock);
+  ae_buf_free (buf);
+}
+
+static uint64_t mono_nsecs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Record the lateness of a firing, in microseconds */
+
+static void ae_record (edgex_aegroup *g, uint64_t scheduled)
+{
+  edgex_autoevents_t *aes = g->svc->autoevents;
+  uint64_t now = mono_nsecs ();
+  uint64_t late = now > scheduled ? (now - scheduled) / 1000 : 0;
+  uint64_t max = atomic_load (&g->latemax);
+
+  atomic_fetch_add (&g->fires, 1);
+  atomic_fetch_add (&g->latesum, late);
+  while (late > max && !atomic_compare_exchange_weak (&g->latemax, &max, late));
+  atomic_fetch_add (&aes->fires, 1);
+  edgex_histogram_record (aes->lateness, late);
+}
+
+static void ae_runner (void *p, uint64_t scheduled)
+{
+  edgex_aegroup *g = (edgex_aegroup *)p;
+  edgex_autoevents_t *aes = g->svc->autoevents;
+  edgex_device_aeoverrun policy = g->svc->config.device.aeoverrun;
+  bool again;
+
+  pthread_mutex_lock (&g->lock);
+  if (g->inflight)
+  {
+    atomic_fetch_add (&g->overruns, 1);
+    atomic_fetch_add (&aes->overruns, 1);
+    if (policy != EDGEX_AEOVERRUN_CONCURRENT)
+    {
+      if (policy == EDGEX_AEOVERRUN_QUEUE && !g->queued)
+      {
+        g->queued = true;
+        g->queuedat = scheduled;
+      }
+      pthread_mutex_unlock (&g->lock);
+      return;
+    }
+  }
+  g->inflight++;
+  pthread_mutex_unlock (&g->lock);
+
+  do
+  {
+    ae_record (g, scheduled);
+    ae_run (g);
+    pthread_mutex_lock (&g->lock);
+    again = g->queued;
+    g->queued = false;
+    scheduled = g->queuedat;
+    if (!again)
+    {
+      g->inflight--;
+    }
+    pthread_mutex_unlock (&g->lock);
+  } while (again);
+}
+
+/* Add an AutoEvent to the group of another AutoEvent of the device with the
+ * same interval, provided that the combined request is within MaxCmdOps.
+ * Otherwise start a new group, whose first firing is offset within the
+ * interval according to the AutoEventPhase setting.
+ *
+ * An AutoEvent's group pointer is only set or cleared with the autoevents
+ * lock held, so a reference to another AutoEvent's group is taken under that
+ * lock; while the pointer is set, the member's own reference keeps the group
+ * alive.
+ */
+
+static void ae_schedule (devsdk_service_t *svc, edgex_device *dev, edgex_autoimpl *ai)
+{
+  edgex_aegroup *g = NULL;
+
+  atomic_fetch_add (&ai->refs, 1);
+  for (edgex_device_autoevents *ae = dev->autos; ae && g == NULL; ae = ae->next)
+  {
+    edgex_autoimpl *other = ae->impl;
+    edgex_aegroup *og = NULL;
+    if (other && other != ai && other->interval == ai->interval)
+    {
+      pthread_mutex_lock (&svc->autoevents->lock);
+      og = other->group;
+      if (og)
+      {
+        atomic_fetch_add (&og->refs, 1);
+      }
+      pthread_mutex_unlock (&svc->autoevents->lock);
+    }
+    if (og)
+    {
+      pthread_mutex_lock (&og->lock);
+      if (og->members && og->nreqs + ai->resource->nreqs <= svc->config.device.maxcmdops)
+      {
+        g = og;
+        ai->gnext = g->members;
+        g->members = ai;
+        g->nreqs += ai->resource->nreqs;
+        g->version++;
+      }
+      pthread_mutex_unlock (&og->lock);
+      if (g)
+      {
+        pthread_mutex_lock (&svc->autoevents->lock);
+        ai->group = g;
+        pthread_mutex_unlock (&svc->autoevents->lock);
+      }
+      else
+      {
+        edgex_aegroup_release (og);
+      }
+    }
+  }
+
+  if (g == NULL)
+  {
+    uint64_t interval = ai->interval * 1000;
+    uint64_t offset = 0;
+
+    switch (svc->config.device.aephase)
+    {
+      case EDGEX_AEPHASE_HASH:
+        offset = edgex_map_hash (dev->name) % interval;
+        break;
+      case EDGEX_AEPHASE_RANDOM:
+        offset = (edgex_map_hash (dev->name) ^ iot_time_nsecs ()) % interval;
+        break;
+      default:
+        break;
+    }
+
+    g = malloc (sizeof (edgex_aegroup));
+    g->svc = svc;
+    g->device = edgex_intern_dup (dev->name);
+    g->interval = ai->interval;
+    pthread_mutex_init (&g->lock, NULL);
+    g->members = ai;
+    g->nreqs = ai->resource->nreqs;
+    g->version = 0;
+    g->buf = NULL;
+    g->inflight = 0;
+    g->queued = false;
+    g->queuedat = 0;
+    atomic_init (&g->fires, 0);
+    atomic_init (&g->overruns, 0);
+    atomic_init (&g->latesum, 0);
+    atomic_init (&g->latemax, 0);
+    atomic_store (&g->refs, 2);
+    pthread_mutex_lock (&svc->autoevents->lock);
+    g->prev = NULL;
+    g->next = svc->autoevents->groups;
+    if (g->next)
+    {
+      g->next->prev = g;
+    }
+    svc->autoevents->groups = g;
+    ai->group = g;
+    pthread_mutex_unlock (&svc->autoevents->lock);
+    ai->gnext = NULL;
+    g->timer = edgex_timerwheel_add
+    (
+      svc->wheel, interval, offset, (uint64_t) svc->config.device.aejitter * 1000000,
+      ae_runner, g, ae_timer_release
+    );
+  }
+}
+
+/* Remove an AutoEvent from its group, stopping the group's timer if it was
+ * the last member. Any readings batched for it are posted when the last
+ * reference to it is released.
+ */
+
+static void ae_unschedule (edgex_autoimpl *ai)
+{
+  edgex_aegroup *g;
+  bool empty;
+
+  pthread_mutex_lock (&ai->svc->autoevents->lock);
+  g = ai->group;
+  ai->group = NULL;
+  pthread_mutex_unlock (&ai->svc->autoevents->lock);
+
+  pthread_mutex_lock (&g->lock);
+  for (edgex_autoimpl **pp = &g->members; *pp; pp = &(*pp)->gnext)
+  {
+    if (*pp == ai)
+    {
+      *pp = ai->gnext;
+      break;
+    }
+  }
+  g->nreqs -= ai->resource->nreqs;
+  g->version++;
+  empty = (g->members == NULL);
+  pthread_mutex_unlock (&g->lock);
+
+  if (empty)
+  {
+    edgex_timerwheel_cancel (ai->svc->wheel, g->timer);
+  }
+  edgex_aegroup_release (g);
   edgex_autoimpl_release (ai);
-  return NULL;
 }
 
+/* Driver-managed AutoEvents are given the interval in milliseconds, rounded
+ * up.
+ */
+
 static void *starter (void *p)
 {
   edgex_autoimpl *ai = (edgex_autoimpl *)p;
   ai->handle = ai->svc->userfns.ae_starter
   (
     ai->svc->userdata, ai->device, ai->protocols, ai->resource->name,
-    ai->resource->nreqs, ai->resource->reqs, ai->interval, ai->onChange
+    ai->resource->nreqs, ai->resource->reqs, (ai->interval + 999) / 1000, ai->onChange
   );
   return NULL;
 }
@@ -175,7 +900,7 @@ void edgex_device_autoevent_start (devsdk_service_t *svc, edgex_device *dev)
         );
         continue;
       }
-      uint64_t interval = parseTime (ae->frequency);
+      uint64_t interval = edgex_parse_duration (ae->frequency);
       if (interval == 0)
       {
         iot_log_error
@@ -186,26 +911,41 @@ void edgex_device_autoevent_start (devsdk_service_t *svc, edgex_device *dev)
         );
         continue;
       }
+      if (interval < svc->config.device.aetick)
+      {
+        iot_log_warn
+        (
+          svc->logger,
+          "AutoEvents: device %s: frequency %s is shorter than AutoEventTick (%" PRIu32 "us)",
+          dev->name, ae->frequency, svc->config.device.aetick
+        );
+      }
       ae->impl = malloc (sizeof (edgex_autoimpl));
       ae->impl->svc = svc;
-      ae->impl->last = NULL;
+      ae->impl->filter = ae->onChange ? edgex_filter_alloc (cmd, svc->logger) : NULL;
+      ae->impl->agg = edgex_aggregator_alloc (cmd, svc->logger);
       ae->impl->interval = interval;
       ae->impl->resource = cmd;
-      ae->impl->device = strdup (dev->name);
+      ae->impl->device = edgex_intern_dup (dev->name);
       ae->impl->protocols = devsdk_protocols_dup ((const devsdk_protocols *)dev->protocols);
       ae->impl->handle = NULL;
+      ae->impl->group = NULL;
+      ae->impl->gnext = NULL;
       atomic_store (&ae->impl->refs, 1);
       ae->impl->onChange = ae->onChange;
-    }
-    if (ae->impl->svc->userfns.ae_starter)
-    {
-      iot_threadpool_add_work (svc->thpool, starter, ae->impl, -1);
-    }
-    else
-    {
-      ae->impl->handle = iot_schedule_create
-        (svc->scheduler, ae_runner, NULL, ae->impl, IOT_MS_TO_NS(ae->impl->interval), 0, 0, svc->thpool, -1);
-      iot_schedule_add (ae->impl->svc->scheduler, ae->impl->handle);
+      pthread_mutex_init (&ae->impl->batchlock, NULL);
+      ae->impl->batch = NULL;
+      ae->impl->nbatch = 0;
+      ae->impl->batchcap = 0;
+      ae->impl->batchstart = 0;
+      if (ae->impl->svc->userfns.ae_starter)
+      {
+        iot_threadpool_add_work (svc->thpool, starter, ae->impl, -1);
+      }
+      else
+      {
+        ae_schedule (svc, dev, ae->impl);
+      }
     }
   }
 }
@@ -219,7 +959,7 @@ static void *stopper (void *p)
   }
   else
   {
-    iot_schedule_delete (ai->svc->scheduler, ai->handle);
+    ae_unschedule (ai);
   }
   edgex_autoimpl_release (ai);
   return NULL;
@@ -232,6 +972,7 @@ void edgex_device_autoevent_stop (edgex_device *dev)
     if (ae->impl)
     {
       edgex_autoimpl *ai = ae->impl;
+      ae->impl = NULL;
       iot_threadpool_add_work (ai->svc->thpool, stopper, ai, -1);
     }
   }
@@ -9,10 +9,31 @@
 #ifndef _EDGEX_DEVICE_AUTOEVENT_H
 #define _EDGEX_DEVICE_AUTOEVENT_H 1
 
-#include "service.h"
+#include "devsdk/devsdk.h"
+#include "edgex/edgex.h"
+#include "parson.h"
+
+/* Per-service AutoEvent state: the running AutoEvents and their statistics */
+
+struct edgex_autoevents_t;
+typedef struct edgex_autoevents_t edgex_autoevents_t;
+
+extern edgex_autoevents_t *edgex_autoevents_alloc (void);
+extern void edgex_autoevents_free (edgex_autoevents_t *aes);
+
+/* Returns a JSON object containing counts of AutoEvent firings and overruns,
+ * a summary of the lateness of firings in microseconds, and details of any
+ * AutoEvents which have overrun.
+ */
+
+extern JSON_Value *edgex_autoevents_metrics (edgex_autoevents_t *aes);
+
+/* Start those autoevents of a device which are not already running */
 
 void edgex_device_autoevent_start (devsdk_service_t *svc, edgex_device *dev);
 
+/* Stop any running autoevents of a device */
+
 void edgex_device_autoevent_stop (edgex_device *dev);
 
 #endif
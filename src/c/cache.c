@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/* The cache file holds the service's devices as a JSON array, in the form in
+ * which core-metadata supplies them, so that it is read by the same code.
+ * Each profile is written in full only for the first device which uses it;
+ * the reader takes subsequent references from the profiles it has seen. The
+ * file is written under a temporary name and renamed into place, so that a
+ * partly-written file is never read.
+ */
+
+#include "cache.h"
+#include "callback.h"
+#include "metadata.h"
+#include "edgex-rest.h"
+#include "errorlist.h"
+#include "map.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define CACHE_READ_SIZE 65536
+#define CACHE_BATCH 256
+
+static void populate_devices (void *ctx, const edgex_device *devs)
+{
+  edgex_devmap_populate_devices ((edgex_devmap_t *) ctx, devs);
+}
+
+/* A cache file which does not parse is treated as absent: any devices read
+ * from it are discarded, so that they are loaded from metadata instead.
+ */
+
+unsigned edgex_cache_load (devsdk_service_t *svc)
+{
+  unsigned result = 0;
+  const char *fname = svc->config.device.cachefile;
+  FILE *f = fopen (fname, "r");
+
+  if (f)
+  {
+    size_t n;
+    devsdk_error err = EDGEX_OK;
+    char *buf = malloc (CACHE_READ_SIZE);
+    edgex_devices_parser *p = edgex_devices_parser_alloc
+      (svc->logger, CACHE_BATCH, populate_devices, svc->devices);
+
+    while ((n = fread (buf, 1, CACHE_READ_SIZE, f)) > 0)
+    {
+      edgex_devices_parser_feed (p, buf, n);
+    }
+    result = edgex_devices_parser_finish (p, &err);
+    if (ferror (f) || err.code)
+    {
+      iot_log_error (svc->logger, "Ignoring unreadable cache file %s", fname);
+      edgex_devmap_clear (svc->devices);
+      result = 0;
+    }
+    free (buf);
+    fclose (f);
+  }
+  else if (errno != ENOENT)
+  {
+    iot_log_error (svc->logger, "Unable to read cache file %s: %s", fname, strerror (errno));
+  }
+  return result;
+}
+
+void edgex_cache_save (devsdk_service_t *svc)
+{
+  FILE *f;
+  bool ok;
+  unsigned count = 0;
+  const char *sep = "";
+  const edgex_device *dev;
+  edgex_map_int profiles;
+  edgex_snapshot *snap;
+  edgex_snapshot_iter iter = EDGEX_SNAPSHOT_ITER_INIT;
+  const char *fname = svc->config.device.cachefile;
+  char *tmpname = malloc (strlen (fname) + sizeof (".tmp"));
+
+  strcpy (tmpname, fname);
+  strcat (tmpname, ".tmp");
+  f = fopen (tmpname, "w");
+  if (f == NULL)
+  {
+    iot_log_error (svc->logger, "Unable to write cache file %s: %s", tmpname, strerror (errno));
+    free (tmpname);
+    return;
+  }
+
+  edgex_map_init (&profiles);
+  snap = edgex_devmap_snapshot_acquire (svc->devices);
+  ok = fputs ("[\n", f) >= 0;
+  while (ok && (dev = edgex_devmap_snapshot_next_device (snap, &iter)))
+  {
+    bool withprofile = (edgex_map_get (&profiles, dev->profile->name) == NULL);
+    char *json = edgex_device_write_cache (dev, withprofile);
+    if (withprofile)
+    {
+      edgex_map_set (&profiles, dev->profile->name, 1);
+    }
+    ok = fprintf (f, "%s%s", sep, json) >= 0;
+    free (json);
+    sep = ",\n";
+    count++;
+  }
+  edgex_devmap_snapshot_release (snap);
+  edgex_map_deinit (&profiles);
+
+  ok = ok && fputs ("\n]\n", f) >= 0 && fflush (f) == 0 && fsync (fileno (f)) == 0;
+  ok = (fclose (f) == 0) && ok;
+  if (ok && rename (tmpname, fname) == 0)
+  {
+    iot_log_info (svc->logger, "Saved %u devices to cache file %s", count, fname);
+  }
+  else
+  {
+    iot_log_error (svc->logger, "Unable to write cache file %s: %s", fname, strerror (errno));
+    remove (tmpname);
+  }
+  free (tmpname);
+}
+
+typedef struct reconcile_ctx
+{
+  devsdk_service_t *svc;
+  edgex_map_int seen;
+} reconcile_ctx;
+
+static void reconcile_devices (void *p, const edgex_device *devs)
+{
+  reconcile_ctx *ctx = (reconcile_ctx *) p;
+  devsdk_service_t *svc = ctx->svc;
+
+  for (const edgex_device *d = devs; d; d = d->next)
+  {
+    bool current = false;
+    edgex_map_set (&ctx->seen, d->id, 1);
+    edgex_devmap_read_begin (svc->devices);
+    const edgex_device *existing = edgex_devmap_lookup_byid (svc->devices, d->id);
+    if (existing)
+    {
+      current =
+      (
+        existing->modified == d->modified && strcmp (existing->name, d->name) == 0 &&
+        existing->profile->modified == d->profile->modified
+      );
+    }
+    edgex_devmap_read_end (svc->devices);
+    if (!current)
+    {
+      iot_log_info (svc->logger, "Cache: New or updated device %s", d->name);
+      edgex_device_apply_update (svc, d);
+    }
+  }
+}
+
+unsigned edgex_cache_reconcile (devsdk_service_t *svc, devsdk_error *err)
+{
+  unsigned result;
+  reconcile_ctx ctx;
+  const edgex_device *dev;
+  edgex_snapshot *snap;
+  edgex_snapshot_iter iter = EDGEX_SNAPSHOT_ITER_INIT;
+
+  /* Devices held before the request are removed if metadata does not list
+   * them. Those added while it is in progress are left alone.
+   */
+
+  snap = edgex_devmap_snapshot_acquire (svc->devices);
+  ctx.svc = svc;
+  edgex_map_init (&ctx.seen);
+
+  result = edgex_metadata_client_get_devices
+    (svc->logger, &svc->config.endpoints, svc->name, CACHE_BATCH, reconcile_devices, &ctx, err);
+
+  if (err->code == 0)
+  {
+    while ((dev = edgex_devmap_snapshot_next_device (snap, &iter)))
+    {
+      if (edgex_map_get (&ctx.seen, dev->id) == NULL)
+      {
+        iot_log_info (svc->logger, "Cache: Device %s no longer present", dev->name);
+        edgex_device_apply_removal (svc, dev->id);
+      }
+    }
+  }
+  edgex_devmap_snapshot_release (snap);
+  edgex_map_deinit (&ctx.seen);
+  return result;
+}
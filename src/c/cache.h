@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_CACHE_H_
+#define _EDGEX_DEVICE_CACHE_H_ 1
+
+/* Warm-start cache of the device list (see Device/CacheFile). */
+
+#include "service.h"
+
+/* Load devices from the cache file, if present. Returns the number loaded,
+ * which is zero if the file could not be read or parsed.
+ */
+
+extern unsigned edgex_cache_load (devsdk_service_t *svc);
+
+/* Write the current device list to the cache file. */
+
+extern void edgex_cache_save (devsdk_service_t *svc);
+
+/* Bring the device map up to date with core-metadata. Devices whose
+ * modification time, or whose profile's modification time, differs from that
+ * held are replaced, and devices no longer present are removed. Returns the
+ * number of devices in metadata.
+ */
+
+extern unsigned edgex_cache_reconcile (devsdk_service_t *svc, devsdk_error *err);
+
+#endif
@@ -67,6 +67,49 @@ static int updateWatcher
   return status;
 }
 
+void edgex_device_apply_removal (devsdk_service_t *svc, const char *id)
+{
+  if (svc->userfns.device_removed)
+  {
+    edgex_device *dev = edgex_devmap_device_byid (svc->devices, id);
+    if (dev)
+    {
+      edgex_devmap_removedevice_byid (svc->devices, id);
+      svc->userfns.device_removed (svc->userdata, dev->name, (const devsdk_protocols *)dev->protocols);
+      edgex_device_release (dev);
+    }
+    else
+    {
+      iot_log_error (svc->logger, "callback: Device %s (for deletion) not found", id);
+    }
+  }
+  else
+  {
+    edgex_devmap_removedevice_byid (svc->devices, id);
+  }
+}
+
+void edgex_device_apply_update (devsdk_service_t *svc, const edgex_device *newdev)
+{
+  switch (edgex_devmap_replace_device (svc->devices, newdev))
+  {
+    case CREATED:
+      if (svc->userfns.device_added)
+      {
+        svc->userfns.device_added (svc->userdata, newdev->name, (const devsdk_protocols *)newdev->protocols, newdev->adminState);
+      }
+      break;
+    case UPDATED_DRIVER:
+      if (svc->userfns.device_updated)
+      {
+        svc->userfns.device_updated (svc->userdata, newdev->name, (const devsdk_protocols *)newdev->protocols, newdev->adminState);
+      }
+      break;
+    case UPDATED_SDK:
+      break;
+  }
+}
+
 static int updateDevice
 (
   devsdk_service_t *svc,
@@ -82,24 +125,7 @@ static int updateDevice
   {
     case DELETE:
       iot_log_info (svc->logger, "callback: Delete device %s", id);
-      if (svc->userfns.device_removed)
-      {
-        edgex_device *dev = edgex_devmap_device_byid (svc->devices, id);
-        if (dev)
-        {
-          edgex_devmap_removedevice_byid (svc->devices, id);
-          svc->userfns.device_removed (svc->userdata, dev->name, (const devsdk_protocols *)dev->protocols);
-          edgex_device_release (dev);
-        }
-        else
-        {
-          iot_log_error (svc->logger, "callback: Device %s (for deletion) not found", id);
-        }
-      }
-      else
-      {
-        edgex_devmap_removedevice_byid (svc->devices, id);
-      }
+      edgex_device_apply_removal (svc, id);
       break;
     case POST:
     case PUT:
@@ -119,23 +145,7 @@ static int updateDevice
         else
         {
           iot_log_info (svc->logger, "callback: New or updated device %s", id);
-          switch (edgex_devmap_replace_device (svc->devices, newdev))
-          {
-            case CREATED:
-              if (svc->userfns.device_added)
-              {
-                svc->userfns.device_added (svc->userdata, newdev->name, (const devsdk_protocols *)newdev->protocols, newdev->adminState);
-              }
-              break;
-            case UPDATED_DRIVER:
-              if (svc->userfns.device_updated)
-              {
-                svc->userfns.device_updated (svc->userdata, newdev->name, (const devsdk_protocols *)newdev->protocols, newdev->adminState);
-              }
-              break;
-            case UPDATED_SDK:
-              break;
-          }
+          edgex_device_apply_update (svc, newdev);
         }
         edgex_device_free (newdev);
       }
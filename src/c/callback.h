@@ -10,6 +10,8 @@
 #define _EDGEX_DEVICE_CALLBACK_H_ 1
 
 #include "rest-server.h"
+#include "devsdk/devsdk.h"
+#include "edgex/edgex.h"
 
 extern int edgex_device_handler_callback
 (
@@ -24,4 +26,13 @@ extern int edgex_device_handler_callback
   const char **reply_type
 );
 
+/* Apply a device addition, update or removal to the device map, and inform
+ * the driver.
+ */
+
+extern void edgex_device_apply_update
+  (devsdk_service_t *svc, const edgex_device *newdev);
+
+extern void edgex_device_apply_removal (devsdk_service_t *svc, const char *id);
+
 #endif
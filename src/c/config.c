@@ -488,6 +488,45 @@ static bool get_nv_config_bool
   return dfl;
 }
 
+static const char *aephase_names[] = { "None", "Hash", "Random", NULL };
+static const char *aeoverrun_names[] = { "Concurrent", "Skip", "Queue", NULL };
+
+/* Default thread counts for the work pools, indexed by edgex_workclass */
+
+static const uint32_t workpool_threads[] = { 8, 2, 1 };
+
+/* Returns the index of the setting in the list of names, or zero (the
+ * default) if it is not present or not recognized.
+ */
+
+static unsigned get_nv_config_choice
+(
+  iot_logger_t *lc,
+  const devsdk_nvpairs *config,
+  const char *key,
+  const char **names,
+  devsdk_error *err
+)
+{
+  unsigned result = 0;
+  char *str = get_nv_config_string (config, key);
+  if (str)
+  {
+    while (names[result] && strcasecmp (str, names[result]))
+    {
+      result++;
+    }
+    if (names[result] == NULL)
+    {
+      *err = EDGEX_BAD_CONFIG;
+      iot_log_error (lc, "Invalid value %s for %s", str, key);
+      result = 0;
+    }
+    free (str);
+  }
+  return result;
+}
+
 void edgex_device_populateConfig
   (devsdk_service_t *svc, const devsdk_nvpairs *config, devsdk_error *err)
 {
@@ -504,6 +543,26 @@ void edgex_device_populateConfig
     get_nv_config_string (config, "Service/StartupMsg");
   svc->config.service.checkinterval =
     get_nv_config_string (config, "Service/CheckInterval");
+  svc->config.service.compressminsize = get_nv_config_uint32
+    (svc->logger, config, "Service/CompressionThreshold", err);
+  svc->config.service.maxrequestsize = get_nv_config_uint32
+    (svc->logger, config, "Service/MaxRequestSize", err);
+  if (svc->config.service.maxrequestsize == 0)
+  {
+    svc->config.service.maxrequestsize = 16777216;
+  }
+  for (unsigned c = 0; c < EDGEX_WORK_NCLASSES; c++)
+  {
+    char key[32];
+    sprintf (key, "Service/%sThreads", edgex_workclass_names[c]);
+    svc->config.service.threads[c] = get_nv_config_uint32 (svc->logger, config, key, err);
+    if (svc->config.service.threads[c] == 0)
+    {
+      svc->config.service.threads[c] = workpool_threads[c];
+    }
+    sprintf (key, "Service/%sPriority", edgex_workclass_names[c]);
+    svc->config.service.priority[c] = get_nv_config_uint32 (svc->logger, config, key, err);
+  }
 
   char *lstr = get_nv_config_string (config, "Service/Labels");
   if (lstr)
@@ -551,8 +610,32 @@ void edgex_device_populateConfig
     get_nv_config_string (config, "Device/RemoveCmdArgs");
   svc->config.device.profilesdir =
     get_nv_config_string (config, "Device/ProfilesDir");
+  svc->config.device.cachefile =
+    get_nv_config_string (config, "Device/CacheFile");
+  svc->config.device.aetick =
+    get_nv_config_uint32 (svc->logger, config, "Device/AutoEventTick", err);
+  if (svc->config.device.aetick == 0)
+  {
+    svc->config.device.aetick = 1000;
+  }
+  svc->config.device.aephase = get_nv_config_choice
+    (svc->logger, config, "Device/AutoEventPhase", aephase_names, err);
+  svc->config.device.aejitter =
+    get_nv_config_uint32 (svc->logger, config, "Device/AutoEventJitter", err);
+  svc->config.device.aeoverrun = get_nv_config_choice
+    (svc->logger, config, "Device/AutoEventOverrun", aeoverrun_names, err);
+  svc->config.device.aebatch =
+    get_nv_config_uint32 (svc->logger, config, "Device/AutoEventBatch", err);
   svc->config.device.sendreadingsonchanged =
     get_nv_config_bool (config, "Device/SendReadingsOnChanged", false);
+  svc->config.device.maxconcurrent = get_nv_config_uint32
+    (svc->logger, config, "Device/MaxConcurrentCommands", err);
+  svc->config.device.maxdevicecmds =
+    get_nv_config_uint32 (svc->logger, config, "Device/MaxDeviceCommands", err);
+  svc->config.device.cmdqueuelen =
+    get_nv_config_uint32 (svc->logger, config, "Device/CommandQueueLength", err);
+  svc->config.device.cmdqueuetimeout = get_nv_config_uint32
+    (svc->logger, config, "Device/CommandQueueTimeout", err);
 
   svc->config.driverconf = iot_data_alloc_map (IOT_DATA_STRING);
   for (const devsdk_nvpairs *iter = config; iter; iter = iter->next)
@@ -567,6 +650,18 @@ void edgex_device_populateConfig
   svc->config.logging.useremote =
     get_nv_config_bool (config, "Logging/EnableRemote", false);
   svc->config.logging.file = get_nv_config_string (config, "Logging/File");
+  svc->config.logging.tracing =
+    get_nv_config_bool (config, "Logging/EnableTracing", true);
+  svc->config.logging.ratelimit =
+    get_nv_config_uint32 (svc->logger, config, "Logging/RateLimit", err);
+  svc->config.logging.rateinterval =
+    get_nv_config_uint32 (svc->logger, config, "Logging/RateInterval", err);
+  if (svc->config.logging.rateinterval == 0)
+  {
+    svc->config.logging.rateinterval = 10;
+  }
+  edgex_ratelog_configure
+    (svc->ratelog, svc->config.logging.ratelimit, svc->config.logging.rateinterval);
 
   edgex_device_updateConf (svc, config);
 }
@@ -604,6 +699,7 @@ void edgex_device_freeConfig (devsdk_service_t *svc)
   free (svc->config.device.removecmd);
   free (svc->config.device.removecmdargs);
   free (svc->config.device.profilesdir);
+  free (svc->config.device.cachefile);
 
   if (svc->config.service.labels)
   {
@@ -677,6 +773,9 @@ int edgex_device_handler_config
   JSON_Object *lobj = json_value_get_object (lval);
   json_object_set_string (lobj, "File", svc->config.logging.file);
   json_object_set_boolean (lobj, "EnableRemote", svc->config.logging.useremote);
+  json_object_set_boolean (lobj, "EnableTracing", svc->config.logging.tracing);
+  json_object_set_uint (lobj, "RateLimit", svc->config.logging.ratelimit);
+  json_object_set_uint (lobj, "RateInterval", svc->config.logging.rateinterval);
   json_object_set_value (obj, "Logging", lval);
 
   JSON_Value *sval = json_value_init_object ();
@@ -692,6 +791,18 @@ int edgex_device_handler_config
   json_object_set_string (sobj, "StartupMsg", svc->config.service.startupmsg);
   json_object_set_string
     (sobj, "CheckInterval", svc->config.service.checkinterval);
+  json_object_set_uint
+    (sobj, "CompressionThreshold", svc->config.service.compressminsize);
+  json_object_set_uint
+    (sobj, "MaxRequestSize", svc->config.service.maxrequestsize);
+  for (unsigned c = 0; c < EDGEX_WORK_NCLASSES; c++)
+  {
+    char key[32];
+    sprintf (key, "%sThreads", edgex_workclass_names[c]);
+    json_object_set_uint (sobj, key, svc->config.service.threads[c]);
+    sprintf (key, "%sPriority", edgex_workclass_names[c]);
+    json_object_set_uint (sobj, key, svc->config.service.priority[c]);
+  }
 
   lval = json_value_init_array ();
   JSON_Array *larr = json_value_get_array (lval);
@@ -717,8 +828,24 @@ int edgex_device_handler_config
   json_object_set_string
     (dobj, "RemoveCmdArgs", svc->config.device.removecmdargs);
   json_object_set_string (dobj, "ProfilesDir", svc->config.device.profilesdir);
+  json_object_set_string (dobj, "CacheFile", svc->config.device.cachefile);
+  json_object_set_uint (dobj, "AutoEventTick", svc->config.device.aetick);
+  json_object_set_string
+    (dobj, "AutoEventPhase", aephase_names[svc->config.device.aephase]);
+  json_object_set_uint (dobj, "AutoEventJitter", svc->config.device.aejitter);
+  json_object_set_string
+    (dobj, "AutoEventOverrun", aeoverrun_names[svc->config.device.aeoverrun]);
+  json_object_set_uint (dobj, "AutoEventBatch", svc->config.device.aebatch);
   json_object_set_boolean
     (dobj, "SendReadingsOnChanged", svc->config.device.sendreadingsonchanged);
+  json_object_set_uint
+    (dobj, "MaxConcurrentCommands", svc->config.device.maxconcurrent);
+  json_object_set_uint
+    (dobj, "MaxDeviceCommands", svc->config.device.maxdevicecmds);
+  json_object_set_uint
+    (dobj, "CommandQueueLength", svc->config.device.cmdqueuelen);
+  json_object_set_uint
+    (dobj, "CommandQueueTimeout", svc->config.device.cmdqueuetimeout);
   json_object_set_value (obj, "Device", dval);
 
   if (svc->config.driverconf)
@@ -13,6 +13,7 @@
 #include "rest-server.h"
 #include "toml.h"
 #include "map.h"
+#include "workpool.h"
 
 typedef struct edgex_device_serviceinfo
 {
@@ -23,6 +24,10 @@ typedef struct edgex_device_serviceinfo
   char *startupmsg;
   struct timespec timeout;
   char *checkinterval;
+  uint32_t compressminsize;
+  uint32_t maxrequestsize;
+  uint32_t threads[EDGEX_WORK_NCLASSES];
+  uint32_t priority[EDGEX_WORK_NCLASSES];
 } edgex_device_serviceinfo;
 
 typedef struct edgex_device_service_endpoint
@@ -38,6 +43,20 @@ typedef struct edgex_service_endpoints
   edgex_device_service_endpoint logging;
 } edgex_service_endpoints;
 
+typedef enum edgex_device_aephase
+{
+  EDGEX_AEPHASE_NONE,
+  EDGEX_AEPHASE_HASH,
+  EDGEX_AEPHASE_RANDOM
+} edgex_device_aephase;
+
+typedef enum edgex_device_aeoverrun
+{
+  EDGEX_AEOVERRUN_CONCURRENT,
+  EDGEX_AEOVERRUN_SKIP,
+  EDGEX_AEOVERRUN_QUEUE
+} edgex_device_aeoverrun;
+
 typedef struct edgex_device_deviceinfo
 {
   bool datatransform;
@@ -49,13 +68,26 @@ typedef struct edgex_device_deviceinfo
   char *removecmd;
   char *removecmdargs;
   char *profilesdir;
+  char *cachefile;
+  uint32_t aetick;
+  edgex_device_aephase aephase;
+  uint32_t aejitter;
+  uint32_t aebatch;
+  edgex_device_aeoverrun aeoverrun;
   bool sendreadingsonchanged;
+  uint32_t maxconcurrent;
+  uint32_t maxdevicecmds;
+  uint32_t cmdqueuelen;
+  uint32_t cmdqueuetimeout;
 } edgex_device_deviceinfo;
 
 typedef struct edgex_device_logginginfo
 {
   char *file;
   bool useremote;
+  bool tracing;
+  uint32_t ratelimit;
+  uint32_t rateinterval;
   iot_loglevel_t level;
 } edgex_device_logginginfo;
 
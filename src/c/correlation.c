@@ -8,35 +8,91 @@
 
 #include "correlation.h"
 
-#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <uuid/uuid.h>
 
-static _Thread_local char *localid = NULL;
+#define EDGEX_CRLID_PREFIX EDGEX_CRLID_HDR ": "
+#define EDGEX_CRLID_PREFIXLEN (sizeof (EDGEX_CRLID_PREFIX) - 1)
+#define EDGEX_UUID_STRLEN 36
+
+/* The header buffer holds "correlation-id: <id>"; the id itself is a suffix */
+
+static _Thread_local char localhdr[EDGEX_CRLID_PREFIXLEN + EDGEX_CRLID_MAXLEN + 1];
+static _Thread_local bool localset = false;
+
+/* Generated ids have the form of version 4 UUIDs. The first eight bytes are
+ * drawn at random once per thread and the remainder is a per-thread counter
+ * with a random starting point, so the system RNG is only used once.
+ */
+
+static _Thread_local uint64_t seed = 0;
+static _Thread_local uint64_t counter = 0;
+
+static void render_uuid (char *out, uint64_t hi, uint64_t lo)
+{
+  static const char hex[] = "0123456789abcdef";
+  uint8_t bytes[16];
+
+  hi = (hi & ~0xf000ULL) | 0x4000ULL;
+  lo = (lo & ~(3ULL << 62)) | (2ULL << 62);
+  for (int i = 0; i < 8; i++)
+  {
+    bytes[i] = hi >> (56 - 8 * i);
+    bytes[i + 8] = lo >> (56 - 8 * i);
+  }
+  for (int i = 0; i < 16; i++)
+  {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+    {
+      *out++ = '-';
+    }
+    *out++ = hex[bytes[i] >> 4];
+    *out++ = hex[bytes[i] & 0xf];
+  }
+  *out = '\0';
+}
 
 const char *edgex_device_get_crlid ()
 {
-  return localid;
+  return localset ? localhdr + EDGEX_CRLID_PREFIXLEN : NULL;
+}
+
+const char *edgex_device_get_crlid_hdr ()
+{
+  return localset ? localhdr : NULL;
 }
 
 void edgex_device_alloc_crlid (const char *id)
 {
-  edgex_device_free_crlid ();
+  char *dest = localhdr + EDGEX_CRLID_PREFIXLEN;
+  if (localhdr[0] == '\0')
+  {
+    memcpy (localhdr, EDGEX_CRLID_PREFIX, EDGEX_CRLID_PREFIXLEN);
+  }
   if (id)
   {
-    localid = strdup (id);
+    size_t len = strnlen (id, EDGEX_CRLID_MAXLEN);
+    memcpy (dest, id, len);
+    dest[len] = '\0';
   }
   else
   {
-    uuid_t uid;
-    uuid_generate (uid);
-    localid = malloc (37);
-    uuid_unparse (uid, localid);
+    if (seed == 0)
+    {
+      uuid_t uid;
+      uuid_generate (uid);
+      memcpy (&seed, uid, sizeof (seed));
+      memcpy (&counter, uid + sizeof (seed), sizeof (counter));
+      seed |= 1;
+    }
+    render_uuid (dest, seed, counter++);
   }
+  localset = true;
 }
 
 void edgex_device_free_crlid ()
 {
-  free (localid);
-  localid = NULL;
+  localset = false;
 }
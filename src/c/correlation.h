@@ -11,8 +11,21 @@
 
 #define EDGEX_CRLID_HDR "correlation-id"
 
+/* Longer incoming ids are truncated */
+#define EDGEX_CRLID_MAXLEN 127
+
+/* The correlation id is held in thread-local storage. Functions returning it
+ * give NULL if no id is set for the current thread.
+ */
+
 const char *edgex_device_get_crlid (void);
+
+/* The id pre-rendered as a "correlation-id: <id>" request header */
+const char *edgex_device_get_crlid_hdr (void);
+
+/* Set the id for the current thread, generating a new one if id is NULL */
 void edgex_device_alloc_crlid (const char *id);
+
 void edgex_device_free_crlid (void);
 
 #endif
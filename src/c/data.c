@@ -16,6 +16,7 @@
 #include "iot/base64.h"
 
 #include <cbor.h>
+#include <math.h>
 
 static char *edgex_value_tostring (const iot_data_t *value, bool binfloat)
 {
@@ -73,22 +74,120 @@ edgex_event_cooked *edgex_data_process_event
   const char *device_name,
   const edgex_cmdinfo *commandinfo,
   devsdk_commandresult *values,
-  bool doTransforms
+  bool doTransforms,
+  bool forceCBOR
+)
+{
+  return edgex_data_process_event_batch (device_name, commandinfo, values, 1, doTransforms, forceCBOR);
+}
+
+static double scalar_double (const devsdk_scalar *s)
+{
+  switch (s->kind)
+  {
+    case DEVSDK_SCALAR_INT: return s->v.i;
+    case DEVSDK_SCALAR_UINT: return s->v.ui;
+    case DEVSDK_SCALAR_BOOL: return s->v.b;
+    default: return s->v.f;
+  }
+}
+
+static int64_t scalar_int (const devsdk_scalar *s)
+{
+  switch (s->kind)
+  {
+    case DEVSDK_SCALAR_UINT: return (int64_t) s->v.ui;
+    case DEVSDK_SCALAR_FLOAT: return llround (s->v.f);
+    case DEVSDK_SCALAR_BOOL: return s->v.b;
+    default: return s->v.i;
+  }
+}
+
+static uint64_t scalar_uint (const devsdk_scalar *s)
+{
+  switch (s->kind)
+  {
+    case DEVSDK_SCALAR_INT: return (uint64_t) s->v.i;
+    case DEVSDK_SCALAR_FLOAT: return (s->v.f > 0.0) ? (uint64_t) llround (s->v.f) : 0;
+    case DEVSDK_SCALAR_BOOL: return s->v.b;
+    default: return s->v.ui;
+  }
+}
+
+void edgex_data_materialize (devsdk_commandresult *res, iot_data_type_t type)
+{
+  const devsdk_scalar *s = &res->scalar;
+
+  if (res->value || s->kind == DEVSDK_SCALAR_NONE)
+  {
+    return;
+  }
+  switch (type)
+  {
+    case IOT_DATA_INT8: res->value = iot_data_alloc_i8 (scalar_int (s)); break;
+    case IOT_DATA_UINT8: res->value = iot_data_alloc_ui8 (scalar_uint (s)); break;
+    case IOT_DATA_INT16: res->value = iot_data_alloc_i16 (scalar_int (s)); break;
+    case IOT_DATA_UINT16: res->value = iot_data_alloc_ui16 (scalar_uint (s)); break;
+    case IOT_DATA_INT32: res->value = iot_data_alloc_i32 (scalar_int (s)); break;
+    case IOT_DATA_UINT32: res->value = iot_data_alloc_ui32 (scalar_uint (s)); break;
+    case IOT_DATA_INT64: res->value = iot_data_alloc_i64 (scalar_int (s)); break;
+    case IOT_DATA_UINT64: res->value = iot_data_alloc_ui64 (scalar_uint (s)); break;
+    case IOT_DATA_FLOAT32: res->value = iot_data_alloc_f32 (scalar_double (s)); break;
+    case IOT_DATA_FLOAT64: res->value = iot_data_alloc_f64 (scalar_double (s)); break;
+    case IOT_DATA_BOOL: res->value = iot_data_alloc_bool (scalar_double (s) != 0.0); break;
+    case IOT_DATA_STRING:
+    {
+      char buf[32];
+      if (s->kind == DEVSDK_SCALAR_FLOAT)
+      {
+        sprintf (buf, "%.17g", s->v.f);
+      }
+      else if (s->kind == DEVSDK_SCALAR_BOOL)
+      {
+        strcpy (buf, s->v.b ? "true" : "false");
+      }
+      else if (s->kind == DEVSDK_SCALAR_UINT)
+      {
+        sprintf (buf, "%" PRIu64, s->v.ui);
+      }
+      else
+      {
+        sprintf (buf, "%" PRId64, s->v.i);
+      }
+      res->value = iot_data_alloc_string (strdup (buf), IOT_DATA_TAKE);
+      break;
+    }
+    default: break;
+  }
+  res->scalar.kind = DEVSDK_SCALAR_NONE;
+}
+
+edgex_event_cooked *edgex_data_process_event_batch
+(
+  const char *device_name,
+  const edgex_cmdinfo *commandinfo,
+  devsdk_commandresult *values,
+  uint32_t nsamples,
+  bool doTransforms,
+  bool forceCBOR
 )
 {
   edgex_event_cooked *result = NULL;
-  bool useCBOR = false;
+  bool useCBOR = forceCBOR;
   uint64_t timenow = iot_time_nsecs ();
-  for (uint32_t i = 0; i < commandinfo->nreqs; i++)
+  uint32_t nreadings = commandinfo->nreqs * nsamples;
+  for (uint32_t n = 0; n < nreadings; n++)
   {
+    uint32_t i = n % commandinfo->nreqs;
+    edgex_data_materialize (&values[n], commandinfo->pvals[i]->type);
     if (doTransforms)
     {
-      edgex_transform_outgoing (&values[i], commandinfo->pvals[i], commandinfo->maps[i]);
+      edgex_transform_outgoing (&values[n], commandinfo->pvals[i], commandinfo->maps[i]);
     }
     const char *assertion = commandinfo->pvals[i]->assertion;
     if (assertion && *assertion)
     {
-      char *reading = edgex_value_tostring (values[i].value, commandinfo->pvals[i]->floatAsBinary);
+      char *reading = edgex_value_tostring (values[n].value, commandinfo->pvals[i]->floatAsBinary);
       if (strcmp (reading, assertion))
       {
         free (reading);
@@ -110,25 +209,26 @@ edgex_event_cooked *edgex_data_process_event
   {
     size_t bsize = 0;
     cbor_item_t *cevent = cbor_new_definite_map (3);
-    cbor_item_t *crdgs = cbor_new_definite_array (commandinfo->nreqs);
+    cbor_item_t *crdgs = cbor_new_definite_array (nreadings);
 
-    for (uint32_t i = 0; i < commandinfo->nreqs; i++)
+    for (uint32_t n = 0; n < nreadings; n++)
     {
+      uint32_t i = n % commandinfo->nreqs;
       cbor_item_t *crdg = cbor_new_definite_map (3);
 
       cbor_item_t *cread;
-      if (iot_data_type (values[i].value) == IOT_DATA_ARRAY)
+      if (iot_data_type (values[n].value) == IOT_DATA_ARRAY)
       {
         const uint8_t *data;
-        uint32_t sz = iot_data_array_size (values[i].value);
-        data = iot_data_address (values[i].value);
+        uint32_t sz = iot_data_array_size (values[n].value);
+        data = iot_data_address (values[n].value);
         cread = cbor_build_bytestring (data, sz);
         cbor_map_add (crdg, (struct cbor_pair)
           { .key = cbor_move (cbor_build_string ("binaryValue")), .value = cbor_move (cread) });
       }
       else
       {
-        char *reading = edgex_value_tostring (values[i].value, commandinfo->pvals[i]->floatAsBinary);
+        char *reading = edgex_value_tostring (values[n].value, commandinfo->pvals[i]->floatAsBinary);
         cread = cbor_build_string (reading);
         free (reading);
         cbor_map_add (crdg, (struct cbor_pair)
@@ -144,7 +244,7 @@ edgex_event_cooked *edgex_data_process_event
       cbor_map_add (crdg, (struct cbor_pair)
       {
         .key = cbor_move (cbor_build_string ("origin")),
-        .value = cbor_move (cbor_build_uint64 (values[i].origin ? values[i].origin : timenow))
+        .value = cbor_move (cbor_build_uint64 (values[n].origin ? values[n].origin : timenow))
       });
 
       cbor_array_push (crdgs, cbor_move (crdg));
@@ -169,16 +269,17 @@ edgex_event_cooked *edgex_data_process_event
     JSON_Value *arrval = json_value_init_array ();
     JSON_Array *jrdgs = json_value_get_array (arrval);
 
-    for (uint32_t i = 0; i < commandinfo->nreqs; i++)
+    for (uint32_t n = 0; n < nreadings; n++)
     {
-      char *reading = edgex_value_tostring (values[i].value, commandinfo->pvals[i]->floatAsBinary);
+      uint32_t i = n % commandinfo->nreqs;
+      char *reading = edgex_value_tostring (values[n].value, commandinfo->pvals[i]->floatAsBinary);
 
       JSON_Value *rval = json_value_init_object ();
       JSON_Object *robj = json_value_get_object (rval);
 
       json_object_set_string (robj, "name", commandinfo->reqs[i].resname);
       json_object_set_string (robj, "value", reading);
-      json_object_set_uint (robj, "origin", values[i].origin ? values[i].origin : timenow);
+      json_object_set_uint (robj, "origin", values[n].origin ? values[n].origin : timenow);
       json_array_append_value (jrdgs, rval);
       free (reading);
     }
@@ -259,34 +360,6 @@ void devsdk_commandresult_free (devsdk_commandresult *res, int n)
   }
 }
 
-/* Dummy methods: onChange on AutoEvents will not work until these two are impl
-emented in iot-c-utils */
-
-devsdk_commandresult *devsdk_commandresult_dup (const devsdk_commandresult *res, int n)
-{
-  devsdk_commandresult *result = calloc (n, sizeof (devsdk_commandresult));
-  for (int i = 0; i < n; i++)
-  {
-    result[i].value = iot_data_copy (res[i].value);
-  }
-  return result;
-}
-
-bool devsdk_commandresult_equal
-  (const devsdk_commandresult *lhs, const devsdk_commandresult *rhs, int n)
-{
-  bool result = true;
-  for (int i = 0; i < n; i++)
-  {
-    if (!iot_data_equal (lhs[i].value, rhs[i].value))
-    {
-      result = false;
-      break;
-    }
-  }
-  return result;
-}
-
 edgex_valuedescriptor *edgex_data_client_add_valuedescriptor
 (
   iot_logger_t *lc,
@@ -77,12 +77,35 @@ typedef struct edgex_service_endpoints edgex_service_endpoints;
 
 void edgex_event_cooked_free (edgex_event_cooked *e);
 
+/* Convert a reading set in place by the driver (see
+ * devsdk_commandresult_set_int etc) to an iot_data_t of the given type.
+ * Readings which already have a value are left as they are.
+ */
+
+void edgex_data_materialize (devsdk_commandresult *res, iot_data_type_t type);
+
 edgex_event_cooked *edgex_data_process_event
 (
   const char *device_name,
   const edgex_cmdinfo *commandinfo,
   devsdk_commandresult *values,
-  bool doTransforms
+  bool doTransforms,
+  bool forceCBOR
+);
+
+/* As above, for an event containing several sets of readings for the
+ * command. The values array holds nsamples sets of commandinfo->nreqs
+ * values, one set after another.
+ */
+
+edgex_event_cooked *edgex_data_process_event_batch
+(
+  const char *device_name,
+  const edgex_cmdinfo *commandinfo,
+  devsdk_commandresult *values,
+  uint32_t nsamples,
+  bool doTransforms,
+  bool forceCBOR
 );
 
 void edgex_data_client_add_event
@@ -113,8 +136,4 @@ edgex_valuedescriptor *edgex_data_client_add_valuedescriptor
 
 void devsdk_commandresult_free (devsdk_commandresult *res, int n);
 
-devsdk_commandresult *devsdk_commandresult_dup (const devsdk_commandresult *res, int n);
-
-bool devsdk_commandresult_equal (const devsdk_commandresult *lhs, const devsdk_commandresult *rhs, int n);
-
 #endif
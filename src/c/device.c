@@ -142,7 +142,7 @@ static iot_data_t *populateValue (iot_data_type_t rtype, const char *val)
 static edgex_deviceresource *findDevResource
   (edgex_deviceresource *list, const char *name)
 {
-  while (list && strcmp (list->name, name))
+  while (list && list->name != name && strcmp (list->name, name))
   {
     list = list->next;
   }
@@ -270,13 +270,22 @@ const edgex_cmdinfo *edgex_deviceprofile_findcommand
   }
 
   edgex_cmdinfo *result = prof->cmdinfo;
-  while (result && (strcmp (result->name, name) || forGet != result->isget))
+  while (result && (forGet != result->isget || (result->name != name && strcmp (result->name, name))))
   {
     result = result->next;
   }
   return result;
 }
 
+const edgex_cmdinfo *edgex_deviceprofile_commands (edgex_deviceprofile *prof)
+{
+  if (prof->cmdinfo == NULL)
+  {
+    populateCmdInfo (prof);
+  }
+  return prof->cmdinfo;
+}
+
 static bool commandExists (const char *name, edgex_deviceprofile *prof)
 {
   if (prof->cmdinfo == NULL)
@@ -307,7 +316,7 @@ static int edgex_device_runput
   JSON_Value *jval = json_parse_string (data);
   if (jval == NULL)
   {
-    iot_log_error (svc->logger, "Payload did not parse as JSON");
+    edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Payload did not parse as JSON");
     return MHD_HTTP_BAD_REQUEST;
   }
 
@@ -319,8 +328,8 @@ static int edgex_device_runput
     const char *resname = commandinfo->reqs[i].resname;
     if (!commandinfo->pvals[i]->writable)
     {
-      iot_log_error
-        (svc->logger, "Attempt to write unwritable value %s", resname);
+      edgex_log_limited
+        (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Attempt to write unwritable value %s", resname);
       retcode = MHD_HTTP_METHOD_NOT_ALLOWED;
       break;
     }
@@ -329,15 +338,15 @@ static int edgex_device_runput
     if (value == NULL && commandinfo->dfls[i] == NULL)
     {
       retcode = MHD_HTTP_BAD_REQUEST;
-      iot_log_error (svc->logger, "No value supplied for %s", resname);
+      edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "No value supplied for %s", resname);
       break;
     }
     results[i] = populateValue (commandinfo->pvals[i]->type, value ? value : commandinfo->dfls[i]);
     if (!results[i])
     {
       retcode = MHD_HTTP_BAD_REQUEST;
-      iot_log_error
-        (svc->logger, "Unable to parse \"%s\" for %s", value ? value : commandinfo->dfls[i], resname);
+      edgex_log_limited
+        (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Unable to parse \"%s\" for %s", value ? value : commandinfo->dfls[i], resname);
       break;
     }
     if (svc->config.device.datatransform && value)
@@ -346,7 +355,7 @@ static int edgex_device_runput
       if (!results[i])
       {
         retcode = MHD_HTTP_BAD_REQUEST;
-        iot_log_error (svc->logger, "Value \"%s\" for %s overflows after transformations", value, resname);
+        edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Value \"%s\" for %s overflows after transformations", value, resname);
         break;
       }
     }
@@ -366,7 +375,7 @@ static int edgex_device_runput
       {
         *exc = iot_data_to_json (e);
       }
-      iot_log_error (svc->logger, "Driver for %s failed on PUT%s%s", dev->name, e ? ": " : "", e ? *exc : "");
+      edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Driver for %s failed on PUT%s%s", dev->name, e ? ": " : "", e ? *exc : "");
     }
     iot_data_free (e);
   }
@@ -381,6 +390,14 @@ static int edgex_device_runput
   return retcode;
 }
 
+/* Clients may request CBOR-encoded events via the Accept header */
+
+static bool acceptsCBOR (void)
+{
+  const char *accept = edgex_rest_server_request_header (MHD_HTTP_HEADER_ACCEPT);
+  return accept && strstr (accept, "application/cbor");
+}
+
 static int edgex_device_runget
 (
   devsdk_service_t *svc,
@@ -400,7 +417,7 @@ static int edgex_device_runget
   {
     if (!cmdinfo->pvals[i]->readable)
     {
-      iot_log_error (svc->logger, "Attempt to read unreadable value %s", cmdinfo->reqs[i].resname);
+      edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Attempt to read unreadable value %s", cmdinfo->reqs[i].resname);
       return MHD_HTTP_METHOD_NOT_ALLOWED;
     }
   }
@@ -413,7 +430,8 @@ static int edgex_device_runget
   )
   {
     devsdk_error err = EDGEX_OK;
-    *reply = edgex_data_process_event (dev->name, cmdinfo, results, svc->config.device.datatransform);
+    *reply = edgex_data_process_event
+      (dev->name, cmdinfo, results, svc->config.device.datatransform, acceptsCBOR ());
 
     if (*reply)
     {
@@ -422,7 +440,7 @@ static int edgex_device_runget
     }
     else
     {
-      iot_log_error (svc->logger, "Assertion failed for device %s. Disabling.", dev->name);
+      edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Assertion failed for device %s. Disabling.", dev->name);
       edgex_metadata_client_set_device_opstate (svc->logger, &svc->config.endpoints, dev->id, DISABLED, &err);
     }
   }
@@ -432,7 +450,7 @@ static int edgex_device_runget
     {
       *exc = iot_data_to_json (e);
     }
-    iot_log_error (svc->logger, "Driver for %s failed on GET%s%s", dev->name, e ? ": " : "", e ? *exc : "");
+    edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "Driver for %s failed on GET%s%s", dev->name, e ? ": " : "", e ? *exc : "");
   }
 
   iot_data_free (e);
@@ -455,9 +473,9 @@ static int runOne
 {
   if (dev->adminState == LOCKED)
   {
-    iot_log_error
+    edgex_log_limited
     (
-      svc->logger,
+      svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name,
       "Can't run command %s on device %s as it is locked",
       command->name, dev->name
     );
@@ -466,9 +484,9 @@ static int runOne
 
   if (dev->operatingState == DISABLED)
   {
-    iot_log_error
+    edgex_log_limited
     (
-      svc->logger,
+      svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name,
       "Can't run command %s on device %s as it is disabled",
       command->name, dev->name
     );
@@ -477,9 +495,9 @@ static int runOne
 
   if (command->nreqs > svc->config.device.maxcmdops)
   {
-    iot_log_error
+    edgex_log_limited
     (
-      svc->logger,
+      svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name,
       "MaxCmdOps (%d) exceeded for dev: %s cmd: %s",
       svc->config.device.maxcmdops, dev->name, command->name
     );
@@ -494,7 +512,7 @@ static int runOne
   {
     if (upload_data_size == 0)
     {
-      iot_log_error (svc->logger, "PUT command recieved with no data");
+      edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "PUT command recieved with no data");
       return MHD_HTTP_BAD_REQUEST;
     }
     return edgex_device_runput (svc, dev, command, upload_data, exc);
@@ -530,8 +548,16 @@ static int allCommand
   edgex_event_encoding enc;
   size_t bsize;
 
-  iot_log_debug
-    (svc->logger, "Incoming %s command %s for all", methStr (method), cmd);
+  edgex_log_limited
+    (svc->logger, svc->ratelog, IOT_LOG_DEBUG, cmd, "Incoming %s command %s for all", methStr (method), cmd);
+
+  ret = edgex_admission_enter (svc->admission, NULL);
+  if (ret != MHD_HTTP_OK)
+  {
+    edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_DEBUG, cmd, "Command %s for all rejected: service busy", cmd);
+    return ret;
+  }
+  ret = MHD_HTTP_NOT_FOUND;
 
   enc = JSON;
   bsize = 3; // start-array byte + end-array byte + NUL character
@@ -544,7 +570,20 @@ static int allCommand
   {
     edgex_event_cooked *ereply = NULL;
     char *exc = NULL;
-    retOne = runOne (svc, iter->dev, iter->cmd, qparams, upload_data, upload_data_size, &ereply, &exc);
+    retOne = edgex_admission_enter_device (svc->admission, iter->dev->name);
+    if (retOne == MHD_HTTP_OK)
+    {
+      retOne = runOne (svc, iter->dev, iter->cmd, qparams, upload_data, upload_data_size, &ereply, &exc);
+      edgex_admission_leave_device (svc->admission, iter->dev->name);
+    }
+    else
+    {
+      edgex_log_limited
+      (
+        svc->logger, svc->ratelog, IOT_LOG_DEBUG, iter->dev->name,
+        "Command %s for device %s skipped: device busy", cmd, iter->dev->name
+      );
+    }
     edgex_device_release (iter->dev);
     free (exc);
     if (ereply)
@@ -610,6 +649,7 @@ static int allCommand
     free (cmdq);
     cmdq = iter;
   }
+  edgex_admission_leave (svc->admission, NULL);
   return ret;
 }
 
@@ -632,9 +672,9 @@ static int oneCommand
   edgex_device *dev = NULL;
   const edgex_cmdinfo *command = NULL;
 
-  iot_log_debug
+  edgex_log_limited
   (
-    svc->logger,
+    svc->logger, svc->ratelog, IOT_LOG_DEBUG, id,
     "Incoming command for device {%s}: %s (%s)",
     id, cmd, methStr (method)
   );
@@ -658,7 +698,21 @@ static int oneCommand
   {
     edgex_event_cooked *ereply = NULL;
     char *exc = NULL;
-    result = runOne (svc, dev, command, qparams, upload_data, upload_data_size, &ereply, &exc);
+    result = edgex_admission_enter (svc->admission, dev->name);
+    if (result == MHD_HTTP_OK)
+    {
+      result = runOne (svc, dev, command, qparams, upload_data, upload_data_size, &ereply, &exc);
+      edgex_admission_leave (svc->admission, dev->name);
+    }
+    else
+    {
+      edgex_log_limited
+      (
+        svc->logger, svc->ratelog, IOT_LOG_DEBUG, dev->name,
+        "Command %s for device %s rejected: %s busy",
+        cmd, dev->name, result == MHD_HTTP_TOO_MANY_REQUESTS ? "device" : "service"
+      );
+    }
     edgex_device_release (dev);
     if (ereply)
     {
@@ -690,9 +744,9 @@ static int oneCommand
     {
       if (commandExists (cmd, dev->profile))
       {
-        iot_log_error
+        edgex_log_limited
         (
-          svc->logger,
+          svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name,
           "Wrong method for command %s, device %s",
           cmd, dev->name
         );
@@ -700,14 +754,14 @@ static int oneCommand
       }
       else
       {
-        iot_log_error
-          (svc->logger, "No command %s for device %s", cmd, dev->name);
+        edgex_log_limited
+          (svc->logger, svc->ratelog, IOT_LOG_ERROR, dev->name, "No command %s for device %s", cmd, dev->name);
       }
       edgex_device_release (dev);
     }
     else
     {
-      iot_log_error (svc->logger, "No such device {%s}", id);
+      edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, id, "No such device {%s}", id);
     }
   }
   return result;
@@ -732,7 +786,7 @@ int edgex_device_handler_device
 
   if (strlen (url) == 0)
   {
-    iot_log_error (svc->logger, "No device specified in url");
+    edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, NULL, "No device specified in url");
   }
   else
   {
@@ -745,7 +799,7 @@ int edgex_device_handler_device
       }
       else
       {
-        iot_log_error (svc->logger, "No command specified in url");
+        edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, NULL, "No command specified in url");
       }
     }
     else
@@ -759,7 +813,7 @@ int edgex_device_handler_device
       cmd = strchr (url, '/');
       if (cmd == NULL || strlen (cmd + 1) == 0)
       {
-        iot_log_error (svc->logger, "No command specified in url");
+        edgex_log_limited (svc->logger, svc->ratelog, IOT_LOG_ERROR, NULL, "No command specified in url");
       }
       else
       {
@@ -30,4 +30,7 @@ extern int edgex_device_handler_device
 extern const struct edgex_cmdinfo *edgex_deviceprofile_findcommand
   (const char *name, edgex_deviceprofile *prof, bool forGet);
 
+extern const struct edgex_cmdinfo *edgex_deviceprofile_commands
+  (edgex_deviceprofile *prof);
+
 #endif
@@ -77,6 +77,31 @@ edgex_device * edgex_devices (devsdk_service_t *svc)
   return edgex_devmap_copydevices (svc->devices);
 }
 
+edgex_snapshot *edgex_snapshot_acquire (devsdk_service_t *svc)
+{
+  return edgex_devmap_snapshot_acquire (svc->devices);
+}
+
+void edgex_snapshot_release (edgex_snapshot *snap)
+{
+  edgex_devmap_snapshot_release (snap);
+}
+
+const edgex_device *edgex_snapshot_next_device (const edgex_snapshot *snap, edgex_snapshot_iter *iter)
+{
+  return edgex_devmap_snapshot_next_device (snap, iter);
+}
+
+const edgex_deviceprofile *edgex_snapshot_next_profile (const edgex_snapshot *snap, edgex_snapshot_iter *iter)
+{
+  return edgex_devmap_snapshot_next_profile (snap, iter);
+}
+
+const edgex_device *edgex_snapshot_device_byname (const edgex_snapshot *snap, const char *name)
+{
+  return edgex_devmap_snapshot_device_byname (snap, name);
+}
+
 edgex_device * edgex_get_device (devsdk_service_t *svc, const char *id)
 {
   edgex_device *internal;
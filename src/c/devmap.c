@@ -6,73 +6,654 @@
  *
  */
 
-/* Device / profile map implementation. We maintain 3 maps: device by id,
- * device id by name and profile by name. The devices in the device map
- * reference profiles in the profile map by pointer.
+/* Device / profile map implementation. Devices are indexed by id and by
+ * name, and profiles by name. The devices reference profiles in the profile
+ * map by pointer.
+ *
+ * The device indexes are split into shards, selected by a hash of the id or
+ * name respectively; a device's id and name entries may be in different
+ * shards. Each index is an open-addressed table which readers probe without
+ * locking, inside an epoch read section. Writers lock the shards they need,
+ * in ascending order, and change the tables an entry at a time: a slot is
+ * filled, replaced or cleared by a single atomic store, so that a reader
+ * finds either the old or the new device. The map's reference to a device
+ * which has been removed or replaced, and a table which has been outgrown,
+ * are retired for deferred reclamation (see epoch.h) rather than waited for.
+ * So the cost of a write does not depend on the number of devices, and
+ * writers touching different shards proceed in parallel.
+ *
+ * Devices in the map are not modified: an update replaces the device with a
+ * new one, to which any running autoevents are transferred.
+ *
+ * Each shard also indexes its devices (by id) which are enabled and unlocked,
+ * by the commands they support, for GET and SET separately. This maps each
+ * command name to a table of devices like those above, whose slots also hold
+ * the command info. The map of command names is immutable, and is copied
+ * when a name is added.
+ *
+ * The map publishes a snapshot, which holds a reference on each device in the
+ * map, sorted by name; acquiring it takes a reference on the snapshot. Each
+ * write advances the map's generation, and the snapshot is rebuilt by the
+ * first acquisition after the generation changes. A snapshot must see either
+ * all or none of the changes made by a writer: writers count themselves in
+ * and out of modification, and the rebuild retries if any modification
+ * overlaps it, taking all the shard locks after a few attempts.
+ *
+ * Profiles are held in a map under a rwlock, and are not freed until the
+ * device map is. A device bringing a newer version of its profile replaces the
+ * one held, which is kept until then as other devices may still refer to it;
+ * those devices are replaced as their own updates arrive. A reference-counted
+ * array of the profiles is also kept for snapshots.
  */
 
 #include "devmap.h"
 #include "devutil.h"
 #include "map.h"
+#include "epoch.h"
 #include "edgex-rest.h"
 #include "device.h"
 #include "autoevent.h"
+#include "service.h"
+
+#include <sched.h>
+
+#define DEVMAP_SHARD_BITS 4
+#define DEVMAP_SHARDS (1 << DEVMAP_SHARD_BITS)
+#define DEVMAP_ALL_SHARDS ((1u << DEVMAP_SHARDS) - 1)
+#define DEVMAP_MIN_SLOTS 8
+#define DEVMAP_SNAPSHOT_TRIES 4
 
-typedef edgex_map(edgex_device *) edgex_map_device;
 typedef edgex_map(edgex_deviceprofile *) edgex_map_profile;
 
+/* Marks a table slot whose device has been removed */
+
+static char devmap_cleared;
+#define DEVMAP_CLEARED ((edgex_device *) &devmap_cleared)
+
+typedef struct devmap_slot
+{
+  _Atomic (edgex_device *) dev;
+  uint64_t hash;
+  const edgex_cmdinfo *cmd;
+} devmap_slot;
+
+/* A table of devices, keyed by id or name. Slots are filled in order of
+ * probing and are not reused once cleared; the table is rebuilt when three
+ * quarters of its slots have been used. 'used' and 'live' are only accessed
+ * by writers.
+ */
+
+typedef struct devmap_table
+{
+  bool byname;
+  unsigned mask;
+  unsigned used;
+  unsigned live;
+  devmap_slot slots[];
+} devmap_table;
+
+/* The devices supporting a command, keyed by id, with the command info */
+
+typedef struct devmap_cmdslot
+{
+  _Atomic (devmap_table *) devs;
+} devmap_cmdslot;
+
+typedef struct devmap_cmdindex
+{
+  edgex_map(devmap_cmdslot *) names;
+} devmap_cmdindex;
+
+typedef struct devmap_shard
+{
+  pthread_mutex_t lock;
+  _Atomic (devmap_table *) byid;
+  _Atomic (devmap_table *) byname;
+  _Atomic (devmap_cmdindex *) getcmds;
+  _Atomic (devmap_cmdindex *) setcmds;
+} devmap_shard;
+
+/* Device list built up by a writer: devices to start */
+
+typedef struct devmap_pending
+{
+  edgex_device *dev;
+  struct devmap_pending *next;
+} devmap_pending;
+
+/* State of a write operation. The shards in 'locked' are held. */
+
+typedef struct devmap_txn
+{
+  edgex_devmap_t *map;
+  unsigned locked;
+  devmap_pending *started;
+} devmap_txn;
+
+typedef struct devmap_proflist
+{
+  atomic_uint refs;
+  unsigned count;
+  edgex_deviceprofile *profiles[];
+} devmap_proflist;
+
 struct edgex_devmap_t
 {
-  pthread_rwlock_t lock;
-  edgex_map_device devices;
-  edgex_map_string name_to_id;
+  devmap_shard shards[DEVMAP_SHARDS];
+  atomic_uint publishing;
+  atomic_uint_fast64_t published;
+  pthread_rwlock_t plock;
   edgex_map_profile profiles;
+  edgex_deviceprofile *oldprofiles;
+  devmap_proflist *proflist;
+  _Atomic (edgex_snapshot *) snapshot;
+  pthread_mutex_t snaplock;
   devsdk_service_t *svc;
 };
 
-edgex_devmap_t *edgex_devmap_alloc (devsdk_service_t *svc)
+/* The devices in a snapshot are sorted by name. 'gen' is the map's published
+ * count when it was built.
+ */
+
+struct edgex_snapshot
+{
+  atomic_uint refs;
+  uint64_t gen;
+  unsigned count;
+  edgex_device **devices;
+  devmap_proflist *proflist;
+};
+
+static inline unsigned shard_of (const char *key)
+{
+  return edgex_map_hash (key) >> (64 - DEVMAP_SHARD_BITS);
+}
+
+static inline unsigned shard_bit (const char *key)
+{
+  return 1u << shard_of (key);
+}
+
+static unsigned device_shards (const edgex_device *dev)
+{
+  return dev ? (shard_bit (dev->id) | shard_bit (dev->name)) : 0;
+}
+
+static inline const char *device_key (const edgex_device *dev, bool byname)
+{
+  return byname ? dev->name : dev->id;
+}
+
+static void device_retired (void *p)
+{
+  edgex_device_release ((edgex_device *)p);
+}
+
+static devmap_table *table_alloc (unsigned capacity, bool byname)
+{
+  devmap_table *t = calloc (1, sizeof (devmap_table) + capacity * sizeof (devmap_slot));
+  t->byname = byname;
+  t->mask = capacity - 1;
+  return t;
+}
+
+static edgex_device *table_find (devmap_table *t, const char *key)
+{
+  uint64_t hash = edgex_map_hash (key);
+
+  for (unsigned i = hash & t->mask; ; i = (i + 1) & t->mask)
+  {
+    edgex_device *dev = atomic_load_explicit (&t->slots[i].dev, memory_order_acquire);
+    if (dev == NULL)
+    {
+      return NULL;
+    }
+    if (dev != DEVMAP_CLEARED && t->slots[i].hash == hash)
+    {
+      const char *dkey = device_key (dev, t->byname);
+      if (dkey == key || strcmp (dkey, key) == 0)
+      {
+        return dev;
+      }
+    }
+  }
+}
+
+/* The slot holding a device, for writers */
+
+static devmap_slot *table_slot (devmap_table *t, const edgex_device *dev)
+{
+  uint64_t hash = edgex_map_hash (device_key (dev, t->byname));
+
+  for (unsigned i = hash & t->mask; ; i = (i + 1) & t->mask)
+  {
+    edgex_device *d = atomic_load_explicit (&t->slots[i].dev, memory_order_relaxed);
+    if (d == dev)
+    {
+      return &t->slots[i];
+    }
+    if (d == NULL)
+    {
+      return NULL;
+    }
+  }
+}
+
+/* Copy the live entries of a table into a new one, with room to grow, and
+ * publish it. The old table is retired.
+ */
+
+static devmap_table *table_rebuild (_Atomic (devmap_table *) *tp)
+{
+  devmap_table *old = atomic_load (tp);
+  unsigned capacity = DEVMAP_MIN_SLOTS;
+  devmap_table *t;
+
+  while (capacity * 3 <= (old->live + 1) * 8)
+  {
+    capacity <<= 1;
+  }
+  t = table_alloc (capacity, old->byname);
+  for (unsigned i = 0; i <= old->mask; i++)
+  {
+    edgex_device *dev = atomic_load_explicit (&old->slots[i].dev, memory_order_relaxed);
+    if (dev && dev != DEVMAP_CLEARED)
+    {
+      uint64_t hash = old->slots[i].hash;
+      unsigned j = hash & t->mask;
+      while (atomic_load_explicit (&t->slots[j].dev, memory_order_relaxed))
+      {
+        j = (j + 1) & t->mask;
+      }
+      t->slots[j].cmd = old->slots[i].cmd;
+      t->slots[j].hash = hash;
+      atomic_store_explicit (&t->slots[j].dev, dev, memory_order_relaxed);
+    }
+  }
+  t->used = t->live = old->live;
+  atomic_store (tp, t);
+  edgex_epoch_retire (free, old);
+  return t;
+}
+
+/* Add a device, which must not already be present */
+
+static void table_insert (_Atomic (devmap_table *) *tp, edgex_device *dev, const edgex_cmdinfo *cmd)
+{
+  devmap_table *t = atomic_load (tp);
+  uint64_t hash;
+  unsigned i;
+
+  if ((t->used + 1) * 4 > (t->mask + 1) * 3)
+  {
+    t = table_rebuild (tp);
+  }
+  hash = edgex_map_hash (device_key (dev, t->byname));
+  for (i = hash & t->mask; atomic_load_explicit (&t->slots[i].dev, memory_order_relaxed); i = (i + 1) & t->mask);
+  t->slots[i].cmd = cmd;
+  t->slots[i].hash = hash;
+  atomic_store_explicit (&t->slots[i].dev, dev, memory_order_release);
+  t->used++;
+  t->live++;
+}
+
+static void table_remove (devmap_table *t, const edgex_device *dev)
+{
+  devmap_slot *slot = table_slot (t, dev);
+  if (slot)
+  {
+    atomic_store_explicit (&slot->dev, DEVMAP_CLEARED, memory_order_release);
+    t->live--;
+  }
+}
+
+/* Replace a device with another having the same key */
+
+static void table_replace (devmap_table *t, const edgex_device *olddev, edgex_device *newdev)
+{
+  devmap_slot *slot = table_slot (t, olddev);
+  if (slot)
+  {
+    atomic_store_explicit (&slot->dev, newdev, memory_order_release);
+  }
+}
+
+static devmap_cmdindex *cmdindex_alloc (void)
+{
+  devmap_cmdindex *idx = malloc (sizeof (devmap_cmdindex));
+  edgex_map_init (&idx->names);
+  return idx;
+}
+
+/* Retirement of a superseded command index; its slots remain in use */
+
+static void cmdindex_retired (void *p)
+{
+  devmap_cmdindex *idx = (devmap_cmdindex *)p;
+  edgex_map_deinit (&idx->names);
+  free (idx);
+}
+
+static void cmdindex_free (devmap_cmdindex *idx)
+{
+  const char *key;
+  edgex_map_iter iter = edgex_map_iter (idx->names);
+  while ((key = edgex_map_next (&idx->names, &iter)))
+  {
+    devmap_cmdslot *slot = *(devmap_cmdslot **)edgex_map_get_ (&idx->names.base, key);
+    free (atomic_load (&slot->devs));
+    free (slot);
+  }
+  cmdindex_retired (idx);
+}
+
+static devmap_cmdslot *cmdindex_find (devmap_cmdindex *idx, const char *name)
+{
+  devmap_cmdslot **slot = edgex_map_get_ (&idx->names.base, name);
+  return slot ? *slot : NULL;
+}
+
+/* Returns the slot for a command, adding it if necessary. Slots are not
+ * removed, the number of distinct command names being small.
+ */
+
+static devmap_cmdslot *cmdindex_slot (_Atomic (devmap_cmdindex *) *ip, const char *name)
+{
+  const char *key;
+  devmap_cmdindex *idx = atomic_load (ip);
+  devmap_cmdslot *slot = cmdindex_find (idx, name);
+
+  if (slot == NULL)
+  {
+    devmap_cmdindex *copy = cmdindex_alloc ();
+    edgex_map_iter iter = edgex_map_iter (idx->names);
+    while ((key = edgex_map_next (&idx->names, &iter)))
+    {
+      edgex_map_set (&copy->names, key, cmdindex_find (idx, key));
+    }
+    slot = malloc (sizeof (devmap_cmdslot));
+    atomic_init (&slot->devs, table_alloc (DEVMAP_MIN_SLOTS, false));
+    edgex_map_set (&copy->names, name, slot);
+    atomic_store (ip, copy);
+    edgex_epoch_retire (cmdindex_retired, idx);
+  }
+  return slot;
+}
+
+static inline bool device_active (const edgex_device *dev)
+{
+  return dev->operatingState == ENABLED && dev->adminState == UNLOCKED;
+}
+
+static void cmdindex_add (devmap_shard *s, edgex_device *dev)
+{
+  if (device_active (dev))
+  {
+    for (const edgex_cmdinfo *ci = edgex_deviceprofile_commands (dev->profile); ci; ci = ci->next)
+    {
+      devmap_cmdslot *slot = cmdindex_slot (ci->isget ? &s->getcmds : &s->setcmds, ci->name);
+
+      /* Where a profile has duplicate names, the first is used */
+
+      if (table_find (atomic_load (&slot->devs), dev->id) == NULL)
+      {
+        table_insert (&slot->devs, dev, ci);
+      }
+    }
+  }
+}
+
+/* Replace a device in the command index with another, or remove it if
+ * newdev is NULL. The devices must have the same profile.
+ */
+
+static void cmdindex_replace (devmap_shard *s, const edgex_device *olddev, edgex_device *newdev)
 {
-  pthread_rwlockattr_t rwatt;
-  pthread_rwlockattr_init (&rwatt);
-#ifdef  __GLIBC_PREREQ
-#if __GLIBC_PREREQ(2, 1)
-  /* Avoid heavy readlock use (eg spammed "all" commands) blocking updates */
-  pthread_rwlockattr_setkind_np
-    (&rwatt, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
-#endif
-#endif
+  if (device_active (olddev))
+  {
+    for (const edgex_cmdinfo *ci = edgex_deviceprofile_commands (olddev->profile); ci; ci = ci->next)
+    {
+      devmap_cmdslot *slot = cmdindex_find (atomic_load (ci->isget ? &s->getcmds : &s->setcmds), ci->name);
+      if (slot)
+      {
+        devmap_table *t = atomic_load (&slot->devs);
+        if (newdev)
+        {
+          table_replace (t, olddev, newdev);
+        }
+        else
+        {
+          table_remove (t, olddev);
+        }
+      }
+    }
+  }
+}
 
+static void proflist_unref (devmap_proflist *pl)
+{
+  if (atomic_fetch_sub (&pl->refs, 1) == 1)
+  {
+    free (pl);
+  }
+}
+
+/* Rebuild the profile list after a change to the profile map. Called with
+ * the profile lock held for writing.
+ */
+
+static void proflist_update (edgex_devmap_t *map)
+{
+  const char *key;
+  unsigned n = 0;
+  devmap_proflist *pl = malloc (sizeof (devmap_proflist) + edgex_map_size (&map->profiles) * sizeof (edgex_deviceprofile *));
+  edgex_map_iter iter = edgex_map_iter (map->profiles);
+  while ((key = edgex_map_next (&map->profiles, &iter)))
+  {
+    pl->profiles[n++] = *edgex_map_get (&map->profiles, key);
+  }
+  pl->count = n;
+  atomic_init (&pl->refs, 1);
+  if (map->proflist)
+  {
+    proflist_unref (map->proflist);
+  }
+  map->proflist = pl;
+}
+
+/* Devices to have their autoevents started. The list holds a reference. */
+
+static void pending_add (devmap_pending **list, edgex_device *dev)
+{
+  devmap_pending *p = malloc (sizeof (devmap_pending));
+  atomic_fetch_add (&dev->refs, 1);
+  p->dev = dev;
+  p->next = *list;
+  *list = p;
+}
+
+static void txn_begin (devmap_txn *t, edgex_devmap_t *map, unsigned shards)
+{
+  memset (t, 0, sizeof (devmap_txn));
+  t->map = map;
+  t->locked = shards;
+  for (unsigned i = 0; i < DEVMAP_SHARDS; i++)
+  {
+    if (shards & (1u << i))
+    {
+      pthread_mutex_lock (&map->shards[i].lock);
+    }
+  }
+  atomic_fetch_add (&map->publishing, 1);
+}
+
+static void txn_unlock (devmap_txn *t)
+{
+  for (unsigned i = DEVMAP_SHARDS; i-- > 0; )
+  {
+    if (t->locked & (1u << i))
+    {
+      pthread_mutex_unlock (&t->map->shards[i].lock);
+    }
+  }
+  t->locked = 0;
+}
+
+static void txn_abort (devmap_txn *t)
+{
+  atomic_fetch_sub (&t->map->publishing, 1);
+  txn_unlock (t);
+}
+
+/* Complete a write operation, then start the autoevents of the devices on
+ * the started list. A device's id shard is relocked while its autoevents
+ * are started, so that this is ordered with any concurrent update or
+ * removal of the device, which stops them; a device which has already been
+ * replaced is not started.
+ */
+
+static void txn_commit (devmap_txn *t)
+{
+  edgex_devmap_t *map = t->map;
+
+  atomic_fetch_add (&map->published, 1);
+  atomic_fetch_sub (&map->publishing, 1);
+  txn_unlock (t);
+  while (t->started)
+  {
+    devmap_pending *next = t->started->next;
+    edgex_device *dev = t->started->dev;
+    devmap_shard *s = &map->shards[shard_of (dev->id)];
+
+    pthread_mutex_lock (&s->lock);
+    if (table_find (atomic_load (&s->byid), dev->id) == dev)
+    {
+      edgex_device_autoevent_start (map->svc, dev);
+    }
+    pthread_mutex_unlock (&s->lock);
+    edgex_device_release (dev);
+    free (t->started);
+    t->started = next;
+  }
+}
+
+/* Begin a write operation on the device found by lookup (key), and on the
+ * device newdev if given. Returns the device found, if any. As the shards
+ * needed are not known until the device is found, we find it without
+ * locking, then check that the shards locked are still sufficient.
+ */
+
+static edgex_device *txn_begin_device
+(
+  devmap_txn *t,
+  edgex_devmap_t *map,
+  const edgex_device *(*lookup) (edgex_devmap_t *, const char *),
+  const char *key,
+  const edgex_device *newdev
+)
+{
+  edgex_device *olddev;
+  unsigned need;
+
+  while (true)
+  {
+    edgex_epoch_enter ();
+    olddev = (edgex_device *)lookup (map, key);
+    need = shard_bit (key) | device_shards (olddev) | device_shards (newdev);
+    edgex_epoch_exit ();
+
+    txn_begin (t, map, need);
+    olddev = (edgex_device *)lookup (map, key);
+    if ((device_shards (olddev) & ~need) == 0)
+    {
+      return olddev;
+    }
+    txn_abort (t);
+  }
+}
+
+edgex_devmap_t *edgex_devmap_alloc (devsdk_service_t *svc)
+{
   edgex_devmap_t *res = malloc (sizeof (edgex_devmap_t));
-  pthread_rwlock_init (&res->lock, &rwatt);
-  pthread_rwlockattr_destroy (&rwatt);
-  edgex_map_init (&res->devices);
-  edgex_map_init (&res->name_to_id);
+  for (unsigned i = 0; i < DEVMAP_SHARDS; i++)
+  {
+    devmap_shard *s = &res->shards[i];
+    pthread_mutex_init (&s->lock, NULL);
+    atomic_init (&s->byid, table_alloc (DEVMAP_MIN_SLOTS, false));
+    atomic_init (&s->byname, table_alloc (DEVMAP_MIN_SLOTS, true));
+    atomic_init (&s->getcmds, cmdindex_alloc ());
+    atomic_init (&s->setcmds, cmdindex_alloc ());
+  }
+  atomic_init (&res->publishing, 0);
+  atomic_init (&res->published, 0);
+  pthread_rwlock_init (&res->plock, NULL);
   edgex_map_init (&res->profiles);
+  res->oldprofiles = NULL;
+  res->proflist = NULL;
+  proflist_update (res);
+  atomic_init (&res->snapshot, NULL);
+  pthread_mutex_init (&res->snaplock, NULL);
   res->svc = svc;
   return res;
 }
 
+static void remove_locked (devmap_txn *t, edgex_device *olddev);
+static void snapshot_retired (void *p);
+
 void edgex_devmap_clear (edgex_devmap_t *map)
 {
-  const char *key;
-  const char *next;
-  edgex_map_iter i = edgex_map_iter (map->devices);
-  key = edgex_map_next (&map->devices, &i);
-  while (key)
+  devmap_txn t;
+
+  txn_begin (&t, map, DEVMAP_ALL_SHARDS);
+  for (unsigned s = 0; s < DEVMAP_SHARDS; s++)
+  {
+    devmap_table *tab = atomic_load (&map->shards[s].byid);
+    for (unsigned i = 0; i <= tab->mask; i++)
+    {
+      edgex_device *dev = atomic_load (&tab->slots[i].dev);
+      if (dev && dev != DEVMAP_CLEARED)
+      {
+        remove_locked (&t, dev);
+      }
+    }
+  }
+  txn_commit (&t);
+
+  /* Drop the published snapshot, so that it does not keep the devices */
+
+  pthread_mutex_lock (&map->snaplock);
+  edgex_snapshot *snap = atomic_exchange (&map->snapshot, NULL);
+  pthread_mutex_unlock (&map->snaplock);
+  if (snap)
   {
-    edgex_device **e = edgex_map_get (&map->devices, key);
-    edgex_device_release (*e);
-    next = edgex_map_next (&map->devices, &i);
-    edgex_map_remove (&map->devices, key);
-    key = next;
+    edgex_epoch_retire (snapshot_retired, snap);
   }
 }
 
 void edgex_devmap_free (edgex_devmap_t *map)
 {
   const char *key;
-  edgex_map_deinit (&map->name_to_id);
-  edgex_map_deinit (&map->devices);
+
+  edgex_epoch_barrier ();
+  edgex_devmap_snapshot_release (atomic_load (&map->snapshot));
+  for (unsigned s = 0; s < DEVMAP_SHARDS; s++)
+  {
+    devmap_shard *shard = &map->shards[s];
+    devmap_table *tab = atomic_load (&shard->byid);
+    for (unsigned i = 0; i <= tab->mask; i++)
+    {
+      edgex_device *dev = atomic_load (&tab->slots[i].dev);
+      if (dev && dev != DEVMAP_CLEARED)
+      {
+        edgex_device_release (dev);
+      }
+    }
+    free (tab);
+    free (atomic_load (&shard->byname));
+    cmdindex_free (atomic_load (&shard->getcmds));
+    cmdindex_free (atomic_load (&shard->setcmds));
+    pthread_mutex_destroy (&shard->lock);
+  }
   edgex_map_iter i = edgex_map_iter (map->profiles);
   while ((key = edgex_map_next (&map->profiles, &i)))
   {
@@ -80,58 +661,308 @@ void edgex_devmap_free (edgex_devmap_t *map)
     edgex_deviceprofile_free (*p);
   }
   edgex_map_deinit (&map->profiles);
-  pthread_rwlock_destroy (&map->lock);
+  edgex_deviceprofile_free (map->oldprofiles);
+  proflist_unref (map->proflist);
+  pthread_rwlock_destroy (&map->plock);
+  pthread_mutex_destroy (&map->snaplock);
   free (map);
 }
 
-static void add_locked (edgex_devmap_t *map, const edgex_device *newdev)
+/* Make a packed copy of a device for insertion, sharing a profile already
+ * held. The profile is only copied if it is new to the map, or newer than
+ * the one held.
+ */
+
+static edgex_device *device_copy (edgex_devmap_t *map, const edgex_device *newdev)
 {
-  edgex_device *dup = edgex_device_dup (newdev);
+  edgex_device *dup = edgex_device_dup_packed (newdev);
   atomic_store (&dup->refs, 1);
-  edgex_deviceprofile **pp = edgex_map_get (&map->profiles, dup->profile->name);
-  if (pp)
+  pthread_rwlock_wrlock (&map->plock);
+  edgex_deviceprofile **pp = edgex_map_get (&map->profiles, newdev->profile->name);
+  if (pp && (*pp)->modified >= newdev->profile->modified)
   {
-    edgex_deviceprofile_free (dup->profile);
     dup->profile = *pp;
   }
   else
   {
+    if (pp)
+    {
+      (*pp)->next = map->oldprofiles;
+      map->oldprofiles = *pp;
+    }
+    dup->profile = edgex_deviceprofile_dup (newdev->profile);
     edgex_map_set (&map->profiles, dup->profile->name, dup->profile);
+    proflist_update (map);
   }
-  edgex_map_set (&map->devices, dup->id, dup);
-  edgex_map_set (&map->name_to_id, dup->name, dup->id);
-  edgex_device_autoevent_start (map->svc, dup);
+  pthread_rwlock_unlock (&map->plock);
+  return dup;
+}
+
+/* Insert a device, passing the reference we hold to the map */
+
+static void add_locked (devmap_txn *t, const edgex_device *newdev)
+{
+  edgex_device *dev = device_copy (t->map, newdev);
+  devmap_shard *s = &t->map->shards[shard_of (dev->id)];
+
+  table_insert (&s->byid, dev, NULL);
+  cmdindex_add (s, dev);
+  table_insert (&t->map->shards[shard_of (dev->name)].byname, dev, NULL);
+  pending_add (&t->started, dev);
+}
+
+/* Remove a device and stop its autoevents. The map's reference is dropped
+ * once no reader can be using the device.
+ */
+
+static void remove_locked (devmap_txn *t, edgex_device *olddev)
+{
+  devmap_shard *s = &t->map->shards[shard_of (olddev->id)];
+
+  edgex_device_autoevent_stop (olddev);
+  table_remove (atomic_load (&t->map->shards[shard_of (olddev->name)].byname), olddev);
+  table_remove (atomic_load (&s->byid), olddev);
+  cmdindex_replace (s, olddev, NULL);
+  edgex_epoch_retire (device_retired, olddev);
+}
+
+/* Replace a device with a new one having the same id, and stop those of its
+ * autoevents which have not been transferred to the new device.
+ */
+
+static void replace_locked (devmap_txn *t, edgex_device *olddev, edgex_device *newdev)
+{
+  devmap_shard *s = &t->map->shards[shard_of (olddev->id)];
+
+  edgex_device_autoevent_stop (olddev);
+  table_replace (atomic_load (&s->byid), olddev, newdev);
+  if (strcmp (olddev->name, newdev->name) == 0)
+  {
+    table_replace (atomic_load (&t->map->shards[shard_of (newdev->name)].byname), olddev, newdev);
+  }
+  else
+  {
+    table_insert (&t->map->shards[shard_of (newdev->name)].byname, newdev, NULL);
+    table_remove (atomic_load (&t->map->shards[shard_of (olddev->name)].byname), olddev);
+  }
+  if (olddev->profile == newdev->profile && device_active (olddev) && device_active (newdev))
+  {
+    cmdindex_replace (s, olddev, newdev);
+  }
+  else
+  {
+    cmdindex_replace (s, olddev, NULL);
+    cmdindex_add (s, newdev);
+  }
+  pending_add (&t->started, newdev);
+  edgex_epoch_retire (device_retired, olddev);
 }
 
 void edgex_devmap_populate_devices
   (edgex_devmap_t *map, const edgex_device *devs)
 {
-  pthread_rwlock_wrlock (&map->lock);
+  devmap_txn t;
+  unsigned need = 0;
+
+  for (const edgex_device *d = devs; d; d = d->next)
+  {
+    need |= device_shards (d);
+  }
+  txn_begin (&t, map, need);
   for (const edgex_device *d = devs; d; d = d->next)
   {
-    if (edgex_map_get (&map->name_to_id, d->name) == NULL)
+    if (edgex_devmap_lookup_byname (map, d->name) == NULL && edgex_devmap_lookup_byid (map, d->id) == NULL)
+    {
+      add_locked (&t, d);
+    }
+  }
+  txn_commit (&t);
+}
+
+static int device_cmpname (const void *a, const void *b)
+{
+  return strcmp ((*(edgex_device * const *)a)->name, (*(edgex_device * const *)b)->name);
+}
+
+/* Collect the devices in the map into a snapshot */
+
+static void snapshot_collect (edgex_devmap_t *map, edgex_snapshot *snap, unsigned *size)
+{
+  snap->count = 0;
+  for (unsigned s = 0; s < DEVMAP_SHARDS; s++)
+  {
+    devmap_table *t = atomic_load (&map->shards[s].byid);
+    for (unsigned i = 0; i <= t->mask; i++)
     {
-      add_locked (map, d);
+      edgex_device *dev = atomic_load_explicit (&t->slots[i].dev, memory_order_acquire);
+      if (dev && dev != DEVMAP_CLEARED)
+      {
+        if (snap->count == *size)
+        {
+          *size = *size ? *size * 2 : 64;
+          snap->devices = realloc (snap->devices, *size * sizeof (edgex_device *));
+        }
+        snap->devices[snap->count++] = dev;
+      }
     }
   }
-  pthread_rwlock_unlock (&map->lock);
+  for (unsigned i = 0; i < snap->count; i++)
+  {
+    atomic_fetch_add (&snap->devices[i]->refs, 1);
+  }
+}
+
+/* Build a snapshot of the current state of the map. Collection is retried if
+ * a write overlaps it; if that keeps happening, the shards are locked.
+ */
+
+static edgex_snapshot *snapshot_build (edgex_devmap_t *map)
+{
+  unsigned size = 0;
+  bool done = false;
+  edgex_snapshot *snap = malloc (sizeof (edgex_snapshot));
+  snap->devices = NULL;
+  atomic_init (&snap->refs, 1);
+
+  for (unsigned tries = 0; tries < DEVMAP_SNAPSHOT_TRIES && !done; tries++)
+  {
+    if (tries)
+    {
+      sched_yield ();
+    }
+    snap->gen = atomic_load (&map->published);
+    if (atomic_load (&map->publishing) == 0)
+    {
+      edgex_epoch_enter ();
+      snapshot_collect (map, snap, &size);
+      edgex_epoch_exit ();
+      done = atomic_load (&map->publishing) == 0 && atomic_load (&map->published) == snap->gen;
+      if (!done)
+      {
+        for (unsigned i = 0; i < snap->count; i++)
+        {
+          edgex_device_release (snap->devices[i]);
+        }
+      }
+    }
+  }
+  if (!done)
+  {
+    for (unsigned s = 0; s < DEVMAP_SHARDS; s++)
+    {
+      pthread_mutex_lock (&map->shards[s].lock);
+    }
+    snap->gen = atomic_load (&map->published);
+    snapshot_collect (map, snap, &size);
+    for (unsigned s = DEVMAP_SHARDS; s-- > 0; )
+    {
+      pthread_mutex_unlock (&map->shards[s].lock);
+    }
+  }
+  qsort (snap->devices, snap->count, sizeof (edgex_device *), device_cmpname);
+
+  pthread_rwlock_rdlock (&map->plock);
+  snap->proflist = map->proflist;
+  atomic_fetch_add (&snap->proflist->refs, 1);
+  pthread_rwlock_unlock (&map->plock);
+  return snap;
+}
+
+static void snapshot_retired (void *p)
+{
+  edgex_devmap_snapshot_release ((edgex_snapshot *)p);
+}
+
+/* The published snapshot holds a reference for the map, which is dropped
+ * through the epoch scheme when it is replaced. So a reader in a read section
+ * may always take a reference on the snapshot it finds.
+ */
+
+edgex_snapshot *edgex_devmap_snapshot_acquire (edgex_devmap_t *map)
+{
+  edgex_snapshot *snap;
+  edgex_snapshot *old;
+
+  edgex_epoch_enter ();
+  snap = atomic_load (&map->snapshot);
+  if (snap && snap->gen == atomic_load (&map->published))
+  {
+    atomic_fetch_add (&snap->refs, 1);
+    edgex_epoch_exit ();
+    return snap;
+  }
+  edgex_epoch_exit ();
+
+  pthread_mutex_lock (&map->snaplock);
+  snap = atomic_load (&map->snapshot);
+  if (snap == NULL || snap->gen != atomic_load (&map->published))
+  {
+    old = snap;
+    snap = snapshot_build (map);
+    atomic_store (&map->snapshot, snap);
+    if (old)
+    {
+      edgex_epoch_retire (snapshot_retired, old);
+    }
+  }
+  atomic_fetch_add (&snap->refs, 1);
+  pthread_mutex_unlock (&map->snaplock);
+  return snap;
+}
+
+void edgex_devmap_snapshot_release (edgex_snapshot *snap)
+{
+  if (snap && atomic_fetch_sub (&snap->refs, 1) == 1)
+  {
+    for (unsigned i = 0; i < snap->count; i++)
+    {
+      edgex_device_release (snap->devices[i]);
+    }
+    free (snap->devices);
+    proflist_unref (snap->proflist);
+    free (snap);
+  }
+}
+
+const edgex_device *edgex_devmap_snapshot_next_device
+  (const edgex_snapshot *snap, edgex_snapshot_iter *iter)
+{
+  return (iter->pos < snap->count) ? snap->devices[iter->pos++] : NULL;
+}
+
+const edgex_deviceprofile *edgex_devmap_snapshot_next_profile
+  (const edgex_snapshot *snap, edgex_snapshot_iter *iter)
+{
+  return (iter->pos < snap->proflist->count) ? snap->proflist->profiles[iter->pos++] : NULL;
+}
+
+static int device_findname (const void *key, const void *elem)
+{
+  return strcmp ((const char *)key, (*(edgex_device * const *)elem)->name);
+}
+
+const edgex_device *edgex_devmap_snapshot_device_byname
+  (const edgex_snapshot *snap, const char *name)
+{
+  edgex_device **dev = bsearch (name, snap->devices, snap->count, sizeof (edgex_device *), device_findname);
+  return dev ? *dev : NULL;
 }
 
 edgex_device *edgex_devmap_copydevices (edgex_devmap_t *map)
 {
   edgex_device *result = NULL;
   edgex_device *dup;
-  const char *key;
+  const edgex_device *dev;
+  edgex_snapshot_iter iter = EDGEX_SNAPSHOT_ITER_INIT;
+  edgex_snapshot *snap = edgex_devmap_snapshot_acquire (map);
 
-  pthread_rwlock_rdlock (&map->lock);
-  edgex_map_iter iter = edgex_map_iter (map->devices);
-  while ((key = edgex_map_next (&map->devices, &iter)))
+  while ((dev = edgex_devmap_snapshot_next_device (snap, &iter)))
   {
-    dup = edgex_device_dup (*edgex_map_get (&map->devices, key));
+    dup = edgex_device_dup (dev);
     dup->next = result;
     result = dup;
   }
-  pthread_rwlock_unlock (&map->lock);
+  edgex_devmap_snapshot_release (snap);
   return result;
 }
 
@@ -139,17 +970,17 @@ edgex_deviceprofile *edgex_devmap_copyprofiles (edgex_devmap_t *map)
 {
   edgex_deviceprofile *result = NULL;
   edgex_deviceprofile *dup;
-  const char *key;
+  const edgex_deviceprofile *prof;
+  edgex_snapshot_iter iter = EDGEX_SNAPSHOT_ITER_INIT;
+  edgex_snapshot *snap = edgex_devmap_snapshot_acquire (map);
 
-  pthread_rwlock_rdlock (&map->lock);
-  edgex_map_iter iter = edgex_map_iter (map->profiles);
-  while ((key = edgex_map_next (&map->profiles, &iter)))
+  while ((prof = edgex_devmap_snapshot_next_profile (snap, &iter)))
   {
-    dup = edgex_deviceprofile_dup (*edgex_map_get (&map->profiles, key));
+    dup = edgex_deviceprofile_dup (prof);
     dup->next = result;
     result = dup;
   }
-  pthread_rwlock_unlock (&map->lock);
+  edgex_devmap_snapshot_release (snap);
   return result;
 }
 
@@ -157,182 +988,207 @@ const edgex_deviceprofile *edgex_devmap_profile
   (edgex_devmap_t *map, const char *name)
 {
   edgex_deviceprofile **dpp;
-  pthread_rwlock_rdlock (&map->lock);
+  pthread_rwlock_rdlock (&map->plock);
   dpp = edgex_map_get (&map->profiles, name);
-  pthread_rwlock_unlock (&map->lock);
+  pthread_rwlock_unlock (&map->plock);
   return dpp ? *dpp : NULL;
 }
 
-static void remove_locked (edgex_devmap_t *map, edgex_device *olddev)
-{
-  edgex_map_remove (&map->name_to_id, olddev->name);
-  edgex_map_remove (&map->devices, olddev->id);
-  edgex_device_release (olddev);
-}
-
-/* Update a device, but fail if there could be effects on autoevents or
- * operations in progress. For such attempts we will remove the device and
- * add a new one.
+/* Check whether a device may be updated in place. If so, the new device
+ * takes over those autoevents of the old which are unchanged. Otherwise we
+ * will stop the old device and start a new one. Running autoevents refer to
+ * the device by name and to resources in its profile, so a change to either
+ * (including a new version of the profile) prevents an update in place; so does a change of protocols if the driver
+ * manages autoevents itself, as it was given the old protocols when they
+ * were started. Otherwise, autoevents read the protocols from the map, and
+ * see the new ones once the update is committed.
  */
 
-static bool update_in_place (edgex_device *dest, const edgex_device *src, edgex_devmap_outcome_t *outcome)
+static bool update_compatible (const edgex_devmap_t *map, const edgex_device *olddev, const edgex_device *newdev, edgex_devmap_outcome_t *outcome)
 {
-  if (!devsdk_protocols_equal ((devsdk_protocols *)dest->protocols, (devsdk_protocols *)src->protocols))
+  bool result = true;
+  if (!devsdk_protocols_equal ((devsdk_protocols *)olddev->protocols, (devsdk_protocols *)newdev->protocols))
   {
     *outcome = UPDATED_DRIVER;
-    return false;
+    result = (map->svc->userfns.ae_starter == NULL);
   }
-  if (strcmp (dest->name, src->name))
+  if (strcmp (olddev->name, newdev->name))
   {
     *outcome = UPDATED_DRIVER;
-    return false;
+    result = false;
   }
-  if (dest->adminState != src->adminState)
+  if (olddev->adminState != newdev->adminState)
   {
     *outcome = UPDATED_DRIVER;
-    dest->adminState = src->adminState;
   }
-  if (strcmp (dest->profile->name, src->profile->name))
+  if (olddev->profile != newdev->profile)
   {
-    return false;
+    result = false;
   }
-  if (!edgex_device_autoevents_equal (dest->autos, src->autos))
+  return result;
+}
+
+/* Move the running autoevents of a device to its replacement, where the
+ * resource, frequency and onChange setting are unchanged. The autoevent
+ * keeps its schedule and its last reading.
+ */
+
+static void autoevents_transfer (edgex_device_autoevents *from, edgex_device_autoevents *to)
+{
+  for (; to; to = to->next)
   {
-    return false;
+    for (edgex_device_autoevents *ae = from; ae; ae = ae->next)
+    {
+      if (ae->impl && ae->onChange == to->onChange && strcmp (ae->resource, to->resource) == 0 && strcmp (ae->frequency, to->frequency) == 0)
+      {
+        to->impl = ae->impl;
+        ae->impl = NULL;
+        break;
+      }
+    }
   }
-  dest->operatingState = src->operatingState;
-  dest->created = src->created;
-  dest->lastConnected = src->lastConnected;
-  dest->lastReported = src->lastReported;
-  dest->modified = src->modified;
-  dest->origin = src->origin;
-  free (dest->description);
-  dest->description = strdup (src->description);
-  edgex_strings_free (dest->labels);
-  dest->labels = edgex_strings_dup (src->labels);
-
-  return true;
 }
 
 edgex_devmap_outcome_t edgex_devmap_replace_device (edgex_devmap_t *map, const edgex_device *dev)
 {
-  edgex_device **olddev;
+  edgex_device *olddev;
   edgex_devmap_outcome_t result = UPDATED_SDK;
+  devmap_txn t;
 
-  pthread_rwlock_wrlock (&map->lock);
-  olddev = edgex_map_get (&map->devices, dev->id);
+  olddev = txn_begin_device (&t, map, edgex_devmap_lookup_byid, dev->id, dev);
   if (olddev == NULL)
   {
-    add_locked (map, dev);
+    add_locked (&t, dev);
     result = CREATED;
   }
   else
   {
-    if (!update_in_place (*olddev, dev, &result))
+    edgex_device *newdev = device_copy (map, dev);
+    if (update_compatible (map, olddev, newdev, &result))
     {
-      remove_locked (map, *olddev);
-      add_locked (map, dev);
+      autoevents_transfer (olddev->autos, newdev->autos);
     }
+    replace_locked (&t, olddev, newdev);
   }
-  pthread_rwlock_unlock (&map->lock);
+  txn_commit (&t);
   return result;
 }
 
 edgex_device *edgex_devmap_device_byid (edgex_devmap_t *map, const char *id)
 {
-  edgex_device **dev;
-  edgex_device *result = NULL;
+  edgex_device *result;
 
-  pthread_rwlock_rdlock (&map->lock);
-  dev = edgex_map_get (&map->devices, id);
-  if (dev)
+  edgex_epoch_enter ();
+  result = (edgex_device *)edgex_devmap_lookup_byid (map, id);
+  if (result)
   {
-    result = *dev;
     atomic_fetch_add (&result->refs, 1);
   }
-  pthread_rwlock_unlock (&map->lock);
+  edgex_epoch_exit ();
   return result;
 }
 
 edgex_device *edgex_devmap_device_byname (edgex_devmap_t *map, const char *name)
 {
-  char **id;
-  edgex_device *result = NULL;
+  edgex_device *result;
 
-  pthread_rwlock_rdlock (&map->lock);
-  id = edgex_map_get (&map->name_to_id, name);
-  if (id)
+  edgex_epoch_enter ();
+  result = (edgex_device *)edgex_devmap_lookup_byname (map, name);
+  if (result)
   {
-    result = *edgex_map_get (&map->devices, *id);
     atomic_fetch_add (&result->refs, 1);
   }
-  pthread_rwlock_unlock (&map->lock);
+  edgex_epoch_exit ();
   return result;
 }
 
-void edgex_devmap_removedevice_byname (edgex_devmap_t *map, const char *name)
+void edgex_devmap_read_begin (edgex_devmap_t *map)
 {
-  edgex_device **olddev;
-  char **id;
+  edgex_epoch_enter ();
+}
 
-  pthread_rwlock_wrlock (&map->lock);
-  id = edgex_map_get (&map->name_to_id, name);
-  if (id)
-  {
-    olddev = edgex_map_get (&map->devices, *id);
-    remove_locked (map, *olddev);
-  }
-  pthread_rwlock_unlock (&map->lock);
+void edgex_devmap_read_end (edgex_devmap_t *map)
+{
+  edgex_epoch_exit ();
 }
 
-void edgex_devmap_removedevice_byid (edgex_devmap_t *map, const char *id)
+const edgex_device *edgex_devmap_lookup_byid
+  (edgex_devmap_t *map, const char *id)
+{
+  return table_find (atomic_load (&map->shards[shard_of (id)].byid), id);
+}
+
+const edgex_device *edgex_devmap_lookup_byname
+  (edgex_devmap_t *map, const char *name)
+{
+  return table_find (atomic_load (&map->shards[shard_of (name)].byname), name);
+}
+
+static void remove_common
+(
+  edgex_devmap_t *map,
+  const edgex_device *(*lookup) (edgex_devmap_t *, const char *),
+  const char *key
+)
 {
-  edgex_device **olddev;
-  pthread_rwlock_wrlock (&map->lock);
-  olddev = edgex_map_get (&map->devices, id);
+  devmap_txn t;
+  edgex_device *olddev = txn_begin_device (&t, map, lookup, key, NULL);
   if (olddev)
   {
-    remove_locked (map, *olddev);
+    remove_locked (&t, olddev);
   }
-  pthread_rwlock_unlock (&map->lock);
+  txn_commit (&t);
+}
+
+void edgex_devmap_removedevice_byname (edgex_devmap_t *map, const char *name)
+{
+  remove_common (map, edgex_devmap_lookup_byname, name);
+}
+
+void edgex_devmap_removedevice_byid (edgex_devmap_t *map, const char *id)
+{
+  remove_common (map, edgex_devmap_lookup_byid, id);
 }
 
 void edgex_devmap_add_profile (edgex_devmap_t *map, edgex_deviceprofile *dp)
 {
-  pthread_rwlock_wrlock (&map->lock);
+  pthread_rwlock_wrlock (&map->plock);
   edgex_map_set (&map->profiles, dp->name, dp);
-  pthread_rwlock_unlock (&map->lock);
+  proflist_update (map);
+  pthread_rwlock_unlock (&map->plock);
+  atomic_fetch_add (&map->published, 1);
 }
 
 edgex_cmdqueue_t *edgex_devmap_device_forcmd
   (edgex_devmap_t *map, const char *cmd, bool forGet)
 {
-  edgex_device *dev;
-  const char *key;
-  const struct edgex_cmdinfo *command;
   edgex_cmdqueue_t *result = NULL;
   edgex_cmdqueue_t *q;
 
-  pthread_rwlock_rdlock (&map->lock);
-  edgex_map_iter iter = edgex_map_iter (map->devices);
-  while ((key = edgex_map_next (&map->devices, &iter)))
+  edgex_epoch_enter ();
+  for (unsigned s = 0; s < DEVMAP_SHARDS; s++)
   {
-    dev = *edgex_map_get (&map->devices, key);
-    if (dev->operatingState == ENABLED && dev->adminState == UNLOCKED)
+    devmap_shard *shard = &map->shards[s];
+    devmap_cmdslot *slot = cmdindex_find (atomic_load (forGet ? &shard->getcmds : &shard->setcmds), cmd);
+    devmap_table *t = slot ? atomic_load (&slot->devs) : NULL;
+    if (t)
     {
-      command = edgex_deviceprofile_findcommand (cmd, dev->profile, forGet);
-      if (command)
+      for (unsigned i = 0; i <= t->mask; i++)
       {
-        q = malloc (sizeof (edgex_cmdqueue_t));
-        q->dev = dev;
-        q->cmd = command;
-        q->next = result;
-        result = q;
-        atomic_fetch_add (&dev->refs, 1);
+        edgex_device *dev = atomic_load_explicit (&t->slots[i].dev, memory_order_acquire);
+        if (dev && dev != DEVMAP_CLEARED)
+        {
+          q = malloc (sizeof (edgex_cmdqueue_t));
+          q->dev = dev;
+          q->cmd = t->slots[i].cmd;
+          q->next = result;
+          result = q;
+          atomic_fetch_add (&dev->refs, 1);
+        }
       }
     }
   }
-  pthread_rwlock_unlock (&map->lock);
+  edgex_epoch_exit ();
   return result;
 }
 
@@ -341,7 +1197,6 @@ void edgex_device_release (edgex_device *dev)
   if (atomic_fetch_add (&dev->refs, -1) == 1)
   {
     edgex_device_autoevent_stop (dev);
-    dev->profile = NULL;
-    edgex_device_free (dev);
+    edgex_device_free_packed (dev);
   }
 }
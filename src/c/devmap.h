@@ -13,6 +13,7 @@
 
 #include "devsdk/devsdk.h"
 #include "edgex/edgex.h"
+#include "edgex/devices.h"
 
 struct edgex_devmap_t;
 typedef struct edgex_devmap_t edgex_devmap_t;
@@ -48,7 +49,9 @@ extern void edgex_devmap_clear (edgex_devmap_t *map);
 extern void edgex_devmap_free (edgex_devmap_t *map);
 
 /*
- * These functions copy devices and profiles in and out.
+ * These functions copy devices and profiles in and out. populate_devices
+ * adds a list of devices in one operation, skipping any already present; it
+ * should be preferred to repeated calls to replace_device for bulk additions.
  */
 
 extern void edgex_devmap_populate_devices
@@ -58,6 +61,20 @@ extern edgex_deviceprofile *edgex_devmap_copyprofiles (edgex_devmap_t *map);
 extern edgex_devmap_outcome_t edgex_devmap_replace_device
   (edgex_devmap_t *map, const edgex_device *dev);
 
+/*
+ * Snapshots (see edgex/devices.h). The copy functions above are built on
+ * these.
+ */
+
+extern edgex_snapshot *edgex_devmap_snapshot_acquire (edgex_devmap_t *map);
+extern void edgex_devmap_snapshot_release (edgex_snapshot *snap);
+extern const edgex_device *edgex_devmap_snapshot_next_device
+  (const edgex_snapshot *snap, edgex_snapshot_iter *iter);
+extern const edgex_deviceprofile *edgex_devmap_snapshot_next_profile
+  (const edgex_snapshot *snap, edgex_snapshot_iter *iter);
+extern const edgex_device *edgex_devmap_snapshot_device_byname
+  (const edgex_snapshot *snap, const char *name);
+
 /*
  * These functions return pointers to the devices held in the implementation.
  * They must be released after use by calling edgex_device_release().
@@ -70,6 +87,20 @@ extern edgex_device *edgex_devmap_device_byname
 extern edgex_cmdqueue_t *edgex_devmap_device_forcmd
   (edgex_devmap_t *map, const char *cmd, bool forGet);
 
+/*
+ * Lock-free lookups for short operations. These return pointers which remain
+ * valid only until the matching edgex_devmap_read_end(), and which need not
+ * be released. Other devmap functions that modify the map must not be
+ * called between edgex_devmap_read_begin() and edgex_devmap_read_end().
+ */
+
+extern void edgex_devmap_read_begin (edgex_devmap_t *map);
+extern void edgex_devmap_read_end (edgex_devmap_t *map);
+extern const edgex_device *edgex_devmap_lookup_byid
+  (edgex_devmap_t *map, const char *id);
+extern const edgex_device *edgex_devmap_lookup_byname
+  (edgex_devmap_t *map, const char *name);
+
 /*
  * Release function. The device is freed when its reference count hits zero.
  */
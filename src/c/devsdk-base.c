@@ -185,6 +185,40 @@ void devsdk_protocols_free (devsdk_protocols *e)
   }
 }
 
+static void commandresult_clear (devsdk_commandresult *res)
+{
+  iot_data_free (res->value);
+  res->value = NULL;
+}
+
+void devsdk_commandresult_set_int (devsdk_commandresult *res, int64_t val)
+{
+  commandresult_clear (res);
+  res->scalar.kind = DEVSDK_SCALAR_INT;
+  res->scalar.v.i = val;
+}
+
+void devsdk_commandresult_set_uint (devsdk_commandresult *res, uint64_t val)
+{
+  commandresult_clear (res);
+  res->scalar.kind = DEVSDK_SCALAR_UINT;
+  res->scalar.v.ui = val;
+}
+
+void devsdk_commandresult_set_float (devsdk_commandresult *res, double val)
+{
+  commandresult_clear (res);
+  res->scalar.kind = DEVSDK_SCALAR_FLOAT;
+  res->scalar.v.f = val;
+}
+
+void devsdk_commandresult_set_bool (devsdk_commandresult *res, bool val)
+{
+  commandresult_clear (res);
+  res->scalar.kind = DEVSDK_SCALAR_BOOL;
+  res->scalar.v.b = val;
+}
+
 /* Macro for generating single-linked-list comparison functions.
  * Assumes a "next" pointer and that the key (name) field is a string.
  */
@@ -230,3 +264,47 @@ static bool autoevent_equal (const edgex_device_autoevents *e1, const edgex_devi
 }
 
 LIST_EQUAL_FUNCTION(edgex_device_autoevents, resource, autoevent_equal)
+
+struct sfxstruct
+{
+  const char *str;
+  double factor;
+};
+
+static struct sfxstruct suffixes[] =
+{
+  { "us", 1.0 }, { "ms", 1e3 }, { "s", 1e6 }, { "m", 6e7 }, { "h", 3.6e9 },
+  { NULL, 0 }
+};
+
+/* Durations are converted to nanoseconds by callers, so are limited to
+ * UINT64_MAX / 1000 microseconds. The range check is made on the double
+ * before conversion, as converting an out-of-range value is undefined.
+ */
+
+#define DURATION_MAX (UINT64_MAX / 1000)
+
+uint64_t edgex_parse_duration (const char *spec)
+{
+  char *fend;
+  double fnum = strtod (spec, &fend);
+  if (fend == spec || !(fnum > 0.0))
+  {
+    return 0;
+  }
+  for (int i = 0; suffixes[i].str; i++)
+  {
+    if (strcmp (fend, suffixes[i].str) == 0)
+    {
+      double us = fnum * suffixes[i].factor + 0.5;
+      uint64_t result;
+      if (!(us < (double) DURATION_MAX))
+      {
+        return 0;
+      }
+      result = (uint64_t) us;
+      return (result <= DURATION_MAX) ? result : 0;
+    }
+  }
+  return 0;
+}
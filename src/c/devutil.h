@@ -16,5 +16,12 @@ extern bool devsdk_protocols_equal (const devsdk_protocols *p1, const devsdk_pro
 
 extern bool edgex_device_autoevents_equal (const edgex_device_autoevents *e1, const edgex_device_autoevents *e2);
 
+/* Parse a duration such as "250us", "1.5s" or "10m". Returns the duration in
+ * microseconds, or zero if it is invalid or exceeds UINT64_MAX / 1000 (so
+ * that it may be converted to nanoseconds).
+ */
+
+extern uint64_t edgex_parse_duration (const char *spec);
+
 #endif
 
@@ -61,7 +61,7 @@ int edgex_device_handler_discovery
 
   if (pthread_mutex_trylock (&svc->discolock) == 0)
   {
-    iot_threadpool_add_work (svc->thpool, edgex_device_handler_do_discovery, svc, -1);
+    edgex_workpool_add (svc->pools[EDGEX_WORK_DISCOVERY], edgex_device_handler_do_discovery, svc);
     pthread_mutex_unlock (&svc->discolock);
   }
   // else discovery was already running; ignore this request
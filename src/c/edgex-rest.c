@@ -9,7 +9,10 @@
 #include "edgex-rest.h"
 #include "cmdinfo.h"
 #include "autoevent.h"
+#include "intern.h"
+#include "map.h"
 #include "parson.h"
+#include "errorlist.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -26,6 +29,14 @@ static char *get_string (const JSON_Object *obj, const char *name)
   return strdup (str ? str : "");
 }
 
+/* Names which identify devices, profiles and their components are interned */
+
+static char *get_name (const JSON_Object *obj, const char *name)
+{
+  const char *str = json_object_get_string (obj, name);
+  return edgex_intern (str ? str : "");
+}
+
 static char *get_array_string (const JSON_Array *array, size_t index)
 {
   const char *str = json_array_get_string (array, index);
@@ -505,7 +516,7 @@ static edgex_deviceresource *deviceresource_read
   edgex_deviceresource *result = NULL;
   edgex_profileproperty *pp = profileproperty_read
     (lc, json_object_get_object (obj, "properties"));
-  char *name = get_string (obj, "name");
+  char *name = get_name (obj, "name");
 
   if (pp)
   {
@@ -523,6 +534,7 @@ static edgex_deviceresource *deviceresource_read
   else
   {
     iot_log_error (lc, "Error reading property for deviceResource %s", name);
+    edgex_intern_release (name);
   }
   return result;
 }
@@ -546,7 +558,7 @@ static edgex_deviceresource *edgex_deviceresource_dup (const edgex_deviceresourc
   if (e)
   {
     result = malloc (sizeof (edgex_deviceresource));
-    result->name = strdup (e->name);
+    result->name = edgex_intern_dup (e->name);
     result->description = strdup (e->description);
     result->tag = strdup (e->tag);
     result->properties = profileproperty_dup (e->properties);
@@ -561,7 +573,7 @@ static void deviceresource_free (edgex_deviceresource *e)
   while (e)
   {
     edgex_deviceresource *current = e;
-    free (e->name);
+    edgex_intern_release (e->name);
     free (e->description);
     free (e->tag);
     profileproperty_free (e->properties);
@@ -579,7 +591,7 @@ static edgex_resourceoperation *resourceoperation_read (const JSON_Object *obj)
   result->index = get_string (obj, "index");
   result->operation = get_string (obj, "operation");
   result->object = get_string (obj, "object");
-  result->deviceResource = get_string (obj, "deviceResource");
+  result->deviceResource = get_name (obj, "deviceResource");
   result->property = get_string (obj, "property");
   result->parameter = get_string (obj, "parameter");
   result->resource = get_string (obj, "resource");
@@ -591,8 +603,8 @@ static edgex_resourceoperation *resourceoperation_read (const JSON_Object *obj)
   result->next = NULL;
   if (strlen (result->deviceResource) == 0 && strlen (result->object) != 0)
   {
-    free (result->deviceResource);
-    result->deviceResource = strdup (result->object);
+    edgex_intern_release (result->deviceResource);
+    result->deviceResource = edgex_intern (result->object);
   }
   if (strlen (result->deviceCommand) == 0 && strlen (result->resource) != 0)
   {
@@ -630,7 +642,7 @@ static edgex_resourceoperation *resourceoperation_dup
     result->index = strdup (ro->index);
     result->operation = strdup (ro->operation);
     result->object = strdup (ro->object);
-    result->deviceResource = strdup (ro->deviceResource);
+    result->deviceResource = edgex_intern_dup (ro->deviceResource);
     result->property = strdup (ro->property);
     result->parameter = strdup (ro->parameter);
     result->resource = strdup (ro->resource);
@@ -650,7 +662,7 @@ static void resourceoperation_free (edgex_resourceoperation *e)
     free (e->index);
     free (e->operation);
     free (e->object);
-    free (e->deviceResource);
+    edgex_intern_release (e->deviceResource);
     free (e->property);
     free (e->parameter);
     free (e->resource);
@@ -670,7 +682,7 @@ static edgex_devicecommand *devicecommand_read (const JSON_Object *obj)
   edgex_resourceoperation **last_ptr = &result->set;
   edgex_resourceoperation **last_ptr2 = &result->get;
 
-  result->name = get_string (obj, "name");
+  result->name = get_name (obj, "name");
   array = json_object_get_array (obj, "set");
   result->set = NULL;
   count = json_array_get_count (array);
@@ -727,7 +739,7 @@ static edgex_devicecommand *devicecommand_dup (const edgex_devicecommand *pr)
   if (pr)
   {
     result = malloc (sizeof (edgex_devicecommand));
-    result->name = strdup (pr->name);
+    result->name = edgex_intern_dup (pr->name);
     result->set = resourceoperation_dup (pr->set);
     result->get = resourceoperation_dup (pr->get);
     result->next = devicecommand_dup (pr->next);
@@ -740,7 +752,7 @@ static void devicecommand_free (edgex_devicecommand *e)
   while (e)
   {
     edgex_devicecommand *current = e;
-    free (e->name);
+    edgex_intern_release (e->name);
     resourceoperation_free (e->set);
     resourceoperation_free (e->get);
     e = e->next;
@@ -755,7 +767,7 @@ static bool resourceop_validate (iot_logger_t *lc, edgex_resourceoperation *ro,
     edgex_deviceresource *res = reslist;
     while (res)
     {
-      if (strcmp (ro->deviceResource, res->name) == 0)
+      if (ro->deviceResource == res->name)
       {
         break;
       }
@@ -781,7 +793,7 @@ static edgex_deviceprofile *deviceprofile_read
   edgex_devicecommand **last_ptr2 = &result->device_commands;
 
   result->id = get_string (obj, "id");
-  result->name = get_string (obj, "name");
+  result->name = get_name (obj, "name");
   result->description = get_string (obj, "description");
   result->created = json_object_get_uint (obj, "created");
   result->modified = json_object_get_uint (obj, "modified");
@@ -1222,7 +1234,7 @@ edgex_deviceprofile *edgex_deviceprofile_dup (const edgex_deviceprofile *src)
   {
     dest = calloc (1, sizeof (edgex_deviceprofile));
     dest->id = strdup (src->id);
-    dest->name = strdup (src->name);
+    dest->name = edgex_intern_dup (src->name);
     dest->description = strdup (src->description);
     dest->created = src->created;
     dest->modified = src->modified;
@@ -1242,7 +1254,7 @@ void edgex_deviceprofile_free (edgex_deviceprofile *e)
   {
     edgex_deviceprofile *next = e->next;
     free (e->id);
-    free (e->name);
+    edgex_intern_release (e->name);
     free (e->description);
     free (e->manufacturer);
     free (e->model);
@@ -1284,15 +1296,40 @@ char *edgex_deviceservice_write (const edgex_deviceservice *e, bool create)
   return result;
 }
 
+typedef edgex_map(edgex_deviceprofile *) edgex_map_profile;
+
+/* Read a device. If a profile cache is given, the device's profile is taken
+ * from it where present, and added to it otherwise; the cache retains
+ * ownership of the profile.
+ */
+
 static edgex_device *device_read
-  (iot_logger_t *lc, const JSON_Object *obj)
+  (iot_logger_t *lc, const JSON_Object *obj, edgex_map_profile *cache)
 {
-  char *name = get_string (obj, "name");
-  edgex_deviceprofile *prof = deviceprofile_read (lc, json_object_get_object (obj, "profile"));
+  char *name = get_name (obj, "name");
+  edgex_deviceprofile *prof = NULL;
+  const JSON_Object *pobj = json_object_get_object (obj, "profile");
+  if (cache)
+  {
+    const char *pname = json_object_get_string (pobj, "name");
+    edgex_deviceprofile **pp = pname ? edgex_map_get (cache, pname) : NULL;
+    if (pp)
+    {
+      prof = *pp;
+    }
+  }
+  if (prof == NULL)
+  {
+    prof = deviceprofile_read (lc, pobj);
+    if (prof && cache)
+    {
+      edgex_map_set (cache, prof->name, prof);
+    }
+  }
   if (prof == NULL)
   {
     iot_log_error (lc, "Device %s has an invalid profile: will not be processed", name);
-    free (name);
+    edgex_intern_release (name);
     return NULL;
   }
 
@@ -1305,7 +1342,7 @@ static edgex_device *device_read
     (json_object_get_string (obj, "adminState"));
   result->created = json_object_get_uint (obj, "created");
   result->description = get_string (obj, "description");
-  result->id = get_string (obj, "id");
+  result->id = get_name (obj, "id");
   result->labels = array_to_strings (json_object_get_array (obj, "labels"));
   result->lastConnected = json_object_get_uint (obj, "lastConnected");
   result->lastReported = json_object_get_uint (obj, "lastReported");
@@ -1364,7 +1401,7 @@ static JSON_Value *device_write (const edgex_device *e, bool create)
   json_object_set_value
     (obj, "protocols", protocols_write (e->protocols));
   json_object_set_value
-    (obj, "autoevents", autoevents_write (e->autos));
+    (obj, "autoEvents", autoevents_write (e->autos));
   json_object_set_string
     (obj, "adminState", edgex_adminstate_tostring (e->adminState));
   json_object_set_string (obj, "name", e->name);
@@ -1380,8 +1417,8 @@ static JSON_Value *device_write (const edgex_device *e, bool create)
 edgex_device *edgex_device_dup (const edgex_device *e)
 {
   edgex_device *result = malloc (sizeof (edgex_device));
-  result->name = strdup (e->name);
-  result->id = strdup (e->id);
+  result->name = edgex_intern_dup (e->name);
+  result->id = edgex_intern_dup (e->id);
   result->description = strdup (e->description);
   result->labels = edgex_strings_dup (e->labels);
   result->protocols = edgex_protocols_dup (e->protocols);
@@ -1407,9 +1444,9 @@ void edgex_device_free (edgex_device *e)
     edgex_protocols_free (e->protocols);
     edgex_device_autoevents_free (e->autos);
     free (e->description);
-    free (e->id);
+    edgex_intern_release (e->id);
     edgex_strings_free (e->labels);
-    free (e->name);
+    edgex_intern_release (e->name);
     if (e->profile)
     {
       edgex_deviceprofile_free (e->profile);
@@ -1420,6 +1457,244 @@ void edgex_device_free (edgex_device *e)
   }
 }
 
+/* Packed copies of devices. A device and the structures it owns are held in
+ * a single allocation: the size is computed first, then each part is placed
+ * in turn. The profile is not copied, and the name and id remain interned.
+ */
+
+#define PACK_ALIGN sizeof (uint64_t)
+#define PACK_ROUND(n) (((n) + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1))
+
+typedef struct pack_arena
+{
+  char *next;
+} pack_arena;
+
+static void *pack_alloc (pack_arena *a, size_t size)
+{
+  void *result = a->next;
+  a->next += PACK_ROUND (size);
+  return result;
+}
+
+static char *pack_str (pack_arena *a, const char *str)
+{
+  char *result = NULL;
+  if (str)
+  {
+    size_t len = strlen (str) + 1;
+    result = pack_alloc (a, len);
+    memcpy (result, str, len);
+  }
+  return result;
+}
+
+static size_t str_packsize (const char *str)
+{
+  return str ? PACK_ROUND (strlen (str) + 1) : 0;
+}
+
+static size_t strings_packsize (const edgex_strings *s)
+{
+  size_t result = 0;
+  for (; s; s = s->next)
+  {
+    result += PACK_ROUND (sizeof (edgex_strings)) + str_packsize (s->str);
+  }
+  return result;
+}
+
+static edgex_strings *strings_pack (pack_arena *a, const edgex_strings *s)
+{
+  edgex_strings *result = NULL;
+  edgex_strings **last = &result;
+  for (; s; s = s->next)
+  {
+    edgex_strings *copy = pack_alloc (a, sizeof (edgex_strings));
+    copy->str = pack_str (a, s->str);
+    copy->next = NULL;
+    *last = copy;
+    last = &(copy->next);
+  }
+  return result;
+}
+
+static size_t nvpairs_packsize (const edgex_nvpairs *p)
+{
+  size_t result = 0;
+  for (; p; p = p->next)
+  {
+    result += PACK_ROUND (sizeof (edgex_nvpairs)) + str_packsize (p->name) + str_packsize (p->value);
+  }
+  return result;
+}
+
+static edgex_nvpairs *nvpairs_pack (pack_arena *a, const edgex_nvpairs *p)
+{
+  edgex_nvpairs *result = NULL;
+  edgex_nvpairs **last = &result;
+  for (; p; p = p->next)
+  {
+    edgex_nvpairs *copy = pack_alloc (a, sizeof (edgex_nvpairs));
+    copy->name = pack_str (a, p->name);
+    copy->value = pack_str (a, p->value);
+    copy->next = NULL;
+    *last = copy;
+    last = &(copy->next);
+  }
+  return result;
+}
+
+static size_t protocols_packsize (const edgex_protocols *p)
+{
+  size_t result = 0;
+  for (; p; p = p->next)
+  {
+    result += PACK_ROUND (sizeof (edgex_protocols)) + str_packsize (p->name) + nvpairs_packsize (p->properties);
+  }
+  return result;
+}
+
+static edgex_protocols *protocols_pack (pack_arena *a, const edgex_protocols *p)
+{
+  edgex_protocols *result = NULL;
+  edgex_protocols **last = &result;
+  for (; p; p = p->next)
+  {
+    edgex_protocols *copy = pack_alloc (a, sizeof (edgex_protocols));
+    copy->name = pack_str (a, p->name);
+    copy->properties = nvpairs_pack (a, p->properties);
+    copy->next = NULL;
+    *last = copy;
+    last = &(copy->next);
+  }
+  return result;
+}
+
+static size_t autoevents_packsize (const edgex_device_autoevents *e)
+{
+  size_t result = 0;
+  for (; e; e = e->next)
+  {
+    result += PACK_ROUND (sizeof (edgex_device_autoevents)) + str_packsize (e->resource) + str_packsize (e->frequency);
+  }
+  return result;
+}
+
+static edgex_device_autoevents *autoevents_pack (pack_arena *a, const edgex_device_autoevents *e)
+{
+  edgex_device_autoevents *result = NULL;
+  edgex_device_autoevents **last = &result;
+  for (; e; e = e->next)
+  {
+    edgex_device_autoevents *copy = pack_alloc (a, sizeof (edgex_device_autoevents));
+    copy->resource = pack_str (a, e->resource);
+    copy->frequency = pack_str (a, e->frequency);
+    copy->onChange = e->onChange;
+    copy->impl = NULL;
+    copy->next = NULL;
+    *last = copy;
+    last = &(copy->next);
+  }
+  return result;
+}
+
+static size_t addressable_packsize (const edgex_addressable *e)
+{
+  size_t result = 0;
+  if (e)
+  {
+    result = PACK_ROUND (sizeof (edgex_addressable)) +
+      str_packsize (e->name) + str_packsize (e->id) + str_packsize (e->address) +
+      str_packsize (e->method) + str_packsize (e->path) + str_packsize (e->protocol) +
+      str_packsize (e->user) + str_packsize (e->password) + str_packsize (e->topic) +
+      str_packsize (e->publisher);
+  }
+  return result;
+}
+
+static edgex_addressable *addressable_pack (pack_arena *a, const edgex_addressable *e)
+{
+  edgex_addressable *result = NULL;
+  if (e)
+  {
+    result = pack_alloc (a, sizeof (edgex_addressable));
+    *result = *e;
+    result->name = pack_str (a, e->name);
+    result->id = pack_str (a, e->id);
+    result->address = pack_str (a, e->address);
+    result->method = pack_str (a, e->method);
+    result->path = pack_str (a, e->path);
+    result->protocol = pack_str (a, e->protocol);
+    result->user = pack_str (a, e->user);
+    result->password = pack_str (a, e->password);
+    result->topic = pack_str (a, e->topic);
+    result->publisher = pack_str (a, e->publisher);
+  }
+  return result;
+}
+
+static size_t deviceservice_packsize (const edgex_deviceservice *e)
+{
+  size_t result = 0;
+  if (e)
+  {
+    result = PACK_ROUND (sizeof (edgex_deviceservice)) +
+      str_packsize (e->name) + str_packsize (e->id) + str_packsize (e->description) +
+      strings_packsize (e->labels) + addressable_packsize (e->addressable);
+  }
+  return result;
+}
+
+static edgex_deviceservice *deviceservice_pack (pack_arena *a, const edgex_deviceservice *e)
+{
+  edgex_deviceservice *result = NULL;
+  if (e)
+  {
+    result = pack_alloc (a, sizeof (edgex_deviceservice));
+    *result = *e;
+    result->name = pack_str (a, e->name);
+    result->id = pack_str (a, e->id);
+    result->description = pack_str (a, e->description);
+    result->labels = strings_pack (a, e->labels);
+    result->addressable = addressable_pack (a, e->addressable);
+  }
+  return result;
+}
+
+edgex_device *edgex_device_dup_packed (const edgex_device *e)
+{
+  pack_arena a;
+  edgex_device *result;
+  size_t size = PACK_ROUND (sizeof (edgex_device)) +
+    str_packsize (e->description) + strings_packsize (e->labels) +
+    protocols_packsize (e->protocols) + autoevents_packsize (e->autos) +
+    deviceservice_packsize (e->service);
+
+  a.next = malloc (size);
+  result = pack_alloc (&a, sizeof (edgex_device));
+  *result = *e;
+  result->name = edgex_intern_dup (e->name);
+  result->id = edgex_intern_dup (e->id);
+  result->description = pack_str (&a, e->description);
+  result->labels = strings_pack (&a, e->labels);
+  result->protocols = protocols_pack (&a, e->protocols);
+  result->autos = autoevents_pack (&a, e->autos);
+  result->service = deviceservice_pack (&a, e->service);
+  result->next = NULL;
+  return result;
+}
+
+void edgex_device_free_packed (edgex_device *e)
+{
+  if (e)
+  {
+    edgex_intern_release (e->id);
+    edgex_intern_release (e->name);
+    free (e);
+  }
+}
+
 edgex_device *edgex_device_read (iot_logger_t *lc, const char *json)
 {
   edgex_device *result = NULL;
@@ -1430,7 +1705,7 @@ edgex_device *edgex_device_read (iot_logger_t *lc, const char *json)
 
   if (obj)
   {
-    result = device_read (lc, obj);
+    result = device_read (lc, obj, NULL);
   }
 
   json_value_free (val);
@@ -1449,6 +1724,25 @@ char *edgex_device_write (const edgex_device *e, bool create)
   return result;
 }
 
+/* Write a device for the cache file. If withprofile is false, the profile is
+ * identified by name only.
+ */
+
+char *edgex_device_write_cache (const edgex_device *e, bool withprofile)
+{
+  char *result;
+  JSON_Value *val = device_write (e, false);
+
+  if (!withprofile)
+  {
+    json_object_set_value
+      (json_value_get_object (val), "profile", deviceprofile_write_name (e->profile));
+  }
+  result = json_serialize_to_string (val);
+  json_value_free (val);
+  return result;
+}
+
 char *edgex_device_write_sparse
 (
   const char * name,
@@ -1482,29 +1776,187 @@ char *edgex_device_write_sparse
   return json;
 }
 
-edgex_device *edgex_devices_read (iot_logger_t *lc, const char *json)
+/* Incremental reader for an array of devices. Each element of the array is
+ * extracted from the input as it arrives and parsed on its own, so that the
+ * whole document is never held in memory. Profiles are parsed once for each
+ * distinct name.
+ */
+
+struct edgex_devices_parser
+{
+  iot_logger_t *lc;
+  edgex_devices_cb fn;
+  void *ctx;
+  unsigned batchsize;
+  unsigned pending;
+  unsigned count;
+  edgex_device *batch;
+  edgex_device **last;
+  edgex_map_profile profiles;
+  char *elem;
+  size_t elen;
+  size_t esize;
+  unsigned depth;
+  bool instring;
+  bool escape;
+  bool failed;
+};
+
+edgex_devices_parser *edgex_devices_parser_alloc
+  (iot_logger_t *lc, unsigned batchsize, edgex_devices_cb fn, void *ctx)
 {
-  edgex_device *result = NULL;
-  JSON_Value *val = json_parse_string (json);
-  JSON_Array *array = json_value_get_array (val);
-  edgex_device **last_ptr = &result;
+  edgex_devices_parser *p = calloc (1, sizeof (edgex_devices_parser));
+  p->lc = lc;
+  p->fn = fn;
+  p->ctx = ctx;
+  p->batchsize = batchsize ? batchsize : 1;
+  p->last = &p->batch;
+  edgex_map_init (&p->profiles);
+  return p;
+}
 
-  if (array)
+static void devices_parser_flush (edgex_devices_parser *p)
+{
+  if (p->batch)
   {
-    size_t count = json_array_get_count (array);
-    for (size_t i = 0; i < count; i++)
+    p->fn (p->ctx, p->batch);
+    for (edgex_device *d = p->batch; d; d = d->next)
     {
-      edgex_device *temp = device_read (lc, json_array_get_object (array, i));
-      if (temp)
+      d->profile = NULL;
+    }
+    edgex_device_free (p->batch);
+    p->batch = NULL;
+    p->last = &p->batch;
+    p->pending = 0;
+  }
+}
+
+static void devices_parser_element (edgex_devices_parser *p)
+{
+  JSON_Value *val;
+  JSON_Object *obj;
+
+  p->elem[p->elen] = '\0';
+  val = json_parse_string (p->elem);
+  obj = json_value_get_object (val);
+  if (obj == NULL)
+  {
+    p->failed = true;
+  }
+  else
+  {
+    edgex_device *dev = device_read (p->lc, obj, &p->profiles);
+    if (dev)
+    {
+      *p->last = dev;
+      p->last = &dev->next;
+      p->count++;
+      if (++p->pending == p->batchsize)
       {
-        *last_ptr = temp;
-        last_ptr = &(temp->next);
+        devices_parser_flush (p);
       }
     }
   }
-
   json_value_free (val);
+}
+
+static void devices_parser_append (edgex_devices_parser *p, char c)
+{
+  if (p->elen + 1 >= p->esize)
+  {
+    p->esize = p->esize ? p->esize * 2 : 4096;
+    p->elem = realloc (p->elem, p->esize);
+  }
+  p->elem[p->elen++] = c;
+}
 
+void edgex_devices_parser_feed
+  (edgex_devices_parser *p, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len && !p->failed; i++)
+  {
+    char c = data[i];
+    if (p->depth >= 2)
+    {
+      devices_parser_append (p, c);
+    }
+    if (p->instring)
+    {
+      if (p->escape)
+      {
+        p->escape = false;
+      }
+      else if (c == '\\')
+      {
+        p->escape = true;
+      }
+      else if (c == '"')
+      {
+        p->instring = false;
+      }
+      continue;
+    }
+    switch (c)
+    {
+      case '"':
+        p->instring = true;
+        break;
+      case '[':
+      case '{':
+        if (p->depth == 0 && c != '[')
+        {
+          p->failed = true;
+        }
+        else if (p->depth == 1)
+        {
+          p->elen = 0;
+          devices_parser_append (p, c);
+        }
+        p->depth++;
+        break;
+      case ']':
+      case '}':
+        if (p->depth == 0)
+        {
+          p->failed = true;
+        }
+        else if (--p->depth == 1)
+        {
+          devices_parser_element (p);
+        }
+        break;
+      case ' ': case '\t': case '\r': case '\n':
+        break;
+      default:
+        if (p->depth == 0)
+        {
+          p->failed = true;
+        }
+        break;
+    }
+  }
+}
+
+unsigned edgex_devices_parser_finish (edgex_devices_parser *p, devsdk_error *err)
+{
+  const char *key;
+  unsigned result;
+  edgex_map_iter iter = edgex_map_iter (p->profiles);
+
+  devices_parser_flush (p);
+  while ((key = edgex_map_next (&p->profiles, &iter)))
+  {
+    edgex_deviceprofile_free (*edgex_map_get (&p->profiles, key));
+  }
+  edgex_map_deinit (&p->profiles);
+  if (p->failed || p->depth)
+  {
+    iot_log_error (p->lc, "Device list: malformed or truncated JSON array");
+    *err = EDGEX_DEVICES_PARSE_ERROR;
+  }
+  result = p->count;
+  free (p->elem);
+  free (p);
   return result;
 }
 
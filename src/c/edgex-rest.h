@@ -32,10 +32,24 @@ void edgex_deviceservice_free (edgex_deviceservice *e);
 void edgex_device_autoevents_free (edgex_device_autoevents *e);
 edgex_device *edgex_device_read (iot_logger_t *lc, const char *json);
 char *edgex_device_write (const edgex_device *e, bool create);
+char *edgex_device_write_cache (const edgex_device *e, bool withprofile);
 char *edgex_device_write_sparse (const char *name, const char *id, const char *description, const edgex_strings *labels, const char *profile_name);
 edgex_device *edgex_device_dup (const edgex_device *e);
 void edgex_device_free (edgex_device *e);
-edgex_device *edgex_devices_read (iot_logger_t *lc, const char *json);
+edgex_device *edgex_device_dup_packed (const edgex_device *e);
+void edgex_device_free_packed (edgex_device *e);
+
+/* Incremental parsing of a JSON array of devices. Devices are passed to the
+ * callback in batches as they are read, and freed when it returns.
+ */
+
+typedef struct edgex_devices_parser edgex_devices_parser;
+typedef void (*edgex_devices_cb) (void *ctx, const edgex_device *devs);
+
+edgex_devices_parser *edgex_devices_parser_alloc (iot_logger_t *lc, unsigned batchsize, edgex_devices_cb fn, void *ctx);
+void edgex_devices_parser_feed (edgex_devices_parser *p, const char *data, size_t len);
+unsigned edgex_devices_parser_finish (edgex_devices_parser *p, devsdk_error *err);
+
 edgex_addressable *edgex_addressable_read (const char *json);
 char *edgex_addressable_write (const edgex_addressable *e, bool create);
 edgex_addressable *edgex_addressable_dup (const edgex_addressable *e);
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/* Each thread which enters a read section is given a record in a global
+ * list, in which it publishes the epoch at which its current section began
+ * (or zero when outside a section). Records are never freed; a record is
+ * released for reuse when its thread exits.
+ *
+ * Retired objects are kept on a list, newest first, each with the epoch that
+ * a read section must have begun in (or after) to be unable to see it. When
+ * the list reaches EPOCH_BATCH entries, those older than every active read
+ * section are reclaimed.
+ */
+
+#include "epoch.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+typedef struct epoch_rec
+{
+  atomic_uint_fast64_t active;
+  atomic_bool inuse;
+  struct epoch_rec *next;
+} epoch_rec;
+
+#define EPOCH_BATCH 64
+
+typedef struct epoch_retired
+{
+  void (*fn) (void *);
+  void *p;
+  uint64_t target;
+  struct epoch_retired *next;
+} epoch_retired;
+
+static atomic_uint_fast64_t global_epoch = 1;
+static _Atomic (epoch_rec *) records = NULL;
+static pthread_key_t reckey;
+static pthread_once_t reckey_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+static epoch_retired *retired = NULL;
+static unsigned nretired = 0;
+
+static _Thread_local epoch_rec *myrec = NULL;
+static _Thread_local unsigned depth = 0;
+
+static void rec_release (void *p)
+{
+  epoch_rec *rec = (epoch_rec *) p;
+  atomic_store (&rec->active, 0);
+  atomic_store (&rec->inuse, false);
+}
+
+static void reckey_init (void)
+{
+  pthread_key_create (&reckey, rec_release);
+}
+
+static epoch_rec *rec_acquire (void)
+{
+  epoch_rec *rec;
+  pthread_once (&reckey_once, reckey_init);
+
+  for (rec = atomic_load (&records); rec; rec = rec->next)
+  {
+    bool avail = false;
+    if (atomic_compare_exchange_strong (&rec->inuse, &avail, true))
+    {
+      break;
+    }
+  }
+  if (rec == NULL)
+  {
+    rec = malloc (sizeof (epoch_rec));
+    atomic_init (&rec->active, 0);
+    atomic_init (&rec->inuse, true);
+    rec->next = atomic_load (&records);
+    while (!atomic_compare_exchange_weak (&records, &rec->next, rec));
+  }
+  pthread_setspecific (reckey, rec);
+  return rec;
+}
+
+void edgex_epoch_enter ()
+{
+  if (depth++ == 0)
+  {
+    if (myrec == NULL)
+    {
+      myrec = rec_acquire ();
+    }
+    atomic_store (&myrec->active, atomic_load (&global_epoch));
+  }
+}
+
+void edgex_epoch_exit ()
+{
+  if (--depth == 0)
+  {
+    atomic_store_explicit (&myrec->active, 0, memory_order_release);
+  }
+}
+
+void edgex_epoch_synchronize ()
+{
+  uint64_t target = atomic_fetch_add (&global_epoch, 1) + 1;
+
+  for (epoch_rec *rec = atomic_load (&records); rec; rec = rec->next)
+  {
+    uint64_t e;
+    while ((e = atomic_load (&rec->active)) != 0 && e < target)
+    {
+      sched_yield ();
+    }
+  }
+}
+
+/* The epoch in which the oldest active read section began */
+
+static uint64_t epoch_oldest (void)
+{
+  uint64_t result = UINT64_MAX;
+
+  for (epoch_rec *rec = atomic_load (&records); rec; rec = rec->next)
+  {
+    uint64_t e = atomic_load (&rec->active);
+    if (e != 0 && e < result)
+    {
+      result = e;
+    }
+  }
+  return result;
+}
+
+static void retired_run (epoch_retired *list)
+{
+  while (list)
+  {
+    epoch_retired *next = list->next;
+    list->fn (list->p);
+    free (list);
+    list = next;
+  }
+}
+
+void edgex_epoch_retire (void (*fn) (void *), void *p)
+{
+  epoch_retired *ready = NULL;
+  epoch_retired *r = malloc (sizeof (epoch_retired));
+  r->fn = fn;
+  r->p = p;
+
+  pthread_mutex_lock (&retired_lock);
+  r->target = atomic_fetch_add (&global_epoch, 1) + 1;
+  r->next = retired;
+  retired = r;
+  if (++nretired >= EPOCH_BATCH)
+  {
+    uint64_t oldest = epoch_oldest ();
+    epoch_retired **rp = &retired;
+    while (*rp && (*rp)->target > oldest)
+    {
+      rp = &(*rp)->next;
+    }
+    ready = *rp;
+    *rp = NULL;
+    for (epoch_retired *e = ready; e; e = e->next)
+    {
+      nretired--;
+    }
+  }
+  pthread_mutex_unlock (&retired_lock);
+  retired_run (ready);
+}
+
+void edgex_epoch_barrier ()
+{
+  epoch_retired *all;
+
+  pthread_mutex_lock (&retired_lock);
+  all = retired;
+  retired = NULL;
+  nretired = 0;
+  pthread_mutex_unlock (&retired_lock);
+  edgex_epoch_synchronize ();
+  retired_run (all);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_EPOCH_H_
+#define _EDGEX_DEVICE_EPOCH_H_ 1
+
+/* Epoch-based reclamation. Readers bracket access to shared structures with
+ * edgex_epoch_enter / edgex_epoch_exit, which do not take locks. A writer
+ * which has unpublished an object calls edgex_epoch_synchronize before
+ * freeing it: this waits until every read section which may have seen the
+ * object has finished.
+ *
+ * Read sections may nest but should be short, and must not call
+ * edgex_epoch_synchronize.
+ *
+ * Alternatively, a writer may retire an unpublished object with
+ * edgex_epoch_retire, which does not wait: fn (p) is called later, once no
+ * read section which may have seen the object remains. Retired objects are
+ * reclaimed in batches by subsequent calls to edgex_epoch_retire, and all
+ * at once by edgex_epoch_barrier, which waits for a grace period.
+ */
+
+extern void edgex_epoch_enter (void);
+extern void edgex_epoch_exit (void);
+extern void edgex_epoch_synchronize (void);
+extern void edgex_epoch_retire (void (*fn) (void *), void *p);
+extern void edgex_epoch_barrier (void);
+
+#endif
@@ -28,4 +28,5 @@
 #define EDGEX_PROFILES_DIRECTORY (devsdk_error){ .code = 19, .reason = "Problem scanning profiles directory" }
 #define EDGEX_ASSERT_FAIL (devsdk_error){ .code = 20, .reason = "A reading did not match a specified assertion string" }
 #define EDGEX_HTTP_ERROR (devsdk_error){ .code = 21, .reason = "HTTP request failed" }
+#define EDGEX_DEVICES_PARSE_ERROR (devsdk_error){ .code = 22, .reason = "Error while parsing device list" }
 #endif
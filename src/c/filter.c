@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "filter.h"
+#include "devutil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+/* Compact form of a reading. For exact comparison, bits holds the value of
+ * an integer or boolean, the representation of a float, or a hash of any
+ * other value. For deadband comparison, num holds numeric values as a double.
+ */
+
+typedef struct
+{
+  uint64_t bits;
+  double num;
+  bool numeric;
+} edgex_filter_value;
+
+typedef struct
+{
+  double deadband;
+  double percent;
+  double hysteresis;
+  edgex_filter_value last;
+  int direction;
+} edgex_filter_res;
+
+struct edgex_filter
+{
+  pthread_mutex_t lock;
+  unsigned nreqs;
+  bool valid;
+  uint64_t heartbeat;
+  uint64_t lastpost;
+  edgex_filter_value *current;
+  edgex_filter_res res[];
+};
+
+static uint64_t fnv1a (const uint8_t *data, size_t len)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++)
+  {
+    h = (h ^ data[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+static void filter_scalar (const devsdk_scalar *s, edgex_filter_value *v)
+{
+  v->numeric = true;
+  switch (s->kind)
+  {
+    case DEVSDK_SCALAR_INT: v->num = s->v.i; v->bits = (uint64_t) s->v.i; break;
+    case DEVSDK_SCALAR_UINT: v->num = s->v.ui; v->bits = s->v.ui; break;
+    case DEVSDK_SCALAR_FLOAT: v->num = s->v.f; memcpy (&v->bits, &v->num, sizeof (double)); break;
+    case DEVSDK_SCALAR_BOOL: v->num = s->v.b; v->bits = s->v.b; break;
+    default: v->numeric = false; v->bits = 0; break;
+  }
+}
+
+static void filter_value (const devsdk_commandresult *res, edgex_filter_value *v)
+{
+  const iot_data_t *data = res->value;
+
+  if (data == NULL)
+  {
+    filter_scalar (&res->scalar, v);
+    return;
+  }
+  v->numeric = true;
+  switch (iot_data_type (data))
+  {
+    case IOT_DATA_INT8: v->num = iot_data_i8 (data); v->bits = (uint64_t) (int64_t) iot_data_i8 (data); break;
+    case IOT_DATA_UINT8: v->num = iot_data_ui8 (data); v->bits = iot_data_ui8 (data); break;
+    case IOT_DATA_INT16: v->num = iot_data_i16 (data); v->bits = (uint64_t) (int64_t) iot_data_i16 (data); break;
+    case IOT_DATA_UINT16: v->num = iot_data_ui16 (data); v->bits = iot_data_ui16 (data); break;
+    case IOT_DATA_INT32: v->num = iot_data_i32 (data); v->bits = (uint64_t) (int64_t) iot_data_i32 (data); break;
+    case IOT_DATA_UINT32: v->num = iot_data_ui32 (data); v->bits = iot_data_ui32 (data); break;
+    case IOT_DATA_INT64: v->num = iot_data_i64 (data); v->bits = (uint64_t) iot_data_i64 (data); break;
+    case IOT_DATA_UINT64: v->num = iot_data_ui64 (data); v->bits = iot_data_ui64 (data); break;
+    case IOT_DATA_FLOAT32: v->num = iot_data_f32 (data); memcpy (&v->bits, &v->num, sizeof (double)); break;
+    case IOT_DATA_FLOAT64: v->num = iot_data_f64 (data); memcpy (&v->bits, &v->num, sizeof (double)); break;
+    case IOT_DATA_BOOL: v->num = iot_data_bool (data); v->bits = iot_data_bool (data); break;
+    case IOT_DATA_STRING:
+    {
+      const char *str = iot_data_string (data);
+      v->numeric = false;
+      v->bits = fnv1a ((const uint8_t *) str, strlen (str));
+      break;
+    }
+    case IOT_DATA_ARRAY:
+      v->numeric = false;
+      v->bits = fnv1a (iot_data_address (data), iot_data_array_size (data));
+      break;
+    default:
+      v->numeric = false;
+      v->bits = 0;
+      break;
+  }
+}
+
+static double get_attr (const devsdk_nvpairs *attrs, const char *name, const char *resname, iot_logger_t *lc)
+{
+  double result = 0.0;
+  const char *str = devsdk_nvpairs_value (attrs, name);
+  if (str && *str)
+  {
+    char *end;
+    result = strtod (str, &end);
+    if (*end || result < 0.0)
+    {
+      iot_log_error (lc, "Resource %s: unable to parse \"%s\" for %s", resname, str, name);
+      result = 0.0;
+    }
+  }
+  return result;
+}
+
+edgex_filter *edgex_filter_alloc (const edgex_cmdinfo *cmd, iot_logger_t *lc)
+{
+  edgex_filter *f = calloc (1, sizeof (edgex_filter) + cmd->nreqs * sizeof (edgex_filter_res));
+  pthread_mutex_init (&f->lock, NULL);
+  f->nreqs = cmd->nreqs;
+  f->current = calloc (cmd->nreqs, sizeof (edgex_filter_value));
+  for (unsigned i = 0; i < cmd->nreqs; i++)
+  {
+    const devsdk_nvpairs *attrs = cmd->reqs[i].attributes;
+    const char *resname = cmd->reqs[i].resname;
+    const char *hb = devsdk_nvpairs_value (attrs, "heartbeat");
+
+    f->res[i].deadband = get_attr (attrs, "deadband", resname, lc);
+    f->res[i].percent = get_attr (attrs, "deadbandPercent", resname, lc);
+    f->res[i].hysteresis = get_attr (attrs, "hysteresis", resname, lc);
+    if (hb && *hb)
+    {
+      uint64_t us = edgex_parse_duration (hb);
+      if (us == 0)
+      {
+        iot_log_error (lc, "Resource %s: unable to parse \"%s\" for heartbeat", resname, hb);
+      }
+      else if (f->heartbeat == 0 || us * 1000 < f->heartbeat)
+      {
+        f->heartbeat = us * 1000;
+      }
+    }
+  }
+  return f;
+}
+
+void edgex_filter_free (edgex_filter *f)
+{
+  if (f)
+  {
+    pthread_mutex_destroy (&f->lock);
+    free (f->current);
+    free (f);
+  }
+}
+
+static bool filter_changed (const edgex_filter_res *r, const edgex_filter_value *v)
+{
+  if (!(v->numeric && r->last.numeric) || (r->deadband == 0.0 && r->percent == 0.0 && r->hysteresis == 0.0))
+  {
+    return v->bits != r->last.bits;
+  }
+  double delta = v->num - r->last.num;
+  double threshold = fmax (r->deadband, r->percent / 100.0 * fabs (r->last.num));
+  if (r->direction && (delta > 0.0 ? 1 : -1) != r->direction)
+  {
+    threshold += r->hysteresis;
+  }
+  return fabs (delta) > threshold;
+}
+
+bool edgex_filter_check
+  (edgex_filter *f, const devsdk_commandresult *values, uint64_t now)
+{
+  bool post;
+
+  pthread_mutex_lock (&f->lock);
+  post = !f->valid || (f->heartbeat && now - f->lastpost >= f->heartbeat);
+  for (unsigned i = 0; i < f->nreqs; i++)
+  {
+    filter_value (&values[i], &f->current[i]);
+    if (!post && filter_changed (&f->res[i], &f->current[i]))
+    {
+      post = true;
+    }
+  }
+  if (post)
+  {
+    for (unsigned i = 0; i < f->nreqs; i++)
+    {
+      edgex_filter_res *r = &f->res[i];
+      if (f->valid && f->current[i].numeric && f->current[i].num != r->last.num)
+      {
+        r->direction = (f->current[i].num > r->last.num) ? 1 : -1;
+      }
+      r->last = f->current[i];
+    }
+    f->valid = true;
+    f->lastpost = now;
+  }
+  pthread_mutex_unlock (&f->lock);
+  return post;
+}
+
+void edgex_filter_reset (edgex_filter *f)
+{
+  pthread_mutex_lock (&f->lock);
+  f->valid = false;
+  pthread_mutex_unlock (&f->lock);
+}
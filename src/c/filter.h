@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_FILTER_H_
+#define _EDGEX_DEVICE_FILTER_H_ 1
+
+/* Change detection for onChange AutoEvents. The readings last posted for a
+ * command are held in compact form: numeric and boolean readings as scalars,
+ * others as a hash of their contents. New readings are compared with these
+ * according to the following attributes of each device resource:
+ *
+ * deadband        A numeric reading must differ from the last posted value
+ *                 by more than this amount to count as a change.
+ * deadbandPercent As above, as a percentage of the last posted value. Where
+ *                 both are given the larger threshold applies.
+ * hysteresis      A numeric reading which reverses the direction of the last
+ *                 posted change must additionally exceed the deadband by this
+ *                 amount, which suppresses oscillation about a value.
+ * heartbeat       A duration, eg "5m". The readings are posted if none have
+ *                 been posted for this long, whether or not they changed. If
+ *                 several resources of a command specify it, the shortest
+ *                 applies.
+ *
+ * Readings without any of these attributes change if their value differs.
+ */
+
+#include "cmdinfo.h"
+#include "iot/logger.h"
+
+struct edgex_filter;
+typedef struct edgex_filter edgex_filter;
+
+extern edgex_filter *edgex_filter_alloc (const edgex_cmdinfo *cmd, iot_logger_t *lc);
+extern void edgex_filter_free (edgex_filter *f);
+
+/* Check a set of readings for the command, taken at the given time (in
+ * nanoseconds). Returns true if they should be posted, in which case they
+ * become the reference for subsequent checks.
+ */
+
+extern bool edgex_filter_check
+  (edgex_filter *f, const devsdk_commandresult *values, uint64_t now);
+
+/* Forget the reference readings, so that the next readings are posted. Used
+ * when posting fails.
+ */
+
+extern void edgex_filter_reset (edgex_filter *f);
+
+#endif
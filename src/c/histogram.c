@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "histogram.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
+
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 36
+#define HIST_MAX_VALUE ((1ULL << HIST_MAX_BITS) - 1)
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+#define HIST_STRIPES 8
+
+typedef struct hist_stripe
+{
+  _Alignas (64) atomic_uint_fast64_t counts[HIST_BUCKETS];
+  atomic_uint_fast64_t sum;
+  atomic_uint_fast64_t min;
+  atomic_uint_fast64_t max;
+} hist_stripe;
+
+struct edgex_histogram_t
+{
+  hist_stripe stripes[HIST_STRIPES];
+};
+
+static atomic_uint nextstripe = 0;
+static _Thread_local unsigned mystripe = UINT_MAX;
+
+static unsigned bucket_index (uint64_t v)
+{
+  if (v < HIST_SUB)
+  {
+    return v;
+  }
+  unsigned shift = (63 - __builtin_clzll (v)) - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB + (unsigned)((v >> shift) - HIST_SUB);
+}
+
+/* Highest value which maps to the given bucket */
+
+static uint64_t bucket_value (unsigned idx)
+{
+  if (idx < HIST_SUB)
+  {
+    return idx;
+  }
+  unsigned shift = idx / HIST_SUB - 1;
+  uint64_t sub = idx % HIST_SUB + HIST_SUB;
+  return ((sub + 1) << shift) - 1;
+}
+
+edgex_histogram_t *edgex_histogram_alloc ()
+{
+  edgex_histogram_t *h = aligned_alloc (64, sizeof (edgex_histogram_t));
+  memset (h, 0, sizeof (edgex_histogram_t));
+  for (unsigned s = 0; s < HIST_STRIPES; s++)
+  {
+    atomic_store (&h->stripes[s].min, UINT64_MAX);
+  }
+  return h;
+}
+
+void edgex_histogram_free (edgex_histogram_t *h)
+{
+  free (h);
+}
+
+void edgex_histogram_record (edgex_histogram_t *h, uint64_t value)
+{
+  if (mystripe == UINT_MAX)
+  {
+    mystripe = atomic_fetch_add (&nextstripe, 1) % HIST_STRIPES;
+  }
+  hist_stripe *s = &h->stripes[mystripe];
+  if (value > HIST_MAX_VALUE)
+  {
+    value = HIST_MAX_VALUE;
+  }
+  atomic_fetch_add_explicit (&s->counts[bucket_index (value)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit (&s->sum, value, memory_order_relaxed);
+
+  uint64_t cur = atomic_load_explicit (&s->max, memory_order_relaxed);
+  while (value > cur && !atomic_compare_exchange_weak (&s->max, &cur, value));
+  cur = atomic_load_explicit (&s->min, memory_order_relaxed);
+  while (value < cur && !atomic_compare_exchange_weak (&s->min, &cur, value));
+}
+
+JSON_Value *edgex_histogram_summary (edgex_histogram_t *h)
+{
+  static const struct { const char *name; double q; } pcts[] =
+    { { "P50", 0.5 }, { "P90", 0.9 }, { "P99", 0.99 }, { "P999", 0.999 } };
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+
+  memset (counts, 0, sizeof (counts));
+  for (unsigned s = 0; s < HIST_STRIPES; s++)
+  {
+    hist_stripe *st = &h->stripes[s];
+    for (unsigned i = 0; i < HIST_BUCKETS; i++)
+    {
+      uint64_t c = atomic_load_explicit (&st->counts[i], memory_order_relaxed);
+      counts[i] += c;
+      total += c;
+    }
+    sum += atomic_load_explicit (&st->sum, memory_order_relaxed);
+    uint64_t smin = atomic_load_explicit (&st->min, memory_order_relaxed);
+    uint64_t smax = atomic_load_explicit (&st->max, memory_order_relaxed);
+    if (smin < min)
+    {
+      min = smin;
+    }
+    if (smax > max)
+    {
+      max = smax;
+    }
+  }
+
+  JSON_Value *val = json_value_init_object ();
+  JSON_Object *obj = json_value_get_object (val);
+  json_object_set_uint (obj, "Count", total);
+  if (total)
+  {
+    json_object_set_uint (obj, "Min", min);
+    json_object_set_uint (obj, "Max", max);
+    json_object_set_number (obj, "Mean", (double)sum / total);
+
+    uint64_t seen = 0;
+    unsigned i = 0;
+    for (unsigned p = 0; p < sizeof (pcts) / sizeof (pcts[0]); p++)
+    {
+      uint64_t target = (uint64_t)(pcts[p].q * total + 0.5);
+      if (target == 0)
+      {
+        target = 1;
+      }
+      while (i < HIST_BUCKETS && seen + counts[i] < target)
+      {
+        seen += counts[i++];
+      }
+      uint64_t v = (i < HIST_BUCKETS) ? bucket_value (i) : max;
+      json_object_set_uint (obj, pcts[p].name, v < max ? v : max);
+    }
+  }
+  return val;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_HISTOGRAM_H_
+#define _EDGEX_DEVICE_HISTOGRAM_H_ 1
+
+/* Log-linear histogram for latency measurements. Each power-of-two range is
+ * divided into eight sub-buckets, giving a relative error of at most 12.5%.
+ * Recording is lock-free: threads update one of several stripes, which are
+ * merged when a summary is requested.
+ */
+
+#include "parson.h"
+
+#include <stdint.h>
+
+struct edgex_histogram_t;
+typedef struct edgex_histogram_t edgex_histogram_t;
+
+extern edgex_histogram_t *edgex_histogram_alloc (void);
+extern void edgex_histogram_free (edgex_histogram_t *h);
+
+extern void edgex_histogram_record (edgex_histogram_t *h, uint64_t value);
+
+/*
+ * Returns a JSON object containing Count, Min, Max, Mean and the 50th, 90th,
+ * 99th and 99.9th percentiles of the values recorded.
+ */
+
+extern JSON_Value *edgex_histogram_summary (edgex_histogram_t *h);
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/* The table is split into stripes by the top bits of the string's hash,
+ * each with its own lock and chained buckets. Adding a reference to a string
+ * already held is lock-free; finding and releasing strings take the lock.
+ */
+
+#include "intern.h"
+#include "map.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define INTERN_STRIPE_BITS 4
+#define INTERN_STRIPES (1 << INTERN_STRIPE_BITS)
+#define INTERN_MIN_BUCKETS 64
+
+typedef struct intern_entry
+{
+  struct intern_entry *next;
+  uint64_t hash;
+  atomic_uint_fast32_t refs;
+  size_t len;
+  char str[];
+} intern_entry;
+
+typedef struct intern_stripe
+{
+  pthread_mutex_t lock;
+  intern_entry **buckets;
+  unsigned nbuckets;
+  unsigned count;
+} intern_stripe;
+
+static intern_stripe stripes[INTERN_STRIPES];
+static pthread_once_t stripes_once = PTHREAD_ONCE_INIT;
+
+static atomic_uint_fast64_t nstrings = 0;
+static atomic_uint_fast64_t nbytes = 0;
+static atomic_uint_fast64_t nlookups = 0;
+static atomic_uint_fast64_t nhits = 0;
+
+static void stripes_init (void)
+{
+  for (unsigned i = 0; i < INTERN_STRIPES; i++)
+  {
+    pthread_mutex_init (&stripes[i].lock, NULL);
+    stripes[i].buckets = calloc (INTERN_MIN_BUCKETS, sizeof (intern_entry *));
+    stripes[i].nbuckets = INTERN_MIN_BUCKETS;
+    stripes[i].count = 0;
+  }
+}
+
+static inline intern_entry *entry_of (const char *istr)
+{
+  return (intern_entry *) (istr - offsetof (intern_entry, str));
+}
+
+static void stripe_grow (intern_stripe *s)
+{
+  unsigned n = s->nbuckets * 2;
+  intern_entry **buckets = calloc (n, sizeof (intern_entry *));
+  if (buckets == NULL)
+  {
+    return;
+  }
+  for (unsigned i = 0; i < s->nbuckets; i++)
+  {
+    intern_entry *e = s->buckets[i];
+    while (e)
+    {
+      intern_entry *next = e->next;
+      unsigned b = e->hash & (n - 1);
+      e->next = buckets[b];
+      buckets[b] = e;
+      e = next;
+    }
+  }
+  free (s->buckets);
+  s->buckets = buckets;
+  s->nbuckets = n;
+}
+
+char *edgex_intern (const char *str)
+{
+  intern_entry *e;
+  size_t len = strlen (str);
+  uint64_t hash = edgex_map_hash (str);
+  intern_stripe *s = &stripes[hash >> (64 - INTERN_STRIPE_BITS)];
+
+  pthread_once (&stripes_once, stripes_init);
+  atomic_fetch_add_explicit (&nlookups, 1, memory_order_relaxed);
+
+  pthread_mutex_lock (&s->lock);
+  for (e = s->buckets[hash & (s->nbuckets - 1)]; e; e = e->next)
+  {
+    if (e->hash == hash && e->len == len && memcmp (e->str, str, len) == 0)
+    {
+      atomic_fetch_add (&e->refs, 1);
+      pthread_mutex_unlock (&s->lock);
+      atomic_fetch_add_explicit (&nhits, 1, memory_order_relaxed);
+      return e->str;
+    }
+  }
+
+  e = malloc (sizeof (intern_entry) + len + 1);
+  e->hash = hash;
+  e->len = len;
+  atomic_init (&e->refs, 1);
+  memcpy (e->str, str, len + 1);
+  if (++s->count > s->nbuckets)
+  {
+    stripe_grow (s);
+  }
+  unsigned b = hash & (s->nbuckets - 1);
+  e->next = s->buckets[b];
+  s->buckets[b] = e;
+  pthread_mutex_unlock (&s->lock);
+
+  atomic_fetch_add_explicit (&nstrings, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit (&nbytes, len + 1, memory_order_relaxed);
+  return e->str;
+}
+
+char *edgex_intern_dup (const char *istr)
+{
+  if (istr)
+  {
+    atomic_fetch_add (&entry_of (istr)->refs, 1);
+  }
+  return (char *)istr;
+}
+
+void edgex_intern_release (const char *istr)
+{
+  if (istr)
+  {
+    intern_entry *e = entry_of (istr);
+    intern_stripe *s = &stripes[e->hash >> (64 - INTERN_STRIPE_BITS)];
+
+    pthread_mutex_lock (&s->lock);
+    if (atomic_fetch_sub (&e->refs, 1) == 1)
+    {
+      intern_entry **p = &s->buckets[e->hash & (s->nbuckets - 1)];
+      while (*p != e)
+      {
+        p = &(*p)->next;
+      }
+      *p = e->next;
+      s->count--;
+      atomic_fetch_sub_explicit (&nstrings, 1, memory_order_relaxed);
+      atomic_fetch_sub_explicit (&nbytes, e->len + 1, memory_order_relaxed);
+      free (e);
+    }
+    pthread_mutex_unlock (&s->lock);
+  }
+}
+
+void edgex_intern_getstats (edgex_intern_stats *stats)
+{
+  stats->strings = atomic_load (&nstrings);
+  stats->bytes = atomic_load (&nbytes);
+  stats->lookups = atomic_load (&nlookups);
+  stats->hits = atomic_load (&nhits);
+}
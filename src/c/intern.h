@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_INTERN_H_
+#define _EDGEX_DEVICE_INTERN_H_ 1
+
+/* String interning. Each distinct string is stored once, with a reference
+ * count, so that names which occur in many places (device and profile names,
+ * and map keys) share storage, and so that two interned strings are equal
+ * if and only if they are the same pointer.
+ *
+ * Interned strings must not be modified, and are freed by
+ * edgex_intern_release rather than free().
+ */
+
+#include <stdint.h>
+
+typedef struct edgex_intern_stats
+{
+  uint64_t strings;    // Distinct strings held
+  uint64_t bytes;      // Total size of the strings held
+  uint64_t lookups;    // Calls to edgex_intern
+  uint64_t hits;       // Calls to edgex_intern which found an existing string
+} edgex_intern_stats;
+
+/* Returns the interned copy of str, adding a reference to it. */
+
+extern char *edgex_intern (const char *str);
+
+/* Adds a reference to an interned string, and returns it. */
+
+extern char *edgex_intern_dup (const char *istr);
+
+/* Drops a reference to an interned string. NULL is ignored. */
+
+extern void edgex_intern_release (const char *istr);
+
+extern void edgex_intern_getstats (edgex_intern_stats *stats);
+
+#endif
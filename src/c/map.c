@@ -1,9 +1,11 @@
 #include "map.h"
+#include "intern.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 
-/* Based on rxi's type-safe hashmap implementation */
+/* Type-safe API based on rxi's hashmap implementation */
 
 /**
  * Copyright (c) 2014 rxi
@@ -12,208 +14,370 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
-typedef struct edgex_map_node
+/* Each slot holds the full 64-bit hash of its key, a pointer to the interned
+ * key, and the value. The control array has one byte per slot followed by a
+ * copy of the first group of bytes, so that a group may be loaded from any
+ * position without wrapping. The capacity is a power of two, and at least
+ * one group. Probing visits groups in triangular sequence.
+ */
+
+#define CTRL_EMPTY ((uint8_t) 0x80)
+#define CTRL_DELETED ((uint8_t) 0xfe)
+
+#define SLOT_HDR_SIZE (sizeof (uint64_t) + sizeof (char *))
+
+#if defined (__SSE2__)
+
+#include <emmintrin.h>
+
+#define GROUP_SIZE 16
+typedef uint32_t group_mask;
+
+static inline group_mask group_match (const uint8_t *ctrl, uint8_t h2)
+{
+  __m128i g = _mm_loadu_si128 ((const __m128i *) ctrl);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_set1_epi8 (h2), g));
+}
+
+static inline group_mask group_empty (const uint8_t *ctrl)
+{
+  return group_match (ctrl, CTRL_EMPTY);
+}
+
+static inline group_mask group_free (const uint8_t *ctrl)
+{
+  return _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) ctrl));
+}
+
+static inline unsigned mask_first (group_mask m)
 {
-  unsigned hash;
-  void *value;
-  edgex_map_node *next;
-} edgex_map_node;
+  return __builtin_ctz (m);
+}
+
+#else
+
+/* Portable version: eight control bytes are tested at once in a uint64_t.
+ * Matches are indicated by the top bit of the corresponding byte.
+ */
+
+#define GROUP_SIZE 8
+#define SWAR_LSB 0x0101010101010101ULL
+#define SWAR_MSB 0x8080808080808080ULL
+typedef uint64_t group_mask;
 
-static unsigned edgex_hash (const char *str)
+static inline uint64_t group_load (const uint8_t *ctrl)
 {
-  unsigned hash = 5381u;
-  while (*str)
+  uint64_t g;
+  memcpy (&g, ctrl, sizeof (g));
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  g = __builtin_bswap64 (g);
+#endif
+  return g;
+}
+
+/* May give false positives, which are eliminated by the hash comparison */
+
+static inline group_mask group_match (const uint8_t *ctrl, uint8_t h2)
+{
+  uint64_t x = group_load (ctrl) ^ (SWAR_LSB * h2);
+  return (x - SWAR_LSB) & ~x & SWAR_MSB;
+}
+
+static inline group_mask group_empty (const uint8_t *ctrl)
+{
+  uint64_t g = group_load (ctrl);
+  return g & ~(g << 6) & SWAR_MSB;
+}
+
+static inline group_mask group_free (const uint8_t *ctrl)
+{
+  return group_load (ctrl) & SWAR_MSB;
+}
+
+static inline unsigned mask_first (group_mask m)
+{
+  return __builtin_ctzll (m) >> 3;
+}
+
+#endif
+
+#define MIN_CAPACITY GROUP_SIZE
+
+static inline uint64_t hash_mix (uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t edgex_hash (const char *key, size_t len)
+{
+  uint64_t k;
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+  while (len >= sizeof (k))
   {
-    hash = ((hash << 5) + hash) ^ *str++;
+    memcpy (&k, key, sizeof (k));
+    h = (h ^ k) * 0x9e3779b97f4a7c15ULL;
+    h = (h << 31) | (h >> 33);
+    key += sizeof (k);
+    len -= sizeof (k);
   }
-  return hash;
+  k = 0;
+  memcpy (&k, key, len);
+  return hash_mix (h ^ k);
 }
 
-static edgex_map_node *edgex_map_newnode
-  (const char *key, void *value, int vsize)
+uint64_t edgex_map_hash (const char *key)
 {
-  edgex_map_node *node;
-  int ksize = strlen (key) + 1;
-  int voffset = ksize + ((sizeof (void *) - ksize) % sizeof (void *));
-  node = malloc (sizeof (*node) + voffset + vsize);
-  if (!node)
-  { return NULL; }
-  memcpy (node + 1, key, ksize);
-  node->hash = edgex_hash (key);
-  node->value = ((char *) (node + 1)) + voffset;
-  memcpy (node->value, value, vsize);
-  return node;
+  return edgex_hash (key, strlen (key));
 }
 
-static int edgex_map_bucketidx (edgex_map_base *m, unsigned hash)
+static inline uint8_t hash_h2 (uint64_t hash)
 {
-  /* If the implementation is changed to allow a non-power-of-2 bucket count,
-   * the line below should be changed to use mod instead of AND
-   */
-  return hash & (m->nbuckets - 1);
+  return hash & 0x7f;
 }
 
-static void edgex_map_addnode (edgex_map_base *m, edgex_map_node *node)
+static inline char *slot_at (const edgex_map_base *m, unsigned i)
 {
-  int n = edgex_map_bucketidx (m, node->hash);
-  node->next = m->buckets[n];
-  m->buckets[n] = node;
+  return m->slots + (size_t) i * m->stride;
 }
 
-static int edgex_map_resize (edgex_map_base *m, int nbuckets)
+static inline uint64_t *slot_hash (char *slot)
 {
-  edgex_map_node *nodes, *node, *next;
-  edgex_map_node **buckets;
-  int i;
-  /* Chain all nodes together */
-  nodes = NULL;
-  i = m->nbuckets;
-  while (i--)
+  return (uint64_t *) slot;
+}
+
+static inline char **slot_key (char *slot)
+{
+  return (char **) (slot + sizeof (uint64_t));
+}
+
+static inline void *slot_value (char *slot)
+{
+  return slot + SLOT_HDR_SIZE;
+}
+
+static inline void set_ctrl (edgex_map_base *m, unsigned i, uint8_t c)
+{
+  m->ctrl[i] = c;
+  if (i < GROUP_SIZE)
   {
-    node = (m->buckets)[i];
-    while (node)
-    {
-      next = node->next;
-      node->next = nodes;
-      nodes = node;
-      node = next;
-    }
+    m->ctrl[m->capacity + i] = c;
   }
-  /* Reset buckets */
-  buckets = realloc (m->buckets, sizeof (*m->buckets) * nbuckets);
-  if (buckets != NULL)
+}
+
+static int find_slot (const edgex_map_base *m, const char *key, uint64_t hash)
+{
+  unsigned mask = m->capacity - 1;
+  unsigned pos = (hash >> 7) & mask;
+  uint8_t h2 = hash_h2 (hash);
+
+  /* Keys are usually at or just after their home position. Fetch that slot
+   * alongside the control bytes rather than after them.
+   */
+
+  __builtin_prefetch (slot_at (m, pos));
+
+  for (unsigned step = GROUP_SIZE; ; step += GROUP_SIZE)
   {
-    m->buckets = buckets;
-    m->nbuckets = nbuckets;
+    const uint8_t *g = m->ctrl + pos;
+    for (group_mask match = group_match (g, h2); match; match &= match - 1)
+    {
+      unsigned i = (pos + mask_first (match)) & mask;
+      char *slot = slot_at (m, i);
+      if (*slot_hash (slot) == hash && (*slot_key (slot) == key || strcmp (*slot_key (slot), key) == 0))
+      {
+        return i;
+      }
+    }
+    if (group_empty (g))
+    {
+      return -1;
+    }
+    pos = (pos + step) & mask;
   }
-  if (m->buckets)
+}
+
+/* Find an empty or deleted slot for a key not currently in the table */
+
+static unsigned find_free (const edgex_map_base *m, uint64_t hash)
+{
+  unsigned mask = m->capacity - 1;
+  unsigned pos = (hash >> 7) & mask;
+
+  for (unsigned step = GROUP_SIZE; ; step += GROUP_SIZE)
   {
-    memset (m->buckets, 0, sizeof (*m->buckets) * m->nbuckets);
-    /* Re-add nodes to buckets */
-    node = nodes;
-    while (node)
+    group_mask free = group_free (m->ctrl + pos);
+    if (free)
     {
-      next = node->next;
-      edgex_map_addnode (m, node);
-      node = next;
+      return (pos + mask_first (free)) & mask;
     }
+    pos = (pos + step) & mask;
   }
-  /* Return error code if realloc() failed */
-  return (buckets == NULL) ? -1 : 0;
 }
 
-static edgex_map_node **edgex_map_getref (edgex_map_base *m, const char *key)
+static int edgex_map_resize (edgex_map_base *m, unsigned capacity)
 {
-  unsigned hash = edgex_hash (key);
-  if (m->nbuckets > 0)
+  edgex_map_base old = *m;
+  uint8_t *ctrl = malloc (capacity + GROUP_SIZE);
+  char *slots = malloc ((size_t) capacity * m->stride);
+
+  if (ctrl == NULL || slots == NULL)
   {
-    edgex_map_node **next = &m->buckets[edgex_map_bucketidx (m, hash)];
-    while (*next)
+    free (ctrl);
+    free (slots);
+    return -1;
+  }
+  memset (ctrl, CTRL_EMPTY, capacity + GROUP_SIZE);
+  m->ctrl = ctrl;
+  m->slots = slots;
+  m->capacity = capacity;
+  m->deleted = 0;
+
+  for (unsigned i = 0; i < old.capacity; i++)
+  {
+    if ((old.ctrl[i] & CTRL_EMPTY) == 0)
     {
-      if ((*next)->hash == hash && !strcmp ((char *) (*next + 1), key))
-      {
-        return next;
-      }
-      next = &(*next)->next;
+      char *src = slot_at (&old, i);
+      unsigned j = find_free (m, *slot_hash (src));
+      set_ctrl (m, j, hash_h2 (*slot_hash (src)));
+      memcpy (slot_at (m, j), src, m->stride);
     }
   }
-  return NULL;
+  free (old.ctrl);
+  free (old.slots);
+  return 0;
+}
+
+/* Choose a capacity giving a load factor of under 7/16 for n entries */
+
+static unsigned capacity_for (unsigned n)
+{
+  unsigned cap = MIN_CAPACITY;
+  while (cap * 7 <= n * 16)
+  {
+    cap <<= 1;
+  }
+  return cap;
 }
 
 void edgex_map_deinit_ (edgex_map_base *m)
 {
-  edgex_map_node *next, *node;
-  int i;
-  i = m->nbuckets;
-  while (i--)
+  for (unsigned i = 0; i < m->capacity; i++)
   {
-    node = m->buckets[i];
-    while (node)
+    if ((m->ctrl[i] & CTRL_EMPTY) == 0)
     {
-      next = node->next;
-      free (node);
-      node = next;
+      edgex_intern_release (*slot_key (slot_at (m, i)));
     }
   }
-  free (m->buckets);
+  free (m->ctrl);
+  free (m->slots);
+  memset (m, 0, sizeof (*m));
 }
 
 void *edgex_map_get_ (edgex_map_base *m, const char *key)
 {
-  edgex_map_node **next = edgex_map_getref (m, key);
-  return next ? (*next)->value : NULL;
+  int i;
+  if (m->size == 0)
+  {
+    return NULL;
+  }
+  i = find_slot (m, key, edgex_hash (key, strlen (key)));
+  return (i >= 0) ? slot_value (slot_at (m, i)) : NULL;
 }
 
 int edgex_map_set_ (edgex_map_base *m, const char *key, void *value, int vsize)
 {
-  int n, err;
-  edgex_map_node **next, *node;
-  /* Find & replace existing node */
-  next = edgex_map_getref (m, key);
-  if (next)
+  int i;
+  unsigned j;
+  char *slot;
+  size_t klen = strlen (key);
+  uint64_t hash = edgex_hash (key, klen);
+
+  if (m->capacity == 0)
   {
-    memcpy ((*next)->value, value, vsize);
+    m->stride = SLOT_HDR_SIZE + ((vsize + sizeof (void *) - 1) & ~(sizeof (void *) - 1));
+    if (edgex_map_resize (m, MIN_CAPACITY))
+    {
+      return -1;
+    }
+  }
+
+  /* Find & replace existing entry */
+
+  i = find_slot (m, key, hash);
+  if (i >= 0)
+  {
+    memcpy (slot_value (slot_at (m, i)), value, vsize);
     return 0;
   }
-  /* Add new node */
-  node = edgex_map_newnode (key, value, vsize);
-  if (node == NULL)
-  { goto fail; }
-  if (m->nnodes >= m->nbuckets)
+
+  /* Grow, or rehash to clear deleted entries, when 7/8 full. Tables that
+   * have become sparse through removals are shrunk.
+   */
+
+  if ((m->size + m->deleted + 1) * 8 > m->capacity * 7)
   {
-    n = (m->nbuckets > 0) ? (m->nbuckets << 1) : 1;
-    err = edgex_map_resize (m, n);
-    if (err)
-    { goto fail; }
+    if (edgex_map_resize (m, capacity_for (m->size + 1)))
+    {
+      return -1;
+    }
   }
-  edgex_map_addnode (m, node);
-  m->nnodes++;
+  else if (m->capacity > MIN_CAPACITY && (m->size + 1) * 16 < m->capacity)
+  {
+    edgex_map_resize (m, capacity_for (m->size + 1));
+  }
+
+  j = find_free (m, hash);
+  if (m->ctrl[j] == CTRL_DELETED)
+  {
+    m->deleted--;
+  }
+  set_ctrl (m, j, hash_h2 (hash));
+  slot = slot_at (m, j);
+  *slot_hash (slot) = hash;
+  *slot_key (slot) = edgex_intern (key);
+  memcpy (slot_value (slot), value, vsize);
+  m->size++;
   return 0;
-  fail:
-  if (node)
-  { free (node); }
-  return -1;
 }
 
 void edgex_map_remove_ (edgex_map_base *m, const char *key)
 {
-  edgex_map_node **next = edgex_map_getref (m, key);
-  if (next)
+  int i;
+  if (m->size == 0)
+  {
+    return;
+  }
+  i = find_slot (m, key, edgex_hash (key, strlen (key)));
+  if (i >= 0)
   {
-    edgex_map_node *node = *next;
-    *next = (*next)->next;
-    free (node);
-    m->nnodes--;
+    edgex_intern_release (*slot_key (slot_at (m, i)));
+    set_ctrl (m, i, CTRL_DELETED);
+    m->size--;
+    m->deleted++;
   }
 }
 
 edgex_map_iter edgex_map_iter_ (void)
 {
   edgex_map_iter iter;
-  iter.bucketidx = -1;
-  iter.node = NULL;
+  iter.idx = 0;
   return iter;
 }
 
 const char *edgex_map_next_ (edgex_map_base *m, edgex_map_iter *iter)
 {
-  if (iter->node)
-  {
-    iter->node = iter->node->next;
-    if (iter->node == NULL)
-    { goto nextBucket; }
-  }
-  else
+  while (iter->idx < m->capacity)
   {
-    nextBucket:
-    do
+    unsigned i = iter->idx++;
+    if ((m->ctrl[i] & CTRL_EMPTY) == 0)
     {
-      if (++iter->bucketidx >= m->nbuckets)
-      {
-        return NULL;
-      }
-      iter->node = m->buckets[iter->bucketidx];
-    } while (iter->node == NULL);
+      return *slot_key (slot_at (m, i));
+    }
   }
-  return (char *) (iter->node + 1);
+  return NULL;
 }
@@ -1,7 +1,7 @@
 #ifndef _EDGEX_DEVICE_MAP_H_
 #define _EDGEX_DEVICE_MAP_H_ 1
 
-/* Based on rxi's type-safe hashmap implementation */
+/* Type-safe API based on rxi's hashmap implementation */
 
 /**
  * Copyright (c) 2014 rxi
@@ -10,20 +10,30 @@
  * under the terms of the MIT license. See LICENSE for details.
  */
 
-struct edgex_map_node;
-typedef struct edgex_map_node edgex_map_node;
+/* The implementation is an open-addressing table in the style of SwissTable.
+ * A control byte per slot holds seven bits of the key's hash, or marks the
+ * slot as empty or deleted; lookups test a group of control bytes at a time.
+ *
+ * Keys are interned, so lookups with an interned key usually avoid a string
+ * comparison. Pointers returned by edgex_map_get are valid until the next
+ * call to edgex_map_set. Entries may be removed during iteration.
+ */
+
+#include <stdint.h>
 
 typedef struct
 {
-  edgex_map_node **buckets;
-  unsigned nbuckets;
-  unsigned nnodes;
+  uint8_t *ctrl;
+  char *slots;
+  unsigned capacity;
+  unsigned size;
+  unsigned deleted;
+  unsigned stride;
 } edgex_map_base;
 
 typedef struct
 {
-  unsigned bucketidx;
-  edgex_map_node *node;
+  unsigned idx;
 } edgex_map_iter;
 
 #define edgex_map(T) \
@@ -50,6 +60,8 @@ struct \
 
 #define edgex_map_next(m, iter) edgex_map_next_ (&(m)->base, iter)
 
+#define edgex_map_size(m) ((m)->base.size)
+
 extern void edgex_map_deinit_ (edgex_map_base *m);
 
 extern void *edgex_map_get_ (edgex_map_base *m, const char *key);
@@ -61,6 +73,13 @@ extern void edgex_map_remove_ (edgex_map_base *m, const char *key);
 
 extern edgex_map_iter edgex_map_iter_ (void);
 
+/* The hash function used by the map. The low-order bits are used to place
+ * keys within a map, so callers partitioning keys between maps should use
+ * the high-order bits.
+ */
+
+extern uint64_t edgex_map_hash (const char *key);
+
 extern const char *edgex_map_next_ (edgex_map_base *m, edgex_map_iter *iter);
 
 typedef edgex_map(void*) edgex_map_void;
@@ -262,19 +262,41 @@ char *edgex_metadata_client_create_deviceservice
   return ctx.buff;
 }
 
-edgex_device *edgex_metadata_client_get_devices
+/* The context for a device list request. The edgex_ctx must come first, as
+ * it is what is passed to the write callback.
+ */
+
+typedef struct devices_ctx
+{
+  edgex_ctx ctx;
+  edgex_devices_parser *parser;
+} devices_ctx;
+
+static size_t devices_write_cb (void *contents, size_t size, size_t nmemb, void *userp)
+{
+  devices_ctx *dc = (devices_ctx *) userp;
+  size *= nmemb;
+  edgex_devices_parser_feed (dc->parser, contents, size);
+  return size;
+}
+
+unsigned edgex_metadata_client_get_devices
 (
   iot_logger_t *lc,
   edgex_service_endpoints *endpoints,
   const char *servicename,
+  unsigned batchsize,
+  edgex_devices_cb fn,
+  void *fnctx,
   devsdk_error *err
 )
 {
-  edgex_ctx ctx;
-  edgex_device *result = 0;
+  devices_ctx dc;
+  unsigned result;
+  devsdk_error perr = EDGEX_OK;
   char url[URL_BUF_SIZE];
 
-  memset (&ctx, 0, sizeof (edgex_ctx));
+  memset (&dc, 0, sizeof (devices_ctx));
   snprintf
   (
     url,
@@ -285,17 +307,14 @@ edgex_device *edgex_metadata_client_get_devices
     servicename
   );
 
-  edgex_http_get (lc, &ctx, url, edgex_http_write_cb, err);
-
-  if (err->code)
+  dc.parser = edgex_devices_parser_alloc (lc, batchsize, fn, fnctx);
+  edgex_http_get (lc, &dc.ctx, url, devices_write_cb, err);
+  result = edgex_devices_parser_finish (dc.parser, &perr);
+  if (err->code == 0 && perr.code)
   {
-    return 0;
+    *err = perr;
   }
-
-  result = edgex_devices_read (lc, ctx.buff);
-  free (ctx.buff);
-  *err = EDGEX_OK;
-  return result;
+  return err->code ? 0 : result;
 }
 
 char *edgex_metadata_client_add_device
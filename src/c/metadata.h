@@ -13,6 +13,7 @@
 #include "devsdk/devsdk-base.h"
 #include "iot/logger.h"
 #include "parson.h"
+#include "edgex-rest.h"
 
 typedef struct edgex_service_endpoints edgex_service_endpoints;
 
@@ -73,11 +74,18 @@ char * edgex_metadata_client_create_deviceservice
   const edgex_deviceservice * newds,
   devsdk_error *err
 );
-edgex_device * edgex_metadata_client_get_devices
+/* Devices are passed to fn in batches as they are received. Returns the
+ * number of devices read. If the response cannot be parsed, err is set to
+ * EDGEX_DEVICES_PARSE_ERROR; some devices may already have been passed to fn.
+ */
+unsigned edgex_metadata_client_get_devices
 (
   iot_logger_t *lc,
   edgex_service_endpoints * endpoints,
   const char * servicename,
+  unsigned batchsize,
+  edgex_devices_cb fn,
+  void * fnctx,
   devsdk_error *err
 );
 char * edgex_metadata_client_add_device
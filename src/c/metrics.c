@@ -9,6 +9,7 @@
 #include "metrics.h"
 #include "parson.h"
 #include "service.h"
+#include "intern.h"
 #include "iot/time.h"
 
 #include <sys/time.h>
@@ -57,6 +58,16 @@ int edgex_device_handler_metrics
   }
 #endif
 
+  edgex_intern_stats istats;
+  JSON_Value *nameval = json_value_init_object ();
+  JSON_Object *nameobj = json_value_get_object (nameval);
+
+  edgex_intern_getstats (&istats);
+  json_object_set_uint (nameobj, "Count", istats.strings);
+  json_object_set_uint (nameobj, "Bytes", istats.bytes);
+  json_object_set_number
+    (nameobj, "HitRatio", istats.lookups ? (double)istats.hits / istats.lookups : 0.0);
+  json_object_set_value (obj, "Names", nameval);
 
   if (getrusage (RUSAGE_SELF, &rstats) == 0)
   {
@@ -66,6 +77,41 @@ int edgex_device_handler_metrics
     json_object_set_number (obj, "CpuTime", cputime);
     json_object_set_number (obj, "CpuAvgUsage", cputime / walltime);
   }
+
+  if (svc->admission)
+  {
+    edgex_admission_stats stats;
+    JSON_Value *cmdval = json_value_init_object ();
+    JSON_Object *cmdobj = json_value_get_object (cmdval);
+
+    edgex_admission_getstats (svc->admission, &stats);
+    json_object_set_uint (cmdobj, "Admitted", stats.admitted);
+    json_object_set_uint (cmdobj, "Queued", stats.queued);
+    json_object_set_uint (cmdobj, "Shed", stats.shed);
+    json_object_set_uint (cmdobj, "InFlight", stats.inflight);
+    json_object_set_uint (cmdobj, "Waiting", stats.waiting);
+    json_object_set_value (obj, "Commands", cmdval);
+  }
+
+  json_object_set_value (obj, "AutoEvents", edgex_autoevents_metrics (svc->autoevents));
+  json_object_set_uint (obj, "LogsSuppressed", edgex_ratelog_suppressed (svc->ratelog));
+
+  if (svc->pools[0])
+  {
+    JSON_Value *poolval = json_value_init_object ();
+    JSON_Object *poolobj = json_value_get_object (poolval);
+    for (unsigned c = 0; c < EDGEX_WORK_NCLASSES; c++)
+    {
+      json_object_set_value (poolobj, edgex_workclass_names[c], edgex_workpool_metrics (svc->pools[c]));
+    }
+    json_object_set_value (obj, "WorkPools", poolval);
+  }
+
+  if (svc->daemon)
+  {
+    json_object_set_value (obj, "Routes", edgex_rest_server_metrics (svc->daemon));
+  }
+
   *reply = json_serialize_to_string (val);
   *reply_size = strlen (*reply);
   *reply_type = "application/json";
@@ -14,6 +14,7 @@
 #include "edgex-rest.h"
 #include "iot/time.h"
 #include "errorlist.h"
+#include "aggregate.h"
 
 #include <dirent.h>
 #include <errno.h>
@@ -48,6 +49,54 @@ static bool need_vds (devsdk_service_t *svc)
   return result;
 }
 
+static void generate_value_descriptor
+(
+  devsdk_service_t *svc,
+  const edgex_deviceresource *res,
+  const char *name,
+  iot_data_type_t pt,
+  bool own,
+  uint64_t timenow
+)
+{
+  edgex_propertyvalue *pv = res->properties->value;
+  edgex_units *units = res->properties->units;
+  char type[2];
+  edgex_valuedescriptor *vd;
+  devsdk_error err;
+  iot_logger_t *lc = svc->logger;
+
+  type[0] = edgex_propertytype_tostring (pt)[0];
+  type[1] = '\0';
+  vd = edgex_data_client_add_valuedescriptor
+  (
+    lc,
+    &svc->config.endpoints,
+    name,
+    timenow,
+    own ? pv->minimum : "",
+    own ? pv->maximum : "",
+    type,
+    units->defaultvalue,
+    own ? pv->defaultvalue : "",
+    "%s",
+    res->description,
+    pv->mediaType,
+    pv->floatAsBinary ? "base64" : "eNotation",
+    &err
+  );
+  if (err.code)
+  {
+    iot_log_error (lc, "Unable to create ValueDescriptor for %s", name);
+  }
+  edgex_valuedescriptor_free (vd);
+}
+
+/* Aggregated resources (see aggregate.h) also have a descriptor for each of
+ * their aggregate readings. The resource's minimum, maximum and default
+ * apply to aggregates other than stddev and count.
+ */
+
 static void generate_value_descriptors
 (
   devsdk_service_t *svc,
@@ -58,37 +107,24 @@ static void generate_value_descriptors
 
   for (edgex_deviceresource *res = dp->device_resources; res; res = res->next)
   {
-    edgex_propertyvalue *pv = res->properties->value;
-    edgex_units *units = res->properties->units;
-    char type[2];
-    edgex_valuedescriptor *vd;
-    devsdk_error err;
-    iot_logger_t *lc = svc->logger;
-
-    type[0] = edgex_propertytype_tostring (pv->type)[0];
-    type[1] = '\0';
-    vd = edgex_data_client_add_valuedescriptor
-    (
-      lc,
-      &svc->config.endpoints,
-      res->name,
-      timenow,
-      pv->minimum,
-      pv->maximum,
-      type,
-      units->defaultvalue,
-      pv->defaultvalue,
-      "%s",
-      res->description,
-      pv->mediaType,
-      pv->floatAsBinary ? "base64" : "eNotation",
-      &err
-    );
-    if (err.code)
+    iot_data_type_t pt = res->properties->value->type;
+    unsigned aggs = edgex_aggregates_for ((const devsdk_nvpairs *) res->attributes, pt);
+
+    generate_value_descriptor (svc, res, res->name, pt, true, timenow);
+    for (unsigned agg = 0; agg < EDGEX_AGG_NTYPES; agg++)
     {
-      iot_log_error (lc, "Unable to create ValueDescriptor for %s", res->name);
+      if (aggs & (1u << agg))
+      {
+        char *name = malloc (strlen (res->name) + strlen (edgex_aggregate_names[agg]) + 2);
+        sprintf (name, "%s_%s", res->name, edgex_aggregate_names[agg]);
+        generate_value_descriptor
+        (
+          svc, res, name, edgex_aggregate_type (agg, pt),
+          agg != EDGEX_AGG_STDDEV && agg != EDGEX_AGG_COUNT, timenow
+        );
+        free (name);
+      }
     }
-    edgex_valuedescriptor_free (vd);
   }
 }
 
@@ -115,12 +151,53 @@ static const edgex_deviceprofile *edgex_deviceprofile_get_internal
   return dp;
 }
 
+/* Profiles are uploaded in parallel on the service's thread pool. The first
+ * error encountered is reported.
+ */
+
+typedef struct upload_state
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned pending;
+  devsdk_error err;
+} upload_state;
+
+typedef struct upload_job
+{
+  devsdk_service_t *svc;
+  upload_state *state;
+  char pathname[MAX_PATH_SIZE];
+} upload_job;
+
+static void *upload_profile (void *p)
+{
+  upload_job *job = (upload_job *) p;
+  upload_state *state = job->state;
+  devsdk_error err = EDGEX_OK;
+
+  edgex_add_profile (job->svc, job->pathname, &err);
+
+  pthread_mutex_lock (&state->lock);
+  if (err.code && state->err.code == 0)
+  {
+    state->err = err;
+  }
+  if (--state->pending == 0)
+  {
+    pthread_cond_signal (&state->cond);
+  }
+  pthread_mutex_unlock (&state->lock);
+  free (job);
+  return NULL;
+}
+
 void edgex_device_profiles_upload (devsdk_service_t *svc, devsdk_error *err)
 {
   struct dirent **filenames = NULL;
   int n;
   char *fname;
-  char pathname[MAX_PATH_SIZE];
+  upload_state state;
   const char *profileDir = svc->config.device.profilesdir;
   iot_logger_t *lc = svc->logger;
 
@@ -142,24 +219,49 @@ void edgex_device_profiles_upload (devsdk_service_t *svc, devsdk_error *err)
 
   iot_log_info (lc, "Processing Device Profiles from %s", profileDir);
 
+  pthread_mutex_init (&state.lock, NULL);
+  pthread_cond_init (&state.cond, NULL);
+  state.pending = 1;
+  state.err = EDGEX_OK;
+
   while (n--)
   {
-    if (err->code == 0)
+    fname = filenames[n]->d_name;
+    upload_job *job = malloc (sizeof (upload_job));
+    if (snprintf (job->pathname, MAX_PATH_SIZE, "%s/%s", profileDir, fname) < MAX_PATH_SIZE)
     {
-      fname = filenames[n]->d_name;
-      if (snprintf (pathname, MAX_PATH_SIZE, "%s/%s", profileDir, fname) < MAX_PATH_SIZE)
-      {
-        edgex_add_profile (svc, pathname, err);
-      }
-      else
+      job->svc = svc;
+      job->state = &state;
+      pthread_mutex_lock (&state.lock);
+      state.pending++;
+      pthread_mutex_unlock (&state.lock);
+      iot_threadpool_add_work (svc->thpool, upload_profile, job, -1);
+    }
+    else
+    {
+      iot_log_error (lc, "%s: Pathname too long (max %d chars)", fname, MAX_PATH_SIZE - 1);
+      pthread_mutex_lock (&state.lock);
+      if (state.err.code == 0)
       {
-        iot_log_error (lc, "%s: Pathname too long (max %d chars)", fname, MAX_PATH_SIZE - 1);
-        *err = EDGEX_PROFILE_PARSE_ERROR;
+        state.err = EDGEX_PROFILE_PARSE_ERROR;
       }
+      pthread_mutex_unlock (&state.lock);
+      free (job);
     }
     free (filenames[n]);
   }
   free (filenames);
+
+  pthread_mutex_lock (&state.lock);
+  state.pending--;
+  while (state.pending)
+  {
+    pthread_cond_wait (&state.cond, &state.lock);
+  }
+  pthread_mutex_unlock (&state.lock);
+  pthread_cond_destroy (&state.cond);
+  pthread_mutex_destroy (&state.lock);
+  *err = state.err;
 }
 
 static char *getProfName (iot_logger_t *lc, const char *fname, devsdk_error *err)
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "ratelog.h"
+#include "map.h"
+#include "iot/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define RATELOG_SLOTS 256
+#define RATELOG_BUFSIZE 1024
+
+typedef struct
+{
+  uint64_t hash;
+  uint64_t start;
+  uint32_t count;
+  uint64_t suppressed;
+} edgex_ratelog_slot;
+
+struct edgex_ratelog
+{
+  pthread_mutex_t lock;
+  atomic_uint_fast32_t limit;
+  atomic_uint_fast64_t interval;
+  atomic_uint_fast64_t suppressed;
+  edgex_ratelog_slot slots[RATELOG_SLOTS];
+};
+
+edgex_ratelog *edgex_ratelog_alloc (void)
+{
+  edgex_ratelog *rl = calloc (1, sizeof (edgex_ratelog));
+  pthread_mutex_init (&rl->lock, NULL);
+  atomic_init (&rl->limit, 0);
+  atomic_init (&rl->interval, 0);
+  atomic_init (&rl->suppressed, 0);
+  return rl;
+}
+
+void edgex_ratelog_free (edgex_ratelog *rl)
+{
+  if (rl)
+  {
+    pthread_mutex_destroy (&rl->lock);
+    free (rl);
+  }
+}
+
+void edgex_ratelog_configure (edgex_ratelog *rl, uint32_t limit, uint32_t interval)
+{
+  atomic_store (&rl->interval, (uint64_t) (interval ? interval : 10) * 1000000000);
+  atomic_store (&rl->limit, limit);
+}
+
+uint64_t edgex_ratelog_suppressed (edgex_ratelog *rl)
+{
+  return atomic_load (&rl->suppressed);
+}
+
+bool edgex_log_enabled (const iot_logger_t *lc, iot_loglevel_t level)
+{
+  for (; lc; lc = lc->next)
+  {
+    if (lc->level >= level)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Count a message for a key. Returns false if it is to be suppressed;
+ * otherwise *suppressed is set to the number of messages suppressed for the
+ * key since the last one logged.
+ */
+
+static bool ratelog_admit (edgex_ratelog *rl, const char *fmt, const char *key, uint64_t *suppressed)
+{
+  uint32_t limit = atomic_load (&rl->limit);
+  uint64_t hash;
+  uint64_t now;
+  edgex_ratelog_slot *s;
+  bool result = true;
+
+  *suppressed = 0;
+  if (limit == 0)
+  {
+    return true;
+  }
+  hash = edgex_map_hash (key ? key : "") ^ ((uintptr_t) fmt * 0x9e3779b97f4a7c15ULL);
+  now = iot_time_nsecs ();
+  s = &rl->slots[hash % RATELOG_SLOTS];
+
+  pthread_mutex_lock (&rl->lock);
+  if (s->hash != hash || now - s->start >= atomic_load (&rl->interval))
+  {
+    if (s->hash != hash)
+    {
+      s->hash = hash;
+      s->suppressed = 0;
+    }
+    s->start = now;
+    s->count = 0;
+  }
+  if (s->count < limit)
+  {
+    s->count++;
+    *suppressed = s->suppressed;
+    s->suppressed = 0;
+  }
+  else
+  {
+    s->suppressed++;
+    result = false;
+  }
+  pthread_mutex_unlock (&rl->lock);
+
+  if (!result)
+  {
+    atomic_fetch_add (&rl->suppressed, 1);
+  }
+  return result;
+}
+
+/* Messages are formatted into a stack buffer, or into a heap buffer of the
+ * exact size if they do not fit.
+ */
+
+void edgex_log_limited
+(
+  iot_logger_t *lc,
+  edgex_ratelog *rl,
+  iot_loglevel_t level,
+  const char *key,
+  const char *fmt,
+  ...
+)
+{
+  char buf[RATELOG_BUFSIZE];
+  char sfx[64] = "";
+  char *msg = buf;
+  uint64_t suppressed;
+  va_list args;
+  int len;
+
+  if (!edgex_log_enabled (lc, level) || !ratelog_admit (rl, fmt, key, &suppressed))
+  {
+    return;
+  }
+
+  va_start (args, fmt);
+  len = vsnprintf (buf, sizeof (buf), fmt, args);
+  va_end (args);
+  if (len < 0)
+  {
+    msg = (char *) fmt;
+  }
+  else if ((size_t) len >= sizeof (buf))
+  {
+    char *big = malloc ((size_t) len + 1);
+    if (big)
+    {
+      va_start (args, fmt);
+      vsnprintf (big, (size_t) len + 1, fmt, args);
+      va_end (args);
+      msg = big;
+    }
+  }
+  if (suppressed)
+  {
+    snprintf (sfx, sizeof (sfx), " (%" PRIu64 " similar messages suppressed)", suppressed);
+  }
+
+  switch (level)
+  {
+    case IOT_LOG_ERROR: iot_log_error (lc, "%s%s", msg, sfx); break;
+    case IOT_LOG_WARN: iot_log_warn (lc, "%s%s", msg, sfx); break;
+    case IOT_LOG_INFO: iot_log_info (lc, "%s%s", msg, sfx); break;
+    case IOT_LOG_DEBUG: iot_log_debug (lc, "%s%s", msg, sfx); break;
+    default: iot_log_trace (lc, "%s%s", msg, sfx); break;
+  }
+  if (msg != buf && msg != fmt)
+  {
+    free (msg);
+  }
+}
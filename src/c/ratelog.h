@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_RATELOG_H_
+#define _EDGEX_DEVICE_RATELOG_H_ 1
+
+/* Rate-limited logging for messages which may be generated at high rates,
+ * such as those for AutoEvent readings and device commands. Messages are
+ * counted per key, which is the combination of the format string and a key
+ * string (typically a device name). At most limit messages are logged per
+ * key in each interval; further ones are counted, and the count is appended
+ * to the next message which is logged for the key. A limit of zero disables
+ * rate limiting.
+ *
+ * Keys are held in a fixed-size table, and keys which collide share a count.
+ */
+
+#include "iot/logger.h"
+
+#include <stdint.h>
+
+struct edgex_ratelog;
+typedef struct edgex_ratelog edgex_ratelog;
+
+extern edgex_ratelog *edgex_ratelog_alloc (void);
+extern void edgex_ratelog_free (edgex_ratelog *rl);
+
+/* Set the limit, as a number of messages per key per interval (in seconds) */
+
+extern void edgex_ratelog_configure (edgex_ratelog *rl, uint32_t limit, uint32_t interval);
+
+/* The total number of messages suppressed */
+
+extern uint64_t edgex_ratelog_suppressed (edgex_ratelog *rl);
+
+/* Returns true if messages at the given level would be logged by any of the
+ * loggers in the chain. This is cheap, and may be used to avoid preparing
+ * arguments for messages which would be discarded.
+ */
+
+extern bool edgex_log_enabled (const iot_logger_t *lc, iot_loglevel_t level);
+
+/* Log a message subject to rate limiting. Nothing is formatted unless the
+ * level is enabled and the key is within its limit.
+ */
+
+extern void edgex_log_limited
+(
+  iot_logger_t *lc,
+  edgex_ratelog *rl,
+  iot_loglevel_t level,
+  const char *key,
+  const char *fmt,
+  ...
+);
+
+#endif
@@ -11,13 +11,31 @@
 #include "microhttpd.h"
 #include "correlation.h"
 #include "errorlist.h"
+#include "histogram.h"
 
 #include <string.h>
+#include <strings.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <zlib.h>
 
 #define STR_BLK_SIZE 512
 #define EDGEX_DS_PREFIX "ds-"
+#define EDGEX_RETRY_AFTER "1"
+#define EDGEX_ZBLOCK_SIZE 16384
+#define EDGEX_GZIP_WBITS (MAX_WBITS + 16)
+#define EDGEX_STATUS_MIN 100
+#define EDGEX_STATUS_MAX 599
+
+typedef struct route_stats
+{
+  atomic_uint_fast32_t inflight;
+  atomic_uint_fast64_t status[EDGEX_STATUS_MAX - EDGEX_STATUS_MIN + 1];
+  edgex_histogram_t *latency;
+} route_stats;
 
 typedef struct handler_list
 {
@@ -25,6 +43,7 @@ typedef struct handler_list
   uint32_t methods;
   void *ctx;
   http_method_handler_fn handler;
+  route_stats stats;
   struct handler_list *next;
 } handler_list;
 
@@ -34,14 +53,128 @@ struct edgex_rest_server
   struct MHD_Daemon *daemon;
   handler_list *handlers;
   pthread_mutex_t lock;
+  uint32_t zminsize;
+  uint64_t maxsize;
 };
 
+/* Upload data is copied into a buffer preallocated from the Content-Length
+ * header if present. As the header is supplied by the client, at most
+ * PREALLOC_MAX bytes are reserved before any data arrives. Data beyond the
+ * buffer (or all of it, if there is no Content-Length) is held in a list of
+ * chunks which is joined once the upload completes.
+ */
+
+#define PREALLOC_MAX 65536
+
+typedef struct http_chunk_s
+{
+  struct http_chunk_s *next;
+  size_t size;
+  char data[];
+} http_chunk_t;
+
 typedef struct http_context_s
 {
   char *m_data;
   size_t m_size;
+  size_t m_cap;
+  http_chunk_t *m_chunks;
+  http_chunk_t **m_tail;
+  bool m_toolarge;
+  uint64_t m_start;
 } http_context_t;
 
+typedef enum { ENC_IDENTITY, ENC_GZIP, ENC_DEFLATE } http_encoding_t;
+
+typedef struct http_zstream_s
+{
+  z_stream zs;
+  void *reply;
+  bool done;
+} http_zstream_t;
+
+static _Thread_local struct MHD_Connection *currentconn = NULL;
+
+const char *edgex_rest_server_request_header (const char *name)
+{
+  return currentconn ?
+    MHD_lookup_connection_value (currentconn, MHD_HEADER_KIND, name) : NULL;
+}
+
+static uint64_t mono_usecs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void upload_append (http_context_t *ctx, const char *data, size_t size)
+{
+  if (ctx->m_chunks == NULL && ctx->m_size + size <= ctx->m_cap)
+  {
+    memcpy (ctx->m_data + ctx->m_size, data, size);
+  }
+  else
+  {
+    http_chunk_t *chunk = malloc (sizeof (http_chunk_t) + size);
+    chunk->next = NULL;
+    chunk->size = size;
+    memcpy (chunk->data, data, size);
+    *ctx->m_tail = chunk;
+    ctx->m_tail = &chunk->next;
+  }
+  ctx->m_size += size;
+}
+
+static void upload_complete (http_context_t *ctx)
+{
+  if (ctx->m_chunks)
+  {
+    size_t fill = ctx->m_size;
+    for (http_chunk_t *c = ctx->m_chunks; c; c = c->next)
+    {
+      fill -= c->size;
+    }
+    ctx->m_data = realloc (ctx->m_data, ctx->m_size + 1);
+    while (ctx->m_chunks)
+    {
+      http_chunk_t *c = ctx->m_chunks;
+      memcpy (ctx->m_data + fill, c->data, c->size);
+      fill += c->size;
+      ctx->m_chunks = c->next;
+      free (c);
+    }
+    ctx->m_tail = &ctx->m_chunks;
+  }
+  if (ctx->m_data)
+  {
+    ctx->m_data[ctx->m_size] = '\0';
+  }
+}
+
+static void http_completed
+(
+  void *this,
+  struct MHD_Connection *conn,
+  void **context,
+  enum MHD_RequestTerminationCode toe
+)
+{
+  http_context_t *ctx = (http_context_t *) *context;
+  if (ctx)
+  {
+    while (ctx->m_chunks)
+    {
+      http_chunk_t *c = ctx->m_chunks;
+      ctx->m_chunks = c->next;
+      free (c);
+    }
+    free (ctx->m_data);
+    free (ctx);
+    *context = NULL;
+  }
+}
+
 static edgex_http_method method_from_string (const char *str)
 {
   if (strcmp (str, "GET") == 0)
@@ -91,6 +224,142 @@ static int queryIterator (void *p, enum MHD_ValueKind kind, const char *key, con
   return MHD_YES;
 }
 
+/* Choose a content-coding from an Accept-Encoding header, following RFC 9110
+ * section 12.5.3: a coding named explicitly takes its quality value from that
+ * entry, otherwise from any "*" entry, and a quality value of zero means not
+ * acceptable. Of the acceptable codings, gzip is preferred.
+ */
+
+static http_encoding_t accept_encoding (const char *hdr)
+{
+  double gzip = -1.0;
+  double deflate = -1.0;
+  double any = -1.0;
+
+  while (hdr && *hdr)
+  {
+    size_t len;
+    const char *params;
+    double qval = 1.0;
+    const char *end = strchr (hdr, ',');
+    if (end == NULL)
+    {
+      end = hdr + strlen (hdr);
+    }
+    while (*hdr == ' ' || *hdr == '\t')
+    {
+      hdr++;
+    }
+    len = strcspn (hdr, " \t;,");
+    params = memchr (hdr, ';', end - hdr);
+    while (params)
+    {
+      params++;
+      while (*params == ' ' || *params == '\t')
+      {
+        params++;
+      }
+      if (strncasecmp (params, "q=", 2) == 0)
+      {
+        qval = strtod (params + 2, NULL);
+        break;
+      }
+      params = memchr (params, ';', end - params);
+    }
+    if (len == 4 && strncasecmp (hdr, "gzip", 4) == 0)
+    {
+      gzip = qval;
+    }
+    else if (len == 7 && strncasecmp (hdr, "deflate", 7) == 0)
+    {
+      deflate = qval;
+    }
+    else if (len == 1 && *hdr == '*')
+    {
+      any = qval;
+    }
+    hdr = *end ? end + 1 : end;
+  }
+  if (gzip < 0.0)
+  {
+    gzip = any;
+  }
+  if (deflate < 0.0)
+  {
+    deflate = any;
+  }
+  return (gzip > 0.0) ? ENC_GZIP : (deflate > 0.0) ? ENC_DEFLATE : ENC_IDENTITY;
+}
+
+static ssize_t zstream_reader (void *cls, uint64_t pos, char *buf, size_t max)
+{
+  http_zstream_t *z = (http_zstream_t *) cls;
+
+  if (z->done)
+  {
+    return MHD_CONTENT_READER_END_OF_STREAM;
+  }
+  z->zs.next_out = (Bytef *) buf;
+  z->zs.avail_out = max;
+  switch (deflate (&z->zs, Z_FINISH))
+  {
+    case Z_STREAM_END:
+      z->done = true;
+      break;
+    case Z_OK:
+    case Z_BUF_ERROR:
+      break;
+    default:
+      return MHD_CONTENT_READER_END_WITH_ERROR;
+  }
+  return max - z->zs.avail_out;
+}
+
+static void zstream_free (void *cls)
+{
+  http_zstream_t *z = (http_zstream_t *) cls;
+  deflateEnd (&z->zs);
+  free (z->reply);
+  free (z);
+}
+
+/* Create a chunked response which compresses the reply as it is sent.
+ * Returns NULL if the compressor cannot be initialized.
+ */
+
+static struct MHD_Response *compressed_response
+  (void *reply, size_t reply_size, http_encoding_t enc)
+{
+  struct MHD_Response *response;
+  http_zstream_t *z = calloc (1, sizeof (http_zstream_t));
+
+  if
+  (
+    deflateInit2
+      (&z->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, enc == ENC_GZIP ? EDGEX_GZIP_WBITS : MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK
+  )
+  {
+    free (z);
+    return NULL;
+  }
+  z->reply = reply;
+  z->zs.next_in = (Bytef *) reply;
+  z->zs.avail_in = reply_size;
+  response = MHD_create_response_from_callback
+    (MHD_SIZE_UNKNOWN, EDGEX_ZBLOCK_SIZE, zstream_reader, z, zstream_free);
+  if (response)
+  {
+    MHD_add_response_header
+      (response, MHD_HTTP_HEADER_CONTENT_ENCODING, enc == ENC_GZIP ? "gzip" : "deflate");
+  }
+  else
+  {
+    deflateEnd (&z->zs);
+    free (z);
+  }
+  return response;
+}
+
 static int http_handler
 (
   void *this,
@@ -110,15 +379,37 @@ static int http_handler
   void *reply = NULL;
   size_t reply_size = 0;
   const char *reply_type = NULL;
-  handler_list *h;
+  handler_list *h = NULL;
 
   /* First call used to create call context */
 
   if (ctx == 0)
   {
-    ctx = (http_context_t *) malloc (sizeof (*ctx));
-    ctx->m_size = 0;
-    ctx->m_data = NULL;
+    const char *clen = MHD_lookup_connection_value
+      (conn, MHD_HEADER_KIND, MHD_HTTP_HEADER_CONTENT_LENGTH);
+    uint64_t expected = clen ? strtoull (clen, NULL, 10) : 0;
+
+    /* Reject oversized requests before the body is read */
+
+    if (svr->maxsize && expected > svr->maxsize)
+    {
+      iot_log_error
+        (svr->lc, "Request size %" PRIu64 " exceeds limit of %" PRIu64, expected, svr->maxsize);
+      response = MHD_create_response_from_buffer (0, "", MHD_RESPMEM_PERSISTENT);
+      MHD_queue_response (conn, MHD_HTTP_PAYLOAD_TOO_LARGE, response);
+      MHD_destroy_response (response);
+      return MHD_YES;
+    }
+
+    ctx = (http_context_t *) calloc (1, sizeof (*ctx));
+    if (expected)
+    {
+      size_t cap = (expected < PREALLOC_MAX) ? expected : PREALLOC_MAX;
+      ctx->m_data = malloc (cap + 1);
+      ctx->m_cap = ctx->m_data ? cap : 0;
+    }
+    ctx->m_tail = &ctx->m_chunks;
+    ctx->m_start = mono_usecs ();
     *context = (void *) ctx;
     return MHD_YES;
   }
@@ -127,23 +418,38 @@ static int http_handler
 
   if (*upload_data_size)
   {
-    ctx->m_data = (char *) realloc
-      (ctx->m_data, ctx->m_size + (*upload_data_size) + 1);
-    memcpy (ctx->m_data + ctx->m_size, upload_data, (*upload_data_size) + 1);
-    ctx->m_size += *upload_data_size;
+    if (!ctx->m_toolarge)
+    {
+      if (svr->maxsize && ctx->m_size + *upload_data_size > svr->maxsize)
+      {
+        /* Discard the remainder of the upload; we reply once it is done */
+        iot_log_error (svr->lc, "Request size exceeds limit of %" PRIu64, svr->maxsize);
+        ctx->m_toolarge = true;
+      }
+      else
+      {
+        upload_append (ctx, upload_data, *upload_data_size);
+      }
+    }
     *upload_data_size = 0;
     return MHD_YES;
   }
-  *context = 0;
 
   /* Last call with no data handles request */
 
+  upload_complete (ctx);
+
   edgex_device_alloc_crlid
     (MHD_lookup_connection_value (conn, MHD_HEADER_KIND, EDGEX_CRLID_HDR));
 
   edgex_http_method method = method_from_string (methodname);
 
-  if (strlen (url) == 0 || strcmp (url, "/") == 0)
+  if (ctx->m_toolarge)
+  {
+    status = MHD_HTTP_PAYLOAD_TOO_LARGE;
+    h = NULL;
+  }
+  else if (strlen (url) == 0 || strcmp (url, "/") == 0)
   {
     if (method == GET)
     {
@@ -193,8 +499,12 @@ static int http_handler
       {
         devsdk_nvpairs *qparams = NULL;
         MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND, queryIterator, &qparams);
+        currentconn = conn;
+        atomic_fetch_add (&h->stats.inflight, 1);
         status = h->handler
           (h->ctx, nurl + strlen (h->url), qparams, method, ctx->m_data, ctx->m_size, &reply, &reply_size, &reply_type);
+        atomic_fetch_sub (&h->stats.inflight, 1);
+        currentconn = NULL;
         devsdk_nvpairs_free (qparams);
       }
       else
@@ -216,16 +526,44 @@ static int http_handler
     reply = strdup ("");
     reply_size = 0;
   }
-  response = MHD_create_response_from_buffer (reply_size, reply, MHD_RESPMEM_MUST_FREE);
+  if (svr->zminsize && reply_size >= svr->zminsize)
+  {
+    http_encoding_t enc = accept_encoding
+      (MHD_lookup_connection_value (conn, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING));
+    if (enc != ENC_IDENTITY)
+    {
+      response = compressed_response (reply, reply_size, enc);
+    }
+  }
+  if (response == NULL)
+  {
+    response = MHD_create_response_from_buffer (reply_size, reply, MHD_RESPMEM_MUST_FREE);
+  }
+  if (svr->zminsize)
+  {
+    MHD_add_response_header (response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  }
   MHD_add_response_header (response, "Content-Type", reply_type);
+  if (status == MHD_HTTP_TOO_MANY_REQUESTS || status == MHD_HTTP_SERVICE_UNAVAILABLE)
+  {
+    MHD_add_response_header (response, MHD_HTTP_HEADER_RETRY_AFTER, EDGEX_RETRY_AFTER);
+  }
   MHD_queue_response (conn, status, response);
   MHD_destroy_response (response);
 
-  /* Clean up */
+  /* Update route statistics */
+
+  if (h)
+  {
+    if (status >= EDGEX_STATUS_MIN && status <= EDGEX_STATUS_MAX)
+    {
+      atomic_fetch_add_explicit (&h->stats.status[status - EDGEX_STATUS_MIN], 1, memory_order_relaxed);
+    }
+    edgex_histogram_record (h->stats.latency, mono_usecs () - ctx->m_start);
+  }
+
+  /* Clean up. The request context is freed in http_completed */
 
-  if (ctx->m_data)
-  { free (ctx->m_data); }
-  free (ctx);
   edgex_device_free_crlid ();
   return MHD_YES;
 }
@@ -240,13 +578,15 @@ edgex_rest_server *edgex_rest_server_create
   svr = malloc (sizeof (edgex_rest_server));
   svr->lc = lc;
   svr->handlers = NULL;
+  svr->zminsize = 0;
+  svr->maxsize = 0;
   pthread_mutex_init (&svr->lock, NULL);
 
   /* Start http server */
 
   iot_log_debug (lc, "Starting HTTP server on port %d", port);
   svr->daemon =
-    MHD_start_daemon (flags, port, 0, 0, http_handler, svr, MHD_OPTION_END);
+    MHD_start_daemon (flags, port, 0, 0, http_handler, svr, MHD_OPTION_NOTIFY_COMPLETED, http_completed, svr, MHD_OPTION_END);
   if (svr->daemon == NULL)
   {
     *err = EDGEX_HTTP_SERVER_FAIL;
@@ -274,12 +614,57 @@ void edgex_rest_server_register_handler
   entry->url = url;
   entry->methods = methods;
   entry->ctx = context;
+  memset (&entry->stats, 0, sizeof (route_stats));
+  entry->stats.latency = edgex_histogram_alloc ();
   pthread_mutex_lock (&svr->lock);
   entry->next = svr->handlers;
   svr->handlers = entry;
   pthread_mutex_unlock (&svr->lock);
 }
 
+void edgex_rest_server_enable_compression
+  (edgex_rest_server *svr, uint32_t minsize)
+{
+  svr->zminsize = minsize;
+}
+
+void edgex_rest_server_set_maxsize (edgex_rest_server *svr, uint64_t maxsize)
+{
+  svr->maxsize = maxsize;
+}
+
+JSON_Value *edgex_rest_server_metrics (edgex_rest_server *svr)
+{
+  char code[4];
+  JSON_Value *val = json_value_init_object ();
+  JSON_Object *obj = json_value_get_object (val);
+
+  pthread_mutex_lock (&svr->lock);
+  for (handler_list *h = svr->handlers; h; h = h->next)
+  {
+    JSON_Value *rval = json_value_init_object ();
+    JSON_Object *robj = json_value_get_object (rval);
+    JSON_Value *sval = json_value_init_object ();
+    JSON_Object *sobj = json_value_get_object (sval);
+
+    for (int i = EDGEX_STATUS_MIN; i <= EDGEX_STATUS_MAX; i++)
+    {
+      uint64_t n = atomic_load_explicit (&h->stats.status[i - EDGEX_STATUS_MIN], memory_order_relaxed);
+      if (n)
+      {
+        sprintf (code, "%d", i);
+        json_object_set_uint (sobj, code, n);
+      }
+    }
+    json_object_set_value (robj, "Requests", sval);
+    json_object_set_uint (robj, "InFlight", atomic_load (&h->stats.inflight));
+    json_object_set_value (robj, "Latency", edgex_histogram_summary (h->stats.latency));
+    json_object_set_value (obj, h->url, rval);
+  }
+  pthread_mutex_unlock (&svr->lock);
+  return val;
+}
+
 void edgex_rest_server_destroy (edgex_rest_server *svr)
 {
   handler_list *tmp;
@@ -290,6 +675,7 @@ void edgex_rest_server_destroy (edgex_rest_server *svr)
   while (svr->handlers)
   {
     tmp = svr->handlers->next;
+    edgex_histogram_free (svr->handlers->stats.latency);
     free (svr->handlers);
     svr->handlers = tmp;
   }
@@ -11,6 +11,7 @@
 
 #include "devsdk/devsdk-base.h"
 #include "iot/logger.h"
+#include "parson.h"
 
 struct edgex_rest_server;
 typedef struct edgex_rest_server edgex_rest_server;
@@ -50,6 +51,37 @@ extern void edgex_rest_server_register_handler
   http_method_handler_fn handler
 );
 
+/*
+ * Replies of at least minsize bytes are compressed if the client accepts gzip
+ * or deflate encoding. A minsize of zero disables compression.
+ */
+
+extern void edgex_rest_server_enable_compression
+  (edgex_rest_server *svr, uint32_t minsize);
+
+/*
+ * Requests with bodies larger than maxsize bytes are rejected with status 413.
+ * A maxsize of zero means no limit.
+ */
+
+extern void edgex_rest_server_set_maxsize
+  (edgex_rest_server *svr, uint64_t maxsize);
+
+/*
+ * For use within a handler: returns the value of the named header in the
+ * request being processed, or NULL if it is not present.
+ */
+
+extern const char *edgex_rest_server_request_header (const char *name);
+
+/*
+ * Returns a JSON object giving, for each registered route, request counts by
+ * status, the number of requests in progress and a latency summary in
+ * microseconds.
+ */
+
+extern JSON_Value *edgex_rest_server_metrics (edgex_rest_server *svr);
+
 extern void edgex_rest_server_destroy (edgex_rest_server *svr);
 
 #endif
@@ -52,8 +52,8 @@ static struct curl_slist *edgex_add_hdr (struct curl_slist *slist, const char *n
 
 static struct curl_slist *edgex_add_crlid_hdr (struct curl_slist *slist)
 {
-  const char *id = edgex_device_get_crlid ();
-  return id ? edgex_add_hdr (slist, EDGEX_CRLID_HDR, id) : slist;
+  const char *hdr = edgex_device_get_crlid_hdr ();
+  return hdr ? curl_slist_append (slist, hdr) : slist;
 }
 
 /* Populate request headers from a list */
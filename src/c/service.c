@@ -18,12 +18,14 @@
 #include "data.h"
 #include "rest.h"
 #include "edgex-rest.h"
+#include "cache.h"
 #include "iot/time.h"
 #include "iot/iot.h"
 #include "edgex/csdk-defs.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <dirent.h>
 #include <sys/utsname.h>
@@ -211,9 +213,10 @@ devsdk_service_t *devsdk_service_new
   result->userfns = implfns;
   result->devices = edgex_devmap_alloc (result);
   result->watchlist = edgex_watchlist_alloc ();
+  result->autoevents = edgex_autoevents_alloc ();
+  result->ratelog = edgex_ratelog_alloc ();
   result->logger = iot_logger_alloc_custom (result->name, IOT_LOG_TRACE, "-", edgex_log_tofile, NULL, true);
   result->thpool = iot_threadpool_alloc (POOL_THREADS, 0, -1, -1, result->logger);
-  result->scheduler = iot_scheduler_alloc (-1, -1, result->logger);
   pthread_mutex_init (&result->discolock, NULL);
   return result;
 }
@@ -301,30 +304,34 @@ static bool ping_client
   return false;
 }
 
-static void startConfigured (devsdk_service_t *svc, toml_table_t *config, devsdk_error *err)
+/* Devices are read from metadata in batches, each inserted into the map as
+ * it is completed.
+ */
+
+#define DEVICE_LOAD_BATCH 256
+
+static void populate_devices (void *ctx, const edgex_device *devs)
 {
-  char *myhost;
-  struct utsname buffer;
+  edgex_devmap_populate_devices ((edgex_devmap_t *) ctx, devs);
+}
 
-  if (svc->config.service.host)
-  {
-    myhost = svc->config.service.host;
-  }
-  else
-  {
-    uname (&buffer);
-    myhost = buffer.nodename;
-  }
+static uint64_t startup_phase (devsdk_service_t *svc, const char *name, uint64_t start)
+{
+  uint64_t now = iot_time_msecs ();
+  iot_log_info (svc->logger, "Startup: %s took %" PRIu64 "ms", name, now - start);
+  return now;
+}
 
-  svc->adminstate = UNLOCKED;
-  svc->opstate = ENABLED;
+/* Register the service in metadata, upload profiles and obtain the device
+ * list. When reconciling, the device map already holds the devices from the
+ * cache file, and is brought up to date rather than populated.
+ */
 
-  /* Wait for metadata and data to be available */
+static void sync_metadata (devsdk_service_t *svc, const char *myhost, bool reconcile, devsdk_error *err)
+{
+  unsigned ndevs;
+  uint64_t phase = iot_time_msecs ();
 
-  if (!ping_client (svc->logger, "core-data", &svc->config.endpoints.data, svc->config.service.connectretries, svc->config.service.timeout, err))
-  {
-    return;
-  }
   if (!ping_client (svc->logger, "core-metadata", &svc->config.endpoints.metadata, svc->config.service.connectretries, svc->config.service.timeout, err))
   {
     return;
@@ -416,6 +423,8 @@ static void startConfigured (devsdk_service_t *svc, toml_table_t *config, devsdk
   }
   edgex_deviceservice_free (ds);
 
+  phase = startup_phase (svc, "service registration", phase);
+
   /* Load DeviceProfiles from files and register in metadata */
 
   edgex_device_profiles_upload (svc, err);
@@ -424,19 +433,108 @@ static void startConfigured (devsdk_service_t *svc, toml_table_t *config, devsdk
     return;
   }
 
+  phase = startup_phase (svc, "profile upload", phase);
+
   /* Obtain Devices from metadata */
 
-  edgex_device *devs = edgex_metadata_client_get_devices
-    (svc->logger, &svc->config.endpoints, svc->name, err);
+  if (reconcile)
+  {
+    ndevs = edgex_cache_reconcile (svc, err);
+  }
+  else
+  {
+    ndevs = edgex_metadata_client_get_devices
+      (svc->logger, &svc->config.endpoints, svc->name, DEVICE_LOAD_BATCH, populate_devices, svc->devices, err);
+  }
 
   if (err->code)
   {
     iot_log_error (svc->logger, "Unable to retrieve device list from metadata");
     return;
   }
+  iot_log_info (svc->logger, "Loaded %u devices from metadata", ndevs);
+  startup_phase (svc, "device load", phase);
+
+  if (svc->config.device.cachefile)
+  {
+    edgex_cache_save (svc);
+  }
+}
+
+static const char *service_host (devsdk_service_t *svc, struct utsname *buffer)
+{
+  if (svc->config.service.host)
+  {
+    return svc->config.service.host;
+  }
+  uname (buffer);
+  return buffer->nodename;
+}
+
+static void *reconcile_job (void *p)
+{
+  devsdk_service_t *svc = (devsdk_service_t *) p;
+  devsdk_error err = EDGEX_OK;
+  struct utsname buffer;
+
+  sync_metadata (svc, service_host (svc, &buffer), true, &err);
+  if (err.code)
+  {
+    iot_log_error (svc->logger, "Unable to synchronize with metadata: continuing with cached devices");
+  }
+  return NULL;
+}
+
+static void startConfigured (devsdk_service_t *svc, toml_table_t *config, devsdk_error *err)
+{
+  struct utsname buffer;
+  unsigned ncached = 0;
+  const char *myhost = service_host (svc, &buffer);
+
+  svc->adminstate = UNLOCKED;
+  svc->opstate = ENABLED;
+
+  uint64_t phase = iot_time_msecs ();
 
-  edgex_devmap_populate_devices (svc->devices, devs);
-  edgex_device_free (devs);
+  /* AutoEvents, posting of readings and discovery each have their own
+   * threads (see workpool.h).
+   */
+
+  for (unsigned c = 0; c < EDGEX_WORK_NCLASSES; c++)
+  {
+    uint32_t prio = svc->config.service.priority[c];
+    svc->pools[c] = edgex_workpool_alloc (svc->config.service.threads[c], prio ? (int) prio : -1, svc->logger);
+    edgex_workpool_start (svc->pools[c]);
+  }
+
+  /* AutoEvents are scheduled as devices are added, so the timer wheel is
+   * needed before any devices are loaded.
+   */
+
+  svc->wheel = edgex_timerwheel_alloc
+    (svc->pools[EDGEX_WORK_AUTOEVENT], (uint64_t) svc->config.device.aetick * 1000, svc->logger);
+
+  /* Wait for data to be available. Metadata is required unless devices can
+   * be loaded from the cache.
+   */
+
+  if (!ping_client (svc->logger, "core-data", &svc->config.endpoints.data, svc->config.service.connectretries, svc->config.service.timeout, err))
+  {
+    return;
+  }
+  if (svc->config.device.cachefile && (ncached = edgex_cache_load (svc)))
+  {
+    iot_log_info (svc->logger, "Loaded %u devices from cache file %s", ncached, svc->config.device.cachefile);
+    startup_phase (svc, "cache load", phase);
+  }
+  else
+  {
+    sync_metadata (svc, myhost, false, err);
+    if (err->code)
+    {
+      return;
+    }
+  }
 
   /* Start REST server now so that we get the callbacks on device addition */
 
@@ -446,6 +544,10 @@ static void startConfigured (devsdk_service_t *svc, toml_table_t *config, devsdk
   {
     return;
   }
+  edgex_rest_server_enable_compression
+    (svc->daemon, svc->config.service.compressminsize);
+  edgex_rest_server_set_maxsize
+    (svc->daemon, svc->config.service.maxrequestsize);
 
   edgex_rest_server_register_handler
   (
@@ -490,10 +592,18 @@ static void startConfigured (devsdk_service_t *svc, toml_table_t *config, devsdk
 
   /* Start scheduled events */
 
-  iot_scheduler_start (svc->scheduler);
+  edgex_timerwheel_start (svc->wheel);
 
   /* Register REST handlers */
 
+  svc->admission = edgex_admission_alloc
+  (
+    svc->config.device.maxconcurrent,
+    svc->config.device.maxdevicecmds,
+    svc->config.device.cmdqueuelen,
+    svc->config.device.cmdqueuetimeout
+  );
+
   edgex_rest_server_register_handler
   (
     svc->daemon, EDGEX_DEV_API_DEVICE, GET | PUT | POST, svc,
@@ -524,6 +634,13 @@ static void startConfigured (devsdk_service_t *svc, toml_table_t *config, devsdk
     svc->daemon, EDGEX_DEV_API_PING, GET, svc, ping_handler
   );
 
+  /* Devices were loaded from the cache: reconcile with metadata */
+
+  if (ncached)
+  {
+    iot_threadpool_add_work (svc->thpool, reconcile_job, svc, -1);
+  }
+
   /* Ready. Register ourselves and log that we have started. */
 
   if (svc->registry)
@@ -774,28 +891,30 @@ void devsdk_post_readings
   devsdk_commandresult *values
 )
 {
-  edgex_device *dev = edgex_devmap_device_byname (svc->devices, devname);
+  edgex_devmap_read_begin (svc->devices);
+  const edgex_device *dev = edgex_devmap_lookup_byname (svc->devices, devname);
   if (dev == NULL)
   {
+    edgex_devmap_read_end (svc->devices);
     iot_log_error (svc->logger, "Post readings: no such device %s", devname);
     return;
   }
 
   const edgex_cmdinfo *command = edgex_deviceprofile_findcommand
     (resname, dev->profile, true);
-  edgex_device_release (dev);
+  edgex_devmap_read_end (svc->devices);
 
   if (command)
   {
     edgex_event_cooked *event = edgex_data_process_event
-      (devname, command, values, svc->config.device.datatransform);
+      (devname, command, values, svc->config.device.datatransform, false);
 
     if (event)
     {
       postparams *pp = malloc (sizeof (postparams));
       pp->svc = svc;
       pp->event = event;
-      iot_threadpool_add_work (svc->thpool, doPost, pp, -1);
+      edgex_workpool_add (svc->pools[EDGEX_WORK_POST], doPost, pp);
     }
   }
   else
@@ -812,9 +931,9 @@ void devsdk_service_stop (devsdk_service_t *svc, bool force, devsdk_error *err)
   {
     *svc->stopconfig = true;
   }
-  if (svc->scheduler)
+  if (svc->wheel)
   {
-    iot_scheduler_stop (svc->scheduler);
+    edgex_timerwheel_stop (svc->wheel);
   }
   if (svc->daemon)
   {
@@ -830,8 +949,16 @@ void devsdk_service_stop (devsdk_service_t *svc, bool force, devsdk_error *err)
       iot_log_error (svc->logger, "Unable to deregister service from registry");
     }
   }
-  iot_scheduler_free (svc->scheduler);
+  for (unsigned c = 0; c < EDGEX_WORK_NCLASSES; c++)
+  {
+    if (svc->pools[c])
+    {
+      edgex_workpool_wait (svc->pools[c]);
+    }
+  }
   iot_threadpool_wait (svc->thpool);
+  edgex_timerwheel_free (svc->wheel);
+  svc->wheel = NULL;
   iot_log_info (svc->logger, "Stopped device service");
 }
 
@@ -841,6 +968,13 @@ void devsdk_service_free (devsdk_service_t *svc)
   {
     edgex_devmap_free (svc->devices);
     edgex_watchlist_free (svc->watchlist);
+    edgex_autoevents_free (svc->autoevents);
+    edgex_ratelog_free (svc->ratelog);
+    edgex_admission_free (svc->admission);
+    for (unsigned c = 0; c < EDGEX_WORK_NCLASSES; c++)
+    {
+      edgex_workpool_free (svc->pools[c]);
+    }
     iot_threadpool_free (svc->thpool);
     devsdk_registry_free (svc->registry);
     devsdk_registry_fini ();
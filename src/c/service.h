@@ -16,8 +16,11 @@
 #include "devmap.h"
 #include "watchers.h"
 #include "rest-server.h"
+#include "admission.h"
 #include "iot/threadpool.h"
-#include "iot/scheduler.h"
+#include "timerwheel.h"
+#include "autoevent.h"
+#include "ratelog.h"
 
 struct devsdk_service_t
 {
@@ -39,8 +42,12 @@ struct devsdk_service_t
 
   edgex_devmap_t *devices;
   edgex_watchlist_t *watchlist;
+  edgex_admission_t *admission;
   iot_threadpool_t *thpool;
-  iot_scheduler_t *scheduler;
+  edgex_workpool *pools[EDGEX_WORK_NCLASSES];
+  edgex_timerwheel *wheel;
+  edgex_autoevents_t *autoevents;
+  edgex_ratelog *ratelog;
   pthread_mutex_t discolock;
 };
 
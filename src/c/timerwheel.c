@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/* Level n of the wheel covers times up to 256^(n+1) ticks ahead, in slots of
+ * 256^n ticks. A timer is placed in the lowest level that covers its expiry
+ * time, and each time the current tick crosses a slot boundary on a higher
+ * level the timers in that slot are moved ("cascaded") down. Timers in the
+ * current slot of level 0 have expired.
+ *
+ * A driver thread sleeps until the next occupied slot of level 0 or the next
+ * cascade, whichever is sooner. Timers are reference counted: the wheel holds
+ * one reference until the timer is cancelled, and each queued or running
+ * invocation of the timer function holds another.
+ *
+ * Deadlines are held in nanoseconds from the start of the wheel, and only the
+ * expiry time is rounded to a tick. An interval that is not a whole number of
+ * ticks therefore does not accumulate rounding error: the firings land on the
+ * nearest following tick, and the long-run rate is exact.
+ */
+
+#include "timerwheel.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_SPAN ((uint64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+#define WHEEL_NEVER UINT64_MAX
+
+struct edgex_timer
+{
+  edgex_timer *next;
+  edgex_timer **pprev;
+  uint64_t deadline;
+  uint64_t due;
+  uint64_t expires;
+  uint64_t interval;
+  uint64_t jitter;
+  edgex_timer_fn fn;
+  void *arg;
+  edgex_timer_release_fn release;
+  atomic_uint_fast64_t fired;
+  atomic_uint_fast32_t refs;
+  atomic_bool cancelled;
+};
+
+struct edgex_timerwheel
+{
+  edgex_timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  uint64_t occupied[WHEEL_SLOTS / 64];
+  uint64_t now;
+  uint64_t wake;
+  uint64_t tick_ns;
+  uint64_t base_ns;
+  uint64_t rng;
+  unsigned count;
+  edgex_timer **batch;
+  unsigned nbatch;
+  unsigned batchcap;
+  bool running;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  edgex_workpool *pool;
+  iot_logger_t *lc;
+};
+
+static uint64_t monotonic_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t current_tick (const edgex_timerwheel *w)
+{
+  return (monotonic_ns () - w->base_ns) / w->tick_ns;
+}
+
+static uint64_t to_ticks (const edgex_timerwheel *w, uint64_t ns)
+{
+  return (ns + w->tick_ns - 1) / w->tick_ns;
+}
+
+/* Set the expiry time for a timer's next deadline, applying jitter. The
+ * generator is xorshift64*, and is protected by the wheel's lock.
+ */
+
+static void timer_set_expiry (edgex_timerwheel *w, edgex_timer *t)
+{
+  t->due = t->deadline;
+  if (t->jitter)
+  {
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    t->due += ((w->rng * 0x2545f4914f6cdd1dULL) >> 32) % (t->jitter + 1);
+  }
+  t->expires = to_ticks (w, t->due);
+}
+
+static void timer_unref (edgex_timer *t)
+{
+  if (atomic_fetch_add (&t->refs, -1) == 1)
+  {
+    if (t->release)
+    {
+      t->release (t->arg);
+    }
+    free (t);
+  }
+}
+
+/* Place a timer in the wheel. Expiry times beyond the range of the wheel are
+ * parked in the top level, and re-placed when that slot is cascaded.
+ */
+
+static void timer_link (edgex_timerwheel *w, edgex_timer *t)
+{
+  uint64_t when = t->expires;
+  uint64_t delta = when - w->now;
+  unsigned level = 0;
+  unsigned slot;
+  edgex_timer **head;
+
+  if (delta >= WHEEL_SPAN)
+  {
+    delta = WHEEL_SPAN - 1;
+    when = w->now + delta;
+  }
+  while (delta >= ((uint64_t) WHEEL_SLOTS << (WHEEL_BITS * level)))
+  {
+    level++;
+  }
+  slot = (when >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  if (level == 0)
+  {
+    w->occupied[slot / 64] |= (uint64_t) 1 << (slot % 64);
+  }
+
+  head = &w->slots[level][slot];
+  t->next = *head;
+  if (t->next)
+  {
+    t->next->pprev = &t->next;
+  }
+  t->pprev = head;
+  *head = t;
+}
+
+static void timer_unlink (edgex_timer *t)
+{
+  *t->pprev = t->next;
+  if (t->next)
+  {
+    t->next->pprev = t->pprev;
+  }
+  t->pprev = NULL;
+}
+
+/* Advance by one tick: cascade the higher levels, then collect the timers in
+ * the current slot of level 0 into the batch and reschedule them. A timer
+ * whose next deadline has already passed (because the driver has fallen
+ * behind, or the firing was delayed by jitter) skips the missed deadlines
+ * rather than firing for each of them.
+ */
+
+static void wheel_tick (edgex_timerwheel *w)
+{
+  unsigned slot;
+  edgex_timer *t;
+  edgex_timer *next;
+
+  w->now++;
+  for (unsigned level = WHEEL_LEVELS - 1; level > 0; level--)
+  {
+    if ((w->now & (((uint64_t) 1 << (WHEEL_BITS * level)) - 1)) == 0)
+    {
+      slot = (w->now >> (WHEEL_BITS * level)) & WHEEL_MASK;
+      t = w->slots[level][slot];
+      w->slots[level][slot] = NULL;
+      for (; t; t = next)
+      {
+        next = t->next;
+        timer_link (w, t);
+      }
+    }
+  }
+
+  slot = w->now & WHEEL_MASK;
+  if ((w->occupied[slot / 64] & ((uint64_t) 1 << (slot % 64))) == 0)
+  {
+    return;
+  }
+  w->occupied[slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+  t = w->slots[0][slot];
+  w->slots[0][slot] = NULL;
+  for (; t; t = next)
+  {
+    next = t->next;
+    if (w->nbatch == w->batchcap)
+    {
+      w->batchcap = w->batchcap ? w->batchcap * 2 : 64;
+      w->batch = realloc (w->batch, w->batchcap * sizeof (edgex_timer *));
+    }
+    /* An invocation which has not started by the time the timer fires again
+     * will see the later time.
+     */
+
+    atomic_fetch_add (&t->refs, 1);
+    atomic_store (&t->fired, w->base_ns + t->due);
+    w->batch[w->nbatch++] = t;
+
+    t->deadline += t->interval;
+    if (t->deadline <= w->now * w->tick_ns)
+    {
+      t->deadline +=
+        ((w->now * w->tick_ns - t->deadline) / t->interval + 1) * t->interval;
+    }
+    timer_set_expiry (w, t);
+    timer_link (w, t);
+  }
+}
+
+/* Number of ticks until the next occupied slot of level 0, or zero if none.
+ * Bits may be set for slots whose timers have since been cancelled.
+ */
+
+static unsigned next_occupied (const edgex_timerwheel *w)
+{
+  unsigned d = 1;
+  while (d <= WHEEL_SLOTS)
+  {
+    unsigned slot = (w->now + d) & WHEEL_MASK;
+    uint64_t bits = w->occupied[slot / 64] >> (slot % 64);
+    if (bits)
+    {
+      return d + __builtin_ctzll (bits);
+    }
+    d += 64 - (slot % 64);
+  }
+  return 0;
+}
+
+static uint64_t next_wake (const edgex_timerwheel *w)
+{
+  uint64_t result;
+  unsigned d;
+
+  if (w->count == 0)
+  {
+    return WHEEL_NEVER;
+  }
+  result = (w->now | WHEEL_MASK) + 1;
+  d = next_occupied (w);
+  if (d && w->now + d < result)
+  {
+    result = w->now + d;
+  }
+  return result;
+}
+
+static void *timer_fire (void *p)
+{
+  edgex_timer *t = (edgex_timer *) p;
+  if (!atomic_load (&t->cancelled))
+  {
+    t->fn (t->arg, atomic_load (&t->fired));
+  }
+  timer_unref (t);
+  return NULL;
+}
+
+static void *wheel_driver (void *p)
+{
+  edgex_timerwheel *w = (edgex_timerwheel *) p;
+
+  pthread_mutex_lock (&w->lock);
+  while (w->running)
+  {
+    uint64_t target = current_tick (w);
+    if (w->count == 0 && target > w->now)
+    {
+      w->now = target;
+    }
+    while (w->now < target)
+    {
+      wheel_tick (w);
+    }
+
+    if (w->nbatch)
+    {
+      unsigned n = w->nbatch;
+      w->nbatch = 0;
+      w->wake = WHEEL_NEVER;
+      pthread_mutex_unlock (&w->lock);
+      for (unsigned i = 0; i < n; i++)
+      {
+        edgex_workpool_add (w->pool, timer_fire, w->batch[i]);
+      }
+      pthread_mutex_lock (&w->lock);
+      continue;
+    }
+
+    w->wake = next_wake (w);
+    if (w->wake == WHEEL_NEVER)
+    {
+      pthread_cond_wait (&w->cond, &w->lock);
+    }
+    else
+    {
+      struct timespec deadline;
+      uint64_t ns = w->base_ns + w->wake * w->tick_ns;
+      deadline.tv_sec = ns / 1000000000;
+      deadline.tv_nsec = ns % 1000000000;
+      pthread_cond_timedwait (&w->cond, &w->lock, &deadline);
+    }
+  }
+  pthread_mutex_unlock (&w->lock);
+  return NULL;
+}
+
+edgex_timerwheel *edgex_timerwheel_alloc
+  (edgex_workpool *pool, uint64_t tick_ns, iot_logger_t *lc)
+{
+  pthread_condattr_t attr;
+  edgex_timerwheel *w = calloc (1, sizeof (edgex_timerwheel));
+  w->pool = pool;
+  w->lc = lc;
+  w->tick_ns = tick_ns ? tick_ns : 1;
+  w->base_ns = monotonic_ns ();
+  w->rng = w->base_ns | 1;
+  w->wake = WHEEL_NEVER;
+  pthread_mutex_init (&w->lock, NULL);
+  pthread_condattr_init (&attr);
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+  pthread_cond_init (&w->cond, &attr);
+  pthread_condattr_destroy (&attr);
+  return w;
+}
+
+void edgex_timerwheel_start (edgex_timerwheel *w)
+{
+  pthread_mutex_lock (&w->lock);
+  if (!w->running)
+  {
+    w->running = true;
+    if (pthread_create (&w->thread, NULL, wheel_driver, w) != 0)
+    {
+      iot_log_error (w->lc, "Unable to start timer thread");
+      w->running = false;
+    }
+    else
+    {
+      iot_log_debug (w->lc, "Timer wheel started, tick %" PRIu64 "ns", w->tick_ns);
+    }
+  }
+  pthread_mutex_unlock (&w->lock);
+}
+
+void edgex_timerwheel_stop (edgex_timerwheel *w)
+{
+  bool running;
+
+  pthread_mutex_lock (&w->lock);
+  running = w->running;
+  w->running = false;
+  pthread_cond_signal (&w->cond);
+  pthread_mutex_unlock (&w->lock);
+  if (running)
+  {
+    pthread_join (w->thread, NULL);
+  }
+}
+
+/* The wheel should be stopped, and the thread pool idle, before it is freed */
+
+void edgex_timerwheel_free (edgex_timerwheel *w)
+{
+  if (w)
+  {
+    for (unsigned level = 0; level < WHEEL_LEVELS; level++)
+    {
+      for (unsigned slot = 0; slot < WHEEL_SLOTS; slot++)
+      {
+        edgex_timer *t;
+        while ((t = w->slots[level][slot]))
+        {
+          timer_unlink (t);
+          atomic_store (&t->cancelled, true);
+          timer_unref (t);
+        }
+      }
+    }
+    pthread_cond_destroy (&w->cond);
+    pthread_mutex_destroy (&w->lock);
+    free (w->batch);
+    free (w);
+  }
+}
+
+edgex_timer *edgex_timerwheel_add
+(
+  edgex_timerwheel *w,
+  uint64_t interval_ns,
+  uint64_t offset_ns,
+  uint64_t jitter_ns,
+  edgex_timer_fn fn,
+  void *arg,
+  edgex_timer_release_fn release
+)
+{
+  uint64_t now;
+  uint64_t offset;
+  edgex_timer *t = malloc (sizeof (edgex_timer));
+
+  t->interval = interval_ns ? interval_ns : 1;
+  offset = offset_ns ? offset_ns : t->interval;
+  t->jitter = jitter_ns;
+  if (t->jitter >= t->interval)
+  {
+    t->jitter = t->interval - 1;
+  }
+  t->fn = fn;
+  t->arg = arg;
+  t->release = release;
+  atomic_init (&t->fired, 0);
+  atomic_init (&t->refs, 1);
+  atomic_init (&t->cancelled, false);
+
+  pthread_mutex_lock (&w->lock);
+  now = current_tick (w);
+  if (w->count == 0 && now > w->now)
+  {
+    w->now = now;
+  }
+  t->deadline = now * w->tick_ns + offset;
+  timer_set_expiry (w, t);
+  timer_link (w, t);
+  w->count++;
+  if (t->expires < w->wake)
+  {
+    pthread_cond_signal (&w->cond);
+  }
+  pthread_mutex_unlock (&w->lock);
+  return t;
+}
+
+void edgex_timerwheel_cancel (edgex_timerwheel *w, edgex_timer *t)
+{
+  pthread_mutex_lock (&w->lock);
+  atomic_store (&t->cancelled, true);
+  if (t->pprev)
+  {
+    timer_unlink (t);
+    w->count--;
+  }
+  pthread_mutex_unlock (&w->lock);
+  timer_unref (t);
+}
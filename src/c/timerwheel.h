@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_TIMERWHEEL_H_
+#define _EDGEX_DEVICE_TIMERWHEEL_H_ 1
+
+/* Hierarchical timing wheel for periodic timers. Timers are held in four
+ * levels of 256 slots each; adding and cancelling a timer, and expiring it,
+ * are constant-time operations. Time advances in ticks of a fixed length,
+ * and a timer's deadlines are exact multiples of its interval (which need not
+ * be a whole number of ticks) from its first deadline, so that it does not
+ * drift. All timers expiring in a tick are submitted to the thread pool
+ * together.
+ */
+
+#include "workpool.h"
+#include "iot/logger.h"
+
+struct edgex_timerwheel;
+typedef struct edgex_timerwheel edgex_timerwheel;
+
+struct edgex_timer;
+typedef struct edgex_timer edgex_timer;
+
+/* Timer function. Runs in the thread pool; successive invocations for a
+ * single timer may overlap if it takes longer than the timer's interval.
+ * The time at which the timer was due to fire is passed in scheduled_ns
+ * (CLOCK_MONOTONIC).
+ */
+
+typedef void (*edgex_timer_fn) (void *arg, uint64_t scheduled_ns);
+
+/* Called when a timer's arg is no longer in use, ie, after the timer has
+ * been cancelled and any running invocations of its function have finished.
+ */
+
+typedef void (*edgex_timer_release_fn) (void *arg);
+
+extern edgex_timerwheel *edgex_timerwheel_alloc
+  (edgex_workpool *pool, uint64_t tick_ns, iot_logger_t *lc);
+extern void edgex_timerwheel_start (edgex_timerwheel *w);
+extern void edgex_timerwheel_stop (edgex_timerwheel *w);
+extern void edgex_timerwheel_free (edgex_timerwheel *w);
+
+/* Add a timer which fires every interval_ns. The first deadline is offset_ns
+ * from now, or interval_ns if offset_ns is zero. If jitter_ns is nonzero,
+ * each firing is delayed by a random amount up to jitter_ns (but less than
+ * the interval); this does not affect later deadlines. Each firing takes
+ * place on the first tick at or after its deadline.
+ */
+
+extern edgex_timer *edgex_timerwheel_add
+(
+  edgex_timerwheel *w,
+  uint64_t interval_ns,
+  uint64_t offset_ns,
+  uint64_t jitter_ns,
+  edgex_timer_fn fn,
+  void *arg,
+  edgex_timer_release_fn release
+);
+
+/* Cancel a timer. This must be called exactly once for each timer, after
+ * which the timer must not be used.
+ */
+
+extern void edgex_timerwheel_cancel (edgex_timerwheel *w, edgex_timer *t);
+
+#endif
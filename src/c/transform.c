@@ -7,6 +7,7 @@
  */
 
 #include "transform.h"
+#include "data.h"
 
 #include <math.h>
 #include <limits.h>
@@ -88,6 +89,10 @@ static iot_data_t *setLLInt (long long int llival, const edgex_propertyvalue *pr
 void edgex_transform_outgoing
   (devsdk_commandresult *cres, edgex_propertyvalue *props, devsdk_nvpairs *mappings)
 {
+  if (transformsOn (props) || props->type == IOT_DATA_STRING)
+  {
+    edgex_data_materialize (cres, props->type);
+  }
   switch (props->type)
   {
     case IOT_DATA_FLOAT32:
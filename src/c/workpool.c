@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "workpool.h"
+#include "histogram.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+const char *edgex_workclass_names[] = { "AutoEvent", "Post", "Discovery", NULL };
+
+/* Jobs are wrapped to record their queueing time. The wrappers are kept on a
+ * free list for reuse, so that a pool in steady use does not allocate them.
+ */
+
+typedef struct edgex_workitem
+{
+  edgex_workpool *wp;
+  void *(*fn) (void *);
+  void *arg;
+  uint64_t queued;
+  struct edgex_workitem *next;
+} edgex_workitem;
+
+struct edgex_workpool
+{
+  iot_threadpool_t *pool;
+  unsigned threads;
+  pthread_mutex_t lock;
+  edgex_workitem *spare;
+  edgex_histogram_t *wait;
+  atomic_uint_fast64_t queued;
+  atomic_uint_fast64_t running;
+  atomic_uint_fast64_t completed;
+};
+
+static uint64_t mono_nsecs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+edgex_workpool *edgex_workpool_alloc (unsigned threads, int priority, iot_logger_t *lc)
+{
+  edgex_workpool *wp = calloc (1, sizeof (edgex_workpool));
+  wp->pool = iot_threadpool_alloc (threads, 0, priority, -1, lc);
+  wp->threads = threads;
+  pthread_mutex_init (&wp->lock, NULL);
+  wp->wait = edgex_histogram_alloc ();
+  atomic_init (&wp->queued, 0);
+  atomic_init (&wp->running, 0);
+  atomic_init (&wp->completed, 0);
+  return wp;
+}
+
+void edgex_workpool_start (edgex_workpool *wp)
+{
+  iot_threadpool_start (wp->pool);
+}
+
+static void *workpool_run (void *p)
+{
+  edgex_workitem *item = (edgex_workitem *) p;
+  edgex_workpool *wp = item->wp;
+  void *(*fn) (void *) = item->fn;
+  void *arg = item->arg;
+
+  edgex_histogram_record (wp->wait, (mono_nsecs () - item->queued) / 1000);
+  pthread_mutex_lock (&wp->lock);
+  item->next = wp->spare;
+  wp->spare = item;
+  pthread_mutex_unlock (&wp->lock);
+
+  atomic_fetch_add (&wp->running, 1);
+  atomic_fetch_sub (&wp->queued, 1);
+  fn (arg);
+  atomic_fetch_sub (&wp->running, 1);
+  atomic_fetch_add (&wp->completed, 1);
+  return NULL;
+}
+
+void edgex_workpool_add (edgex_workpool *wp, void *(*fn) (void *), void *arg)
+{
+  edgex_workitem *item;
+
+  pthread_mutex_lock (&wp->lock);
+  item = wp->spare;
+  if (item)
+  {
+    wp->spare = item->next;
+  }
+  pthread_mutex_unlock (&wp->lock);
+  if (item == NULL)
+  {
+    item = malloc (sizeof (edgex_workitem));
+    item->wp = wp;
+  }
+  item->fn = fn;
+  item->arg = arg;
+  item->queued = mono_nsecs ();
+  atomic_fetch_add (&wp->queued, 1);
+  iot_threadpool_add_work (wp->pool, workpool_run, item, -1);
+}
+
+void edgex_workpool_wait (edgex_workpool *wp)
+{
+  iot_threadpool_wait (wp->pool);
+}
+
+void edgex_workpool_free (edgex_workpool *wp)
+{
+  if (wp)
+  {
+    iot_threadpool_free (wp->pool);
+    while (wp->spare)
+    {
+      edgex_workitem *next = wp->spare->next;
+      free (wp->spare);
+      wp->spare = next;
+    }
+    edgex_histogram_free (wp->wait);
+    pthread_mutex_destroy (&wp->lock);
+    free (wp);
+  }
+}
+
+JSON_Value *edgex_workpool_metrics (edgex_workpool *wp)
+{
+  JSON_Value *val = json_value_init_object ();
+  JSON_Object *obj = json_value_get_object (val);
+
+  json_object_set_uint (obj, "Threads", wp->threads);
+  json_object_set_uint (obj, "Queued", atomic_load (&wp->queued));
+  json_object_set_uint (obj, "Running", atomic_load (&wp->running));
+  json_object_set_uint (obj, "Completed", atomic_load (&wp->completed));
+  json_object_set_value (obj, "Wait", edgex_histogram_summary (wp->wait));
+  return val;
+}
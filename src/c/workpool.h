@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_WORKPOOL_H_
+#define _EDGEX_DEVICE_WORKPOOL_H_ 1
+
+/* Thread pools for the classes of work which the service performs in the
+ * background: running AutoEvents, posting readings supplied by the driver,
+ * and discovery. Each class has its own threads, so that a burst of work in
+ * one class does not delay the others; device commands are handled on the
+ * REST server's threads, and so are not delayed by any of them. Each pool
+ * counts its queued, running and completed jobs, and records the time jobs
+ * wait before starting.
+ */
+
+#include "iot/threadpool.h"
+#include "iot/logger.h"
+#include "parson.h"
+
+typedef enum edgex_workclass
+{
+  EDGEX_WORK_AUTOEVENT,
+  EDGEX_WORK_POST,
+  EDGEX_WORK_DISCOVERY,
+  EDGEX_WORK_NCLASSES
+} edgex_workclass;
+
+extern const char *edgex_workclass_names[];
+
+struct edgex_workpool;
+typedef struct edgex_workpool edgex_workpool;
+
+/* A priority of -1 leaves the threads' scheduling priority at the default */
+
+extern edgex_workpool *edgex_workpool_alloc (unsigned threads, int priority, iot_logger_t *lc);
+extern void edgex_workpool_start (edgex_workpool *wp);
+extern void edgex_workpool_add (edgex_workpool *wp, void *(*fn) (void *), void *arg);
+
+/* Wait until there are no jobs queued or running */
+
+extern void edgex_workpool_wait (edgex_workpool *wp);
+extern void edgex_workpool_free (edgex_workpool *wp);
+
+/* Returns a JSON object containing Threads, Queued, Running, Completed, and
+ * a summary of the time in microseconds for which jobs waited to start.
+ */
+
+extern JSON_Value *edgex_workpool_metrics (edgex_workpool *wp);
+
+#endif
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/*
+ * Checks that AutoEvents on resources read as scalars (using
+ * devsdk_commandresult_set_float etc) make no heap allocations once running,
+ * both when every reading is posted and when readings are suppressed by
+ * onChange.
+ *
+ * The SDK modules which run AutoEvents are built into this program. The rest
+ * of the SDK, and the parts of the iot library that those modules use, are
+ * replaced by the stubs below; in particular posting an event is a no-op, so
+ * the encoding and sending of readings is not covered. malloc, calloc,
+ * realloc and strdup are wrapped at link time to count allocations.
+ */
+
+#include "service.h"
+#include "autoevent.h"
+#include "cmdinfo.h"
+#include "device.h"
+#include "data.h"
+#include "metadata.h"
+#include "correlation.h"
+#include "transform.h"
+#include "workpool.h"
+#include "timerwheel.h"
+#include "errorlist.h"
+#include "intern.h"
+#include "iot/time.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_FREQUENCY "10ms"
+#define TEST_WARMUP_US 200000
+#define TEST_PERIOD_US 1000000
+#define TEST_PRIME_JOBS 64
+
+/* Allocation counting */
+
+extern void *__real_malloc (size_t size);
+extern void *__real_calloc (size_t n, size_t size);
+extern void *__real_realloc (void *ptr, size_t size);
+extern char *__real_strdup (const char *s);
+
+extern void *__wrap_malloc (size_t size);
+extern void *__wrap_calloc (size_t n, size_t size);
+extern void *__wrap_realloc (void *ptr, size_t size);
+extern char *__wrap_strdup (const char *s);
+
+static atomic_uint allocs = 0;
+
+void *__wrap_malloc (size_t size)
+{
+  atomic_fetch_add (&allocs, 1);
+  return __real_malloc (size);
+}
+
+void *__wrap_calloc (size_t n, size_t size)
+{
+  atomic_fetch_add (&allocs, 1);
+  return __real_calloc (n, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size)
+{
+  atomic_fetch_add (&allocs, 1);
+  return __real_realloc (ptr, size);
+}
+
+char *__wrap_strdup (const char *s)
+{
+  atomic_fetch_add (&allocs, 1);
+  return __real_strdup (s);
+}
+
+/* iot library stubs. The thread pool keeps finished jobs for reuse so that
+ * it does not itself allocate once running.
+ */
+
+void iot_log_error (iot_logger_t *lc, const char *fmt, ...) {}
+void iot_log_warn (iot_logger_t *lc, const char *fmt, ...) {}
+void iot_log_info (iot_logger_t *lc, const char *fmt, ...) {}
+void iot_log_debug (iot_logger_t *lc, const char *fmt, ...) {}
+void iot_log_trace (iot_logger_t *lc, const char *fmt, ...) {}
+
+uint64_t iot_time_nsecs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef struct test_job
+{
+  void *(*fn) (void *);
+  void *arg;
+  struct test_job *next;
+} test_job;
+
+#define TEST_POOL_THREADS 4
+
+struct iot_threadpool_t
+{
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t idle;
+  test_job *head;
+  test_job *tail;
+  test_job *spare;
+  unsigned busy;
+  pthread_t threads[TEST_POOL_THREADS];
+};
+
+static void *pool_thread (void *p)
+{
+  iot_threadpool_t *pool = (iot_threadpool_t *) p;
+  pthread_mutex_lock (&pool->lock);
+  while (true)
+  {
+    while (pool->head == NULL)
+    {
+      pthread_cond_wait (&pool->work, &pool->lock);
+    }
+    test_job *job = pool->head;
+    pool->head = job->next;
+    if (pool->head == NULL)
+    {
+      pool->tail = NULL;
+    }
+    pool->busy++;
+    pthread_mutex_unlock (&pool->lock);
+    job->fn (job->arg);
+    pthread_mutex_lock (&pool->lock);
+    job->next = pool->spare;
+    pool->spare = job;
+    if (--pool->busy == 0 && pool->head == NULL)
+    {
+      pthread_cond_broadcast (&pool->idle);
+    }
+  }
+  return NULL;
+}
+
+iot_threadpool_t *iot_threadpool_alloc (uint16_t threads, uint32_t max_jobs, int priority, int affinity, iot_logger_t *lc)
+{
+  iot_threadpool_t *pool = calloc (1, sizeof (iot_threadpool_t));
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->work, NULL);
+  pthread_cond_init (&pool->idle, NULL);
+  return pool;
+}
+
+bool iot_threadpool_start (iot_threadpool_t *pool)
+{
+  for (unsigned i = 0; i < TEST_POOL_THREADS; i++)
+  {
+    pthread_create (&pool->threads[i], NULL, pool_thread, pool);
+  }
+  return true;
+}
+
+void iot_threadpool_add_work (iot_threadpool_t *pool, void *(*fn) (void *), void *arg, int priority)
+{
+  pthread_mutex_lock (&pool->lock);
+  test_job *job = pool->spare;
+  if (job)
+  {
+    pool->spare = job->next;
+  }
+  else
+  {
+    job = malloc (sizeof (test_job));
+  }
+  job->fn = fn;
+  job->arg = arg;
+  job->next = NULL;
+  if (pool->tail)
+  {
+    pool->tail->next = job;
+  }
+  else
+  {
+    pool->head = job;
+  }
+  pool->tail = job;
+  pthread_cond_signal (&pool->work);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+void iot_threadpool_wait (iot_threadpool_t *pool)
+{
+  pthread_mutex_lock (&pool->lock);
+  while (pool->head || pool->busy)
+  {
+    pthread_cond_wait (&pool->idle, &pool->lock);
+  }
+  pthread_mutex_unlock (&pool->lock);
+}
+
+void iot_threadpool_free (iot_threadpool_t *pool) {}
+
+/* Readings are only ever held as scalars here, so the iot_data accessors are
+ * not reached.
+ */
+
+iot_data_type_t iot_data_type (const iot_data_t *d) { return IOT_DATA_FLOAT64; }
+iot_data_t *iot_data_copy (const iot_data_t *d) { return NULL; }
+void iot_data_free (iot_data_t *d) {}
+iot_data_t *iot_data_alloc_f64 (double val) { return NULL; }
+iot_data_t *iot_data_alloc_ui64 (uint64_t val) { return NULL; }
+int8_t iot_data_i8 (const iot_data_t *d) { return 0; }
+uint8_t iot_data_ui8 (const iot_data_t *d) { return 0; }
+int16_t iot_data_i16 (const iot_data_t *d) { return 0; }
+uint16_t iot_data_ui16 (const iot_data_t *d) { return 0; }
+int32_t iot_data_i32 (const iot_data_t *d) { return 0; }
+uint32_t iot_data_ui32 (const iot_data_t *d) { return 0; }
+int64_t iot_data_i64 (const iot_data_t *d) { return 0; }
+uint64_t iot_data_ui64 (const iot_data_t *d) { return 0; }
+float iot_data_f32 (const iot_data_t *d) { return 0; }
+double iot_data_f64 (const iot_data_t *d) { return 0; }
+bool iot_data_bool (const iot_data_t *d) { return false; }
+const char *iot_data_string (const iot_data_t *d) { return NULL; }
+const void *iot_data_address (const iot_data_t *d) { return NULL; }
+uint32_t iot_data_array_size (const iot_data_t *d) { return 0; }
+
+/* SDK stubs: a single device with two commands which share a resource */
+
+static atomic_uint gets = 0;
+static atomic_uint events = 0;
+static edgex_event_cooked cooked;
+static edgex_device thedev;
+
+static devsdk_commandrequest reqs1[] = { { "r1" } };
+static devsdk_commandrequest reqs2[] = { { "r2" }, { "r1" } };
+static edgex_cmdinfo cmds[] = { { "c1", true, 1, reqs1 }, { "c2", true, 2, reqs2 } };
+
+const edgex_cmdinfo *edgex_deviceprofile_findcommand (const char *name, edgex_deviceprofile *prof, bool forGet)
+{
+  for (unsigned i = 0; i < sizeof (cmds) / sizeof (cmds[0]); i++)
+  {
+    if (strcmp (cmds[i].name, name) == 0)
+    {
+      return &cmds[i];
+    }
+  }
+  return NULL;
+}
+
+edgex_device *edgex_devmap_device_byname (edgex_devmap_t *map, const char *name)
+{
+  return &thedev;
+}
+
+void edgex_device_release (edgex_device *dev) {}
+void edgex_device_alloc_crlid (const char *id) {}
+void edgex_device_free_crlid (void) {}
+void edgex_transform_outgoing (devsdk_commandresult *cres, edgex_propertyvalue *props, devsdk_nvpairs *mappings) {}
+
+void edgex_metadata_client_set_device_opstate
+  (iot_logger_t *lc, edgex_service_endpoints *endpoints, const char *deviceid, edgex_device_operatingstate opstate, devsdk_error *err) {}
+
+edgex_event_cooked *edgex_data_process_event_batch
+  (const char *device_name, const edgex_cmdinfo *commandinfo, devsdk_commandresult *values, uint32_t nsamples, bool doTransforms, bool compress)
+{
+  atomic_fetch_add (&events, 1);
+  return &cooked;
+}
+
+void edgex_data_client_add_event (iot_logger_t *lc, edgex_service_endpoints *endpoints, edgex_event_cooked *ev, devsdk_error *err)
+{
+  *err = EDGEX_OK;
+}
+
+void edgex_event_cooked_free (edgex_event_cooked *e) {}
+
+static bool test_get_handler
+(
+  void *impl,
+  const char *devname,
+  const devsdk_protocols *protocols,
+  uint32_t nreadings,
+  const devsdk_commandrequest *requests,
+  devsdk_commandresult *readings,
+  const devsdk_nvpairs *qparams,
+  iot_data_t **exception
+)
+{
+  atomic_fetch_add (&gets, 1);
+  for (uint32_t i = 0; i < nreadings; i++)
+  {
+    devsdk_commandresult_set_float (&readings[i], 20.0);
+  }
+  return true;
+}
+
+static edgex_device_autoevents *test_autoevent (const char *resource, bool onChange, edgex_device_autoevents *next)
+{
+  edgex_device_autoevents *ae = calloc (1, sizeof (edgex_device_autoevents));
+  ae->resource = (char *) resource;
+  ae->frequency = (char *) TEST_FREQUENCY;
+  ae->onChange = onChange;
+  ae->next = next;
+  return ae;
+}
+
+/* The work pool and thread pool keep a free list which grows to the largest
+ * number of jobs queued at once. Fill them first, so that a scheduling delay
+ * during the measurement does not show up as growth.
+ */
+
+static void *test_pause (void *arg)
+{
+  usleep (1000);
+  return NULL;
+}
+
+static void test_prime (edgex_workpool *pool)
+{
+  for (unsigned i = 0; i < TEST_PRIME_JOBS; i++)
+  {
+    edgex_workpool_add (pool, test_pause, NULL);
+  }
+  edgex_workpool_wait (pool);
+}
+
+static bool test_run (devsdk_service_t *svc, edgex_workpool *pool, bool onChange)
+{
+  thedev.autos = test_autoevent ("c1", onChange, test_autoevent ("c2", onChange, NULL));
+  svc->wheel = edgex_timerwheel_alloc (pool, 1000000, NULL);
+  edgex_timerwheel_start (svc->wheel);
+  edgex_device_autoevent_start (svc, &thedev);
+
+  usleep (TEST_WARMUP_US);
+  unsigned a0 = allocs;
+  unsigned g0 = gets;
+  unsigned e0 = events;
+  usleep (TEST_PERIOD_US);
+  unsigned a1 = allocs;
+  unsigned g1 = gets;
+  unsigned e1 = events;
+
+  edgex_device_autoevent_stop (&thedev);
+  iot_threadpool_wait (svc->thpool);
+  edgex_timerwheel_stop (svc->wheel);
+  edgex_workpool_wait (pool);
+  edgex_timerwheel_free (svc->wheel);
+  svc->wheel = NULL;
+  for (edgex_device_autoevents *ae = thedev.autos, *next; ae; ae = next)
+  {
+    next = ae->next;
+    free (ae);
+  }
+
+  printf
+  (
+    "%s: %u readings, %u events, %u allocations\n",
+    onChange ? "onChange" : "posted", g1 - g0, e1 - e0, a1 - a0
+  );
+  return (g1 > g0) && (a1 == a0);
+}
+
+int main (void)
+{
+  devsdk_service_t svc;
+  memset (&svc, 0, sizeof (svc));
+  svc.thpool = iot_threadpool_alloc (TEST_POOL_THREADS, 0, -1, -1, NULL);
+  iot_threadpool_start (svc.thpool);
+  edgex_workpool *pool = edgex_workpool_alloc (TEST_POOL_THREADS, -1, NULL);
+  edgex_workpool_start (pool);
+  svc.autoevents = edgex_autoevents_alloc ();
+  svc.userfns.gethandler = test_get_handler;
+  svc.config.device.maxcmdops = 128;
+  test_prime (pool);
+
+  thedev.name = (char *) edgex_intern ("dev1");
+  thedev.adminState = UNLOCKED;
+  thedev.operatingState = ENABLED;
+
+  bool ok = test_run (&svc, pool, false);
+  ok = test_run (&svc, pool, true) && ok;
+  printf ("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/*
+ * Measures the latency of device lookups made for device commands while
+ * devices are being added in bulk. Reader threads look up random devices by
+ * name, as for a command request, while the main thread adds devices either
+ * one at a time (as for callbacks from metadata or discovery) or in one
+ * batch (as at startup). A run with no writer gives the baseline.
+ *
+ * Usage: devmap-bench [devices [readers]]  (default 10000 2)
+ */
+
+#include "devmap.h"
+#include "edgex-rest.h"
+#include "intern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_READERS 16
+#define BENCH_MAX_SAMPLES 2000000
+#define BENCH_BASELINE_US 500000
+
+typedef struct bench_reader
+{
+  pthread_t thread;
+  unsigned seed;
+  unsigned nsamples;
+  uint64_t *samples;
+} bench_reader;
+
+static edgex_devmap_t *map;
+static unsigned ndevices;
+static atomic_bool running;
+
+static uint64_t bench_nsecs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *bench_read (void *p)
+{
+  bench_reader *r = (bench_reader *) p;
+  char name[32];
+
+  r->nsamples = 0;
+  while (atomic_load (&running) && r->nsamples < BENCH_MAX_SAMPLES)
+  {
+    r->seed = r->seed * 1103515245 + 12345;
+    sprintf (name, "bench-device-%u", (r->seed >> 8) % ndevices);
+    uint64_t t0 = bench_nsecs ();
+    edgex_device *dev = edgex_devmap_device_byname (map, name);
+    if (dev)
+    {
+      edgex_device_release (dev);
+    }
+    r->samples[r->nsamples++] = bench_nsecs () - t0;
+  }
+  return NULL;
+}
+
+static int bench_cmp (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a;
+  uint64_t y = *(const uint64_t *) b;
+  return (x < y) ? -1 : (x > y);
+}
+
+static void bench_report (const char *label, double secs, bench_reader *readers, unsigned nreaders)
+{
+  unsigned n = 0;
+  for (unsigned i = 0; i < nreaders; i++)
+  {
+    n += readers[i].nsamples;
+  }
+  uint64_t *all = malloc ((n ? n : 1) * sizeof (uint64_t));
+  n = 0;
+  for (unsigned i = 0; i < nreaders; i++)
+  {
+    memcpy (all + n, readers[i].samples, readers[i].nsamples * sizeof (uint64_t));
+    n += readers[i].nsamples;
+  }
+  printf ("%-12s %7.3f s, %8u lookups", label, secs, n);
+  if (n)
+  {
+    qsort (all, n, sizeof (uint64_t), bench_cmp);
+    printf
+    (
+      ": p50 %7.1f us, p99 %7.1f us, p99.9 %8.1f us, max %8.1f us",
+      all[n / 2] / 1e3, all[(uint64_t) n * 99 / 100] / 1e3, all[(uint64_t) n * 999 / 1000] / 1e3, all[n - 1] / 1e3
+    );
+  }
+  printf ("\n");
+  free (all);
+}
+
+static void bench_start (bench_reader *readers, unsigned nreaders)
+{
+  atomic_store (&running, true);
+  for (unsigned i = 0; i < nreaders; i++)
+  {
+    readers[i].seed = i + 1;
+    pthread_create (&readers[i].thread, NULL, bench_read, &readers[i]);
+  }
+}
+
+static void bench_stop (bench_reader *readers, unsigned nreaders)
+{
+  atomic_store (&running, false);
+  for (unsigned i = 0; i < nreaders; i++)
+  {
+    pthread_join (readers[i].thread, NULL);
+  }
+}
+
+int main (int argc, char *argv[])
+{
+  unsigned nreaders = (argc > 2) ? strtoul (argv[2], NULL, 10) : 2;
+  bench_reader readers[BENCH_MAX_READERS];
+  edgex_deviceprofile profile;
+  edgex_device *devices;
+  char name[32];
+  uint64_t t0;
+
+  ndevices = (argc > 1) ? strtoul (argv[1], NULL, 10) : 10000;
+  if (ndevices == 0)
+  {
+    ndevices = 1;
+  }
+  if (nreaders > BENCH_MAX_READERS)
+  {
+    nreaders = BENCH_MAX_READERS;
+  }
+  for (unsigned i = 0; i < nreaders; i++)
+  {
+    readers[i].samples = malloc (BENCH_MAX_SAMPLES * sizeof (uint64_t));
+  }
+
+  memset (&profile, 0, sizeof (profile));
+  profile.id = "bench-profile-id";
+  profile.name = edgex_intern ("bench-profile");
+  profile.description = "";
+  profile.manufacturer = "";
+  profile.model = "";
+
+  devices = calloc (ndevices, sizeof (edgex_device));
+  for (unsigned i = 0; i < ndevices; i++)
+  {
+    sprintf (name, "bench-device-%u", i);
+    devices[i].name = edgex_intern (name);
+    sprintf (name, "%08x-bench-%u", i * 2654435761u, i);
+    devices[i].id = edgex_intern (name);
+    devices[i].description = "";
+    devices[i].profile = &profile;
+    devices[i].adminState = UNLOCKED;
+    devices[i].operatingState = ENABLED;
+    devices[i].next = (i + 1 < ndevices) ? &devices[i + 1] : NULL;
+  }
+
+  map = edgex_devmap_alloc (NULL);
+  edgex_devmap_populate_devices (map, devices);
+  bench_start (readers, nreaders);
+  usleep (BENCH_BASELINE_US);
+  bench_stop (readers, nreaders);
+  bench_report ("no writer", BENCH_BASELINE_US / 1e6, readers, nreaders);
+
+  edgex_devmap_clear (map);
+  bench_start (readers, nreaders);
+  t0 = bench_nsecs ();
+  for (unsigned i = 0; i < ndevices; i++)
+  {
+    edgex_devmap_replace_device (map, &devices[i]);
+  }
+  double secs = (bench_nsecs () - t0) / 1e9;
+  bench_stop (readers, nreaders);
+  bench_report ("single adds", secs, readers, nreaders);
+
+  edgex_devmap_clear (map);
+  bench_start (readers, nreaders);
+  t0 = bench_nsecs ();
+  edgex_devmap_populate_devices (map, devices);
+  secs = (bench_nsecs () - t0) / 1e9;
+  bench_stop (readers, nreaders);
+  bench_report ("batch add", secs, readers, nreaders);
+
+  edgex_devmap_free (map);
+  for (unsigned i = 0; i < ndevices; i++)
+  {
+    edgex_intern_release (devices[i].name);
+    edgex_intern_release (devices[i].id);
+  }
+  free (devices);
+  edgex_intern_release (profile.name);
+  for (unsigned i = 0; i < nreaders; i++)
+  {
+    free (readers[i].samples);
+  }
+  return 0;
+}
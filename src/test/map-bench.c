@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/*
+ * Compares edgex_map with the chained map that it replaced. For each map size
+ * the keys are device-id style strings; lookups are made in a shuffled order
+ * with copies of the keys, as for names arriving in a request, and with keys
+ * that are not present. For edgex_map, lookups are also made with interned
+ * keys, as for names taken from the SDK's own structures.
+ *
+ * Usage: map-bench [size...]  (default 1000 100000 1000000)
+ */
+
+#include "map.h"
+#include "map-chained.h"
+#include "intern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_KEYLEN 40
+#define BENCH_LOOKUPS 4000000
+
+typedef edgex_map(void *) bench_map;
+
+static double bench_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *bench_keys (unsigned n, unsigned seed)
+{
+  char *keys = malloc ((size_t) n * BENCH_KEYLEN);
+  for (unsigned i = 0; i < n; i++)
+  {
+    unsigned x = (i + seed) * 2654435761u;
+    sprintf (keys + (size_t) i * BENCH_KEYLEN, "%08x-%04x-4%03x-9%03x-%012u", x, seed & 0xffff, i % 4096, x % 4096, i);
+  }
+  return keys;
+}
+
+static unsigned *bench_order (unsigned n)
+{
+  unsigned *order = malloc (n * sizeof (unsigned));
+  for (unsigned i = 0; i < n; i++)
+  {
+    order[i] = i;
+  }
+  srand (n);
+  for (unsigned i = n - 1; i > 0; i--)
+  {
+    unsigned j = rand () % (i + 1);
+    unsigned t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  return order;
+}
+
+static void bench_size (unsigned n)
+{
+  char *keys = bench_keys (n, 1);
+  char *copies = malloc ((size_t) n * BENCH_KEYLEN);
+  char *absent = bench_keys (n, 2);
+  unsigned *order = bench_order (n);
+  unsigned passes = BENCH_LOOKUPS / n ? BENCH_LOOKUPS / n : 1;
+  double t0, t1, t2, t3;
+  unsigned long found;
+
+  memcpy (copies, keys, (size_t) n * BENCH_KEYLEN);
+
+  chained_map cm;
+  memset (&cm, 0, sizeof (cm));
+  t0 = bench_now ();
+  for (unsigned i = 0; i < n; i++)
+  {
+    char *k = keys + (size_t) i * BENCH_KEYLEN;
+    chained_map_set (&cm, k, &k, sizeof (k));
+  }
+  t1 = bench_now ();
+  found = 0;
+  for (unsigned p = 0; p < passes; p++)
+  {
+    for (unsigned i = 0; i < n; i++)
+    {
+      found += chained_map_get (&cm, copies + (size_t) order[i] * BENCH_KEYLEN) != NULL;
+    }
+  }
+  t2 = bench_now ();
+  for (unsigned p = 0; p < passes; p++)
+  {
+    for (unsigned i = 0; i < n; i++)
+    {
+      found += chained_map_get (&cm, absent + (size_t) order[i] * BENCH_KEYLEN) != NULL;
+    }
+  }
+  t3 = bench_now ();
+  printf
+  (
+    "%8u chained: insert %6.1f ns, lookup %6.1f ns, miss %6.1f ns (%lu found)\n",
+    n, (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / passes / n, (t3 - t2) * 1e9 / passes / n, found
+  );
+  chained_map_deinit (&cm);
+
+  bench_map m;
+  edgex_map_init (&m);
+  t0 = bench_now ();
+  for (unsigned i = 0; i < n; i++)
+  {
+    char *k = keys + (size_t) i * BENCH_KEYLEN;
+    edgex_map_set (&m, k, k);
+  }
+  t1 = bench_now ();
+  found = 0;
+  for (unsigned p = 0; p < passes; p++)
+  {
+    for (unsigned i = 0; i < n; i++)
+    {
+      found += edgex_map_get (&m, copies + (size_t) order[i] * BENCH_KEYLEN) != NULL;
+    }
+  }
+  t2 = bench_now ();
+  for (unsigned p = 0; p < passes; p++)
+  {
+    for (unsigned i = 0; i < n; i++)
+    {
+      found += edgex_map_get (&m, absent + (size_t) order[i] * BENCH_KEYLEN) != NULL;
+    }
+  }
+  t3 = bench_now ();
+  printf
+  (
+    "%8u edgex:   insert %6.1f ns, lookup %6.1f ns, miss %6.1f ns (%lu found)\n",
+    n, (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / passes / n, (t3 - t2) * 1e9 / passes / n, found
+  );
+
+  char **interned = malloc (n * sizeof (char *));
+  for (unsigned i = 0; i < n; i++)
+  {
+    interned[i] = edgex_intern (copies + (size_t) order[i] * BENCH_KEYLEN);
+  }
+  found = 0;
+  t0 = bench_now ();
+  for (unsigned p = 0; p < passes; p++)
+  {
+    for (unsigned i = 0; i < n; i++)
+    {
+      found += edgex_map_get (&m, interned[i]) != NULL;
+    }
+  }
+  t1 = bench_now ();
+  printf ("%8u edgex:   interned lookup %6.1f ns (%lu found)\n", n, (t1 - t0) * 1e9 / passes / n, found);
+  for (unsigned i = 0; i < n; i++)
+  {
+    edgex_intern_release (interned[i]);
+  }
+  free (interned);
+  edgex_map_deinit (&m);
+
+  free (order);
+  free (absent);
+  free (copies);
+  free (keys);
+}
+
+int main (int argc, char *argv[])
+{
+  if (argc > 1)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      bench_size (strtoul (argv[i], NULL, 10));
+    }
+  }
+  else
+  {
+    bench_size (1000);
+    bench_size (100000);
+    bench_size (1000000);
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "map-chained.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Based on rxi's type-safe hashmap implementation */
+
+/**
+ * Copyright (c) 2014 rxi
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the MIT license. See LICENSE for details.
+ */
+
+struct chained_map_node
+{
+  unsigned hash;
+  void *value;
+  chained_map_node *next;
+};
+
+static unsigned chained_hash (const char *str)
+{
+  unsigned hash = 5381u;
+  while (*str)
+  {
+    hash = ((hash << 5) + hash) ^ *str++;
+  }
+  return hash;
+}
+
+static chained_map_node *chained_map_newnode (const char *key, void *value, int vsize)
+{
+  chained_map_node *node;
+  int ksize = strlen (key) + 1;
+  int voffset = ksize + ((sizeof (void *) - ksize) % sizeof (void *));
+  node = malloc (sizeof (*node) + voffset + vsize);
+  if (!node)
+  { return NULL; }
+  memcpy (node + 1, key, ksize);
+  node->hash = chained_hash (key);
+  node->value = ((char *) (node + 1)) + voffset;
+  memcpy (node->value, value, vsize);
+  return node;
+}
+
+static void chained_map_addnode (chained_map *m, chained_map_node *node)
+{
+  int n = node->hash & (m->nbuckets - 1);
+  node->next = m->buckets[n];
+  m->buckets[n] = node;
+}
+
+static int chained_map_resize (chained_map *m, int nbuckets)
+{
+  chained_map_node *nodes, *node, *next;
+  chained_map_node **buckets;
+  int i;
+  /* Chain all nodes together */
+  nodes = NULL;
+  i = m->nbuckets;
+  while (i--)
+  {
+    node = (m->buckets)[i];
+    while (node)
+    {
+      next = node->next;
+      node->next = nodes;
+      nodes = node;
+      node = next;
+    }
+  }
+  /* Reset buckets */
+  buckets = realloc (m->buckets, sizeof (*m->buckets) * nbuckets);
+  if (buckets != NULL)
+  {
+    m->buckets = buckets;
+    m->nbuckets = nbuckets;
+  }
+  if (m->buckets)
+  {
+    memset (m->buckets, 0, sizeof (*m->buckets) * m->nbuckets);
+    /* Re-add nodes to buckets */
+    node = nodes;
+    while (node)
+    {
+      next = node->next;
+      chained_map_addnode (m, node);
+      node = next;
+    }
+  }
+  /* Return error code if realloc() failed */
+  return (buckets == NULL) ? -1 : 0;
+}
+
+static chained_map_node **chained_map_getref (chained_map *m, const char *key)
+{
+  unsigned hash = chained_hash (key);
+  if (m->nbuckets > 0)
+  {
+    chained_map_node **next = &m->buckets[hash & (m->nbuckets - 1)];
+    while (*next)
+    {
+      if ((*next)->hash == hash && !strcmp ((char *) (*next + 1), key))
+      {
+        return next;
+      }
+      next = &(*next)->next;
+    }
+  }
+  return NULL;
+}
+
+void chained_map_deinit (chained_map *m)
+{
+  chained_map_node *next, *node;
+  int i;
+  i = m->nbuckets;
+  while (i--)
+  {
+    node = m->buckets[i];
+    while (node)
+    {
+      next = node->next;
+      free (node);
+      node = next;
+    }
+  }
+  free (m->buckets);
+  memset (m, 0, sizeof (*m));
+}
+
+void *chained_map_get (chained_map *m, const char *key)
+{
+  chained_map_node **next = chained_map_getref (m, key);
+  return next ? (*next)->value : NULL;
+}
+
+int chained_map_set (chained_map *m, const char *key, void *value, int vsize)
+{
+  int n, err;
+  chained_map_node **next, *node;
+  /* Find & replace existing node */
+  next = chained_map_getref (m, key);
+  if (next)
+  {
+    memcpy ((*next)->value, value, vsize);
+    return 0;
+  }
+  /* Add new node */
+  node = chained_map_newnode (key, value, vsize);
+  if (node == NULL)
+  { goto fail; }
+  if (m->nnodes >= m->nbuckets)
+  {
+    n = (m->nbuckets > 0) ? (m->nbuckets << 1) : 1;
+    err = chained_map_resize (m, n);
+    if (err)
+    { goto fail; }
+  }
+  chained_map_addnode (m, node);
+  m->nnodes++;
+  return 0;
+  fail:
+  if (node)
+  { free (node); }
+  return -1;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef _EDGEX_DEVICE_MAP_CHAINED_H_
+#define _EDGEX_DEVICE_MAP_CHAINED_H_ 1
+
+/* The chained hash map which edgex_map replaced, kept as a baseline for
+ * map-bench. Each entry is a separate allocation holding the key and value.
+ */
+
+typedef struct chained_map_node chained_map_node;
+
+typedef struct
+{
+  chained_map_node **buckets;
+  unsigned nbuckets;
+  unsigned nnodes;
+} chained_map;
+
+extern void chained_map_deinit (chained_map *m);
+
+extern void *chained_map_get (chained_map *m, const char *key);
+
+extern int chained_map_set (chained_map *m, const char *key, void *value, int vsize);
+
+#endif
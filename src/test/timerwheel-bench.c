@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2020
+ * IoTech Ltd
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/*
+ * Measures the cost and accuracy of the AutoEvent timing wheel. For each
+ * schedule size, timers with random intervals between 100ms and 1s are run
+ * on a 1ms tick for a fixed period. Reported are the time taken to add and
+ * cancel a timer, the CPU time used per firing (wheel, work pool and a
+ * trivial timer function), and the lateness of firings relative to their
+ * deadlines.
+ *
+ * Usage: timerwheel-bench [seconds [size...]]  (default 5 1000 10000 100000)
+ */
+
+#include "timerwheel.h"
+#include "workpool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_THREADS 8
+#define BENCH_TICK_NS 1000000
+#define BENCH_BUCKETS 32
+
+static atomic_uint_fast64_t fires = 0;
+static atomic_uint_fast64_t late_sum = 0;
+static atomic_uint_fast64_t late_max = 0;
+static atomic_uint_fast64_t late_hist[BENCH_BUCKETS];
+static atomic_uint releases = 0;
+
+static uint64_t bench_nsecs (clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime (clock, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Lateness is recorded in power-of-two buckets of microseconds */
+
+static void bench_fire (void *arg, uint64_t scheduled_ns)
+{
+  uint64_t now = bench_nsecs (CLOCK_MONOTONIC);
+  uint64_t late = (now > scheduled_ns) ? now - scheduled_ns : 0;
+  uint64_t max = atomic_load (&late_max);
+  unsigned b = 0;
+
+  atomic_fetch_add (&fires, 1);
+  atomic_fetch_add (&late_sum, late);
+  while (late > max && !atomic_compare_exchange_weak (&late_max, &max, late));
+  for (uint64_t us = late / 1000; us && b < BENCH_BUCKETS - 1; us >>= 1)
+  {
+    b++;
+  }
+  atomic_fetch_add (&late_hist[b], 1);
+}
+
+static void bench_release (void *arg)
+{
+  atomic_fetch_add (&releases, 1);
+}
+
+/* Upper bound in microseconds of the lateness of a fraction q of firings */
+
+static uint64_t bench_percentile (double q)
+{
+  uint64_t total = 0;
+  uint64_t acc = 0;
+  for (unsigned b = 0; b < BENCH_BUCKETS; b++)
+  {
+    total += late_hist[b];
+  }
+  for (unsigned b = 0; b < BENCH_BUCKETS; b++)
+  {
+    acc += late_hist[b];
+    if (acc >= q * total)
+    {
+      return 1ULL << b;
+    }
+  }
+  return 0;
+}
+
+static void bench_size (edgex_workpool *pool, unsigned n, unsigned secs)
+{
+  edgex_timerwheel *w = edgex_timerwheel_alloc (pool, BENCH_TICK_NS, NULL);
+  edgex_timer **timers = malloc (n * sizeof (edgex_timer *));
+  uint64_t *intervals = malloc (n * sizeof (uint64_t));
+  uint64_t expected = 0;
+  uint64_t t0, t1, t2, t3, c0, c1;
+
+  atomic_store (&fires, 0);
+  atomic_store (&late_sum, 0);
+  atomic_store (&late_max, 0);
+  atomic_store (&releases, 0);
+  for (unsigned b = 0; b < BENCH_BUCKETS; b++)
+  {
+    atomic_store (&late_hist[b], 0);
+  }
+  srand (n);
+  for (unsigned i = 0; i < n; i++)
+  {
+    intervals[i] = (100 + rand () % 900) * 1000000ULL;
+  }
+
+  edgex_timerwheel_start (w);
+  c0 = bench_nsecs (CLOCK_PROCESS_CPUTIME_ID);
+  t0 = bench_nsecs (CLOCK_MONOTONIC);
+  for (unsigned i = 0; i < n; i++)
+  {
+    timers[i] = edgex_timerwheel_add (w, intervals[i], 0, 0, bench_fire, NULL, bench_release);
+  }
+  t1 = bench_nsecs (CLOCK_MONOTONIC);
+  sleep (secs);
+  t2 = bench_nsecs (CLOCK_MONOTONIC);
+  for (unsigned i = 0; i < n; i++)
+  {
+    edgex_timerwheel_cancel (w, timers[i]);
+  }
+  t3 = bench_nsecs (CLOCK_MONOTONIC);
+  edgex_timerwheel_stop (w);
+  edgex_workpool_wait (pool);
+  c1 = bench_nsecs (CLOCK_PROCESS_CPUTIME_ID);
+  edgex_timerwheel_free (w);
+
+  for (unsigned i = 0; i < n; i++)
+  {
+    expected += (t2 - t0) / intervals[i];
+  }
+  uint64_t nfires = atomic_load (&fires);
+  printf
+  (
+    "%7u timers: add %4.0f ns, cancel %4.0f ns, %5.0f ns CPU/firing; %llu firings (%llu expected); "
+    "lateness mean %.0f us, p50 < %llu us, p99 < %llu us, max %.0f us; %u released\n",
+    n, (double) (t1 - t0) / n, (double) (t3 - t2) / n, nfires ? (double) (c1 - c0) / nfires : 0.0,
+    (unsigned long long) nfires, (unsigned long long) expected,
+    nfires ? (double) late_sum / nfires / 1000 : 0.0,
+    (unsigned long long) bench_percentile (0.5), (unsigned long long) bench_percentile (0.99),
+    (double) late_max / 1000, (unsigned) releases
+  );
+
+  free (intervals);
+  free (timers);
+}
+
+int main (int argc, char *argv[])
+{
+  unsigned secs = (argc > 1) ? strtoul (argv[1], NULL, 10) : 5;
+  edgex_workpool *pool = edgex_workpool_alloc (BENCH_THREADS, -1, NULL);
+  edgex_workpool_start (pool);
+
+  if (argc > 2)
+  {
+    for (int i = 2; i < argc; i++)
+    {
+      bench_size (pool, strtoul (argv[i], NULL, 10), secs);
+    }
+  }
+  else
+  {
+    bench_size (pool, 1000, secs);
+    bench_size (pool, 10000, secs);
+    bench_size (pool, 100000, secs);
+  }
+  edgex_workpool_free (pool);
+  return 0;
+}